@@ -0,0 +1,387 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2006 Vlado Potisk <vlado_potisk@clex.sk>
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from http://www.clex.sk
+ *
+ */
+
+#include <config.h>
+
+#include <sys/types.h>		/* pid_t */
+#include <errno.h>			/* errno */
+#include <fcntl.h>			/* fcntl() */
+#include <poll.h>			/* poll() */
+#include <signal.h>			/* kill() */
+#include <stdio.h>			/* printf() */
+#include <stdlib.h>			/* free() */
+#include <string.h>			/* strlen() */
+#include <unistd.h>			/* read() */
+
+/* waitpid() */
+#ifdef HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
+#ifndef WEXITSTATUS
+# define WEXITSTATUS(status) ((unsigned)(status) >> 8)
+#endif
+#ifndef WIFEXITED
+# define WIFEXITED(status) (((status) & 255) == 0)
+#endif
+
+#include "clex.h"
+#include "batch.h"
+
+#include "cfg.h"			/* config_num() */
+#include "edit.h"			/* edit_isspecial() */
+#include "exec.h"			/* exec_background() */
+#include "inout.h"			/* curses_stop() */
+#include "list.h"			/* list_refresh() */
+#include "sdstring.h"		/* SDSTR() */
+#include "tty.h"			/* tty_setraw() */
+#include "undo.h"			/* undo_reset() */
+#include "ustring.h"		/* USTR() */
+#include "util.h"			/* emalloc() */
+
+/*
+ * Batch execution: the command line is a template, it is expanded
+ * and executed once for every selected file. Up to BATCH_JOBS
+ * commands run at the same time. The output of each command is
+ * collected and printed as a whole when the command finishes, so
+ * the outputs of parallel commands do not mix.
+ */
+
+#define BATCH_MAX	64		/* max number of parallel commands */
+#define STATUS_NOTRUN	(-1000)	/* the command was not started */
+
+typedef struct {
+	pid_t pid;				/* process ID, 0 = free slot */
+	int fd;					/* output pipe, -1 = closed */
+	int item;				/* index into 'files' */
+	char *out;				/* collected output */
+	size_t outlen, outalloc;
+} BATCH_SLOT;
+
+static FILE_ENTRY **files;	/* the selected files */
+static int *status;			/* exit code or -signal of every command */
+static int total, done;		/* number of commands: all, finished */
+
+/*
+ * expand the template 'tmpl' for the file 'name':
+ *   $f -> file name
+ *   $b -> file name without the extension
+ *   $$ -> literal $
+ * names are quoted, everything else is copied literally
+ */
+static char *
+batch_expand(const char *tmpl, const char *name)
+{
+	int pass;
+	size_t len, baselen;
+	char ch, *cmd, *dst;
+	const char *src, *ins, *dot;
+
+	dot = strrchr(name,'.');
+	baselen = dot && dot != name ? dot - name : strlen(name);
+
+	/* 1st pass computes the length, 2nd pass builds the command */
+	cmd = dst = 0;
+	for (pass = 0; pass < 2; pass++) {
+		for (len = 0, src = tmpl; (ch = *src++); ) {
+			if (ch == '$' && (*src == 'f' || *src == 'b')) {
+				for (ins = name; *ins && (*src == 'f'
+				  || ins < name + baselen); ins++) {
+					if (edit_isspecial((unsigned char)*ins)) {
+						if (pass)
+							*dst++ = '\\';
+						len++;
+					}
+					if (pass)
+						*dst++ = *ins;
+					len++;
+				}
+				src++;
+				continue;
+			}
+			if (ch == '$' && *src == '$')
+				src++;
+			if (pass)
+				*dst++ = ch;
+			len++;
+		}
+		if (pass == 0)
+			cmd = dst = emalloc(len + 1);
+	}
+	*dst = '\0';
+	return cmd;
+}
+
+/* append the " $f" if the template does not contain a file name */
+static const char *
+batch_template(const char *line)
+{
+	const char *pch;
+	static USTRING tmpl = { 0,0 };
+
+	for (pch = line; (pch = strchr(pch,'$')); pch += 2)
+		if (pch[1] == 'f' || pch[1] == 'b')
+			return line;
+		else if (pch[1] == '\0')
+			break;
+	us_cat(&tmpl,line," $f",(char *)0);
+	return USTR(tmpl);
+}
+
+static int
+batch_jobs(void)
+{
+	int jobs;
+
+	if ( (jobs = config_num(CFG_BATCH_JOBS)) == 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+		jobs = 1;
+#endif
+	}
+	LIMIT_MIN(jobs,1);
+	LIMIT_MAX(jobs,BATCH_MAX);
+	return jobs;
+}
+
+/* start the command for the file 'item' in the slot 'ps' */
+static void
+batch_start(BATCH_SLOT *ps, const char *tmpl, int item)
+{
+	int fd[2];
+	char *cmd;
+
+	ps->item = item;
+	ps->outlen = 0;
+	if (pipe(fd) < 0) {
+		printf("[%d/%d] CANNOT START %s: %s\n",++done,total,
+		  SDSTR(files[item]->file),strerror(errno));
+		return;
+	}
+	fcntl(fd[0],F_SETFD,FD_CLOEXEC);
+	fcntl(fd[1],F_SETFD,FD_CLOEXEC);
+	cmd = batch_expand(tmpl,SDSTR(files[item]->file));
+	ps->pid = exec_background(cmd,fd[1]);
+	free(cmd);
+	close(fd[1]);
+	if (ps->pid < 0) {
+		printf("[%d/%d] CANNOT START %s: %s\n",++done,total,
+		  SDSTR(files[item]->file),strerror(errno));
+		ps->pid = 0;
+		close(fd[0]);
+		return;
+	}
+	ps->fd = fd[0];
+}
+
+/* collect the output, return value: 0 = EOF */
+static int
+batch_read(BATCH_SLOT *ps)
+{
+	ssize_t rd;
+
+	if (ps->outalloc - ps->outlen < 4096) {
+		ps->outalloc += ps->outalloc + 4096;
+		ps->out = erealloc(ps->out,ps->outalloc);
+	}
+	rd = read(ps->fd,ps->out + ps->outlen,ps->outalloc - ps->outlen);
+	if (rd < 0 && errno == EINTR)
+		return 1;
+	if (rd <= 0) {
+		close(ps->fd);
+		ps->fd = -1;
+		return 0;
+	}
+	ps->outlen += rd;
+	return 1;
+}
+
+/* check if the command in the slot 'ps' has finished */
+static void
+batch_reap(BATCH_SLOT *ps)
+{
+	int code;
+
+	if (waitpid(ps->pid,&code,WNOHANG) <= 0)
+		return;
+
+	ps->pid = 0;
+	code = WIFEXITED(code) ? WEXITSTATUS(code) : -WTERMSIG(code);
+	status[ps->item] = code;
+	printf("[%d/%d] ",++done,total);
+	if (code == 0)
+		printf("ok      %s\n",SDSTR(files[ps->item]->file));
+	else if (code > 0)
+		printf("FAILED  %s (exit code %d)\n",
+		  SDSTR(files[ps->item]->file),code);
+	else
+		printf("FAILED  %s (signal %d)\n",
+		  SDSTR(files[ps->item]->file),-code);
+	if (ps->outlen) {
+		fwrite(ps->out,1,ps->outlen,stdout);
+		if (ps->out[ps->outlen - 1] != '\n')
+			putchar('\n');
+	}
+	fflush(stdout);
+}
+
+/* run all commands, return value: 1 = cancelled by the user */
+static int
+batch_run(const char *tmpl, int jobs)
+{
+	int i, n, next, running, timeout;
+	FLAG cancel;
+	char ch;
+	BATCH_SLOT slot[BATCH_MAX];
+	struct pollfd pfd[BATCH_MAX + 1];
+
+	for (i = 0; i < jobs; i++) {
+		slot[i].pid = 0;
+		slot[i].fd = -1;
+		slot[i].out = 0;
+		slot[i].outalloc = 0;
+	}
+
+	tty_setraw();	/* ctrl-C is read as a character */
+	for (next = 0, cancel = 0; ; ) {
+		for (running = i = 0; i < jobs; i++) {
+			if (slot[i].pid == 0 && !cancel && next < total)
+				batch_start(slot + i,tmpl,next++);
+			if (slot[i].pid)
+				running++;
+		}
+		if (running == 0 && (cancel || next == total))
+			break;
+
+		/* wait for output, command exit, or keyboard input */
+		pfd[0].fd = STDIN_FILENO;
+		pfd[0].events = POLLIN;
+		timeout = -1;
+		for (n = 1, i = 0; i < jobs; i++)
+			if (slot[i].fd >= 0) {
+				pfd[n].fd = slot[i].fd;
+				pfd[n++].events = POLLIN;
+			}
+			else if (slot[i].pid)
+				/* closed the output, but still running */
+				timeout = 100;
+		if (poll(pfd,n,timeout) < 0 && errno != EINTR)
+			break;
+
+		if ((pfd[0].revents & POLLIN) && read(STDIN_FILENO,&ch,1) == 1
+		  && (ch == CH_CTRL('C') || ch == CH_CTRL('G')) && !cancel) {
+			cancel = 1;
+			puts("\nCancelled, terminating the running commands.");
+			fflush(stdout);
+			for (i = 0; i < jobs; i++)
+				if (slot[i].pid)
+					kill(-slot[i].pid,SIGTERM);
+		}
+		for (n = 1, i = 0; i < jobs; i++) {
+			if (slot[i].fd >= 0 && pfd[n++].revents)
+				batch_read(slot + i);
+			if (slot[i].fd < 0 && slot[i].pid)
+				batch_reap(slot + i);
+		}
+	}
+	tty_reset();
+
+	for (i = 0; i < jobs; i++)
+		free(slot[i].out);
+	return cancel;
+}
+
+/* alt-X: execute the command line for every selected file */
+void
+cx_batch(void)
+{
+	int i, jobs, ok, failed, notrun;
+	FLAG cancel;
+	const char *tmpl;
+	char *example;
+
+	if (textline->size == 0) {
+		win_remark("type a command, $f stands for the file name");
+		return;
+	}
+	if (ppanel_file->selected == 0) {
+		win_remark("select the files to be processed first");
+		return;
+	}
+
+	total = ppanel_file->selected;
+	files = emalloc(total * sizeof(FILE_ENTRY *));
+	status = emalloc(total * sizeof(int));
+	for (i = done = 0; done < total; i++)
+		if (ppanel_file->files[i]->select) {
+			status[done] = STATUS_NOTRUN;
+			files[done++] = ppanel_file->files[i];
+		}
+	tmpl = batch_template(USTR(textline->line));
+	jobs = batch_jobs();
+	LIMIT_MAX(jobs,total);
+
+	curses_stop();
+	printf("\nBatch execution: %s\n",tmpl);
+	example = batch_expand(tmpl,SDSTR(files[0]->file));
+	printf("%d command(s) like: %s\n",total,example);
+	free(example);
+	printf("%d command(s) at a time, press ctrl-C to cancel\n",jobs);
+	print_warnings(tmpl);
+	fputs("\nExecute the commands ? (y = YES) ",stdout);
+	fflush(stdout);
+	tty_setraw();
+	i = getchar();
+	tty_reset();
+	puts(i == 'y' || i == 'Y' ? "yes\n" : "no\n");
+	fflush(stdout);
+
+	if (i == 'y' || i == 'Y') {
+		done = 0;
+		cancel = batch_run(tmpl,jobs);
+
+		for (ok = failed = notrun = i = 0; i < total; i++)
+			if (status[i] == 0)
+				ok++;
+			else if (status[i] == STATUS_NOTRUN)
+				notrun++;
+			else
+				failed++;
+		printf("\nBatch %s: %d successful, %d failed",
+		  cancel ? "cancelled" : "finished",ok,failed);
+		if (notrun)
+			printf(", %d not executed",notrun);
+		putchar('\n');
+		if (failed) {
+			puts("Failed:");
+			for (i = 0; i < total; i++)
+				if (status[i] != 0 && status[i] != STATUS_NOTRUN)
+					printf("  %s (%s %d)\n",SDSTR(files[i]->file),
+					  status[i] > 0 ? "exit code" : "signal",
+					  status[i] > 0 ? status[i] : -status[i]);
+		}
+		putchar('\n');
+		fflush(stdout);
+
+		list_refresh();
+		ppanel_file->other->outdated = 1;
+		cx_edit_kill();
+		undo_reset();
+	}
+	free(files);
+	free(status);
+
+	tty_press_enter();
+	curses_restart();
+}
@@ -0,0 +1 @@
+extern void cx_batch(void);
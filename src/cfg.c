@@ -33,6 +33,7 @@
 #include "help.h"		/* help_reconfig() */
 #include "history.h"	/* hist_reconfig() */
 #include "inout.h"		/* win_remark() */
+#include "latency.h"	/* lat_reconfig() */
 #include "list.h"		/* list_reconfig() */
 #include "sort.h"		/* sort_files() */
 #include "ustring.h"	/* USTR() */
@@ -95,6 +96,12 @@ static CNUM table_numeric[] = {
 	{ CFG_WARN_RM,		0, 0, 1, 1, 0, 0, { "No", "Yes" } },
 	{ CFG_WARN_LONG,	0, 0, 1, 1, 0, 0, { "No", "Yes" } },
 	{ CFG_WARN_SELECT,	0, 0, 1, 1, 0, 0, { "No", "Yes" } },
+	{ CFG_SHELL_COPROC,	0, 0, 1, 0, 0, 0,
+		{	"No, start a new shell for every command",
+			"Yes, keep the shell running" } },
+	{ CFG_LATENCY_STATS,	0, 0, 1, 0, 0, 0,
+		{	"No",
+			"Yes, measure the input latency" } },
 	{ CFG_XTERM_TITLE,	0, 0, 2, 1, 0, 0,
 		{	"No",
 			"AUTO (checking the terminal type $TERM)",
@@ -102,7 +109,8 @@ static CNUM table_numeric[] = {
 	/* really numeric */
 	{ CFG_C_SIZE,		"AUTO",	10, 100,  0, 0, 0, { 0 } },
 	{ CFG_D_SIZE,		"AUTO",	10, 100,  0, 0, 0, { 0 } },
-	{ CFG_H_SIZE,		0,		10, 100, 40, 0, 0, { 0 } },
+	{ CFG_H_SIZE,		0,		10, 100000, 40, 0, 0, { 0 } },
+	{ CFG_BATCH_JOBS,	"AUTO",	1, 64,  0, 0, 0, { 0 } },
 	{ CFG_SHOW_HIDDEN,	0, 0, 2, 0, 0, 0,
 		{	"Show hidden .files",
 			"Show hidden .files, except in home directory",
@@ -153,6 +161,8 @@ static struct {
 	CODE code;
 	char *help;
 } table_help[CFG_VARIABLES] = {
+	{ CFG_BATCH_JOBS,	"Parallel commands in batch execution "
+						"(AUTO = number of CPUs)" },
 	{ CFG_C_SIZE,		"Completion panel size (AUTO = screen size)" },
 	{ CFG_CMD_F3,		"Command F3 = view file(s)" },
 	{ CFG_CMD_F4,		"Command F4 = edit file(s)" },
@@ -184,6 +194,7 @@ static struct {
 	{ CFG_SHOW_HIDDEN,	"Appearance: Wether to show hidden .files" },
 	{ CFG_SHOW_LINKTRGT,	"Appearance: Wether to show link targets" },
 	{ CFG_KILOBYTE,		"Appearance: Filesize unit definition" },
+	{ CFG_LATENCY_STATS,	"Collect input latency statistics (alt-I)" },
 	{ CFG_LAYOUT,		"Appearance: "
 		"Which file panel layout is active" },
 	{ CFG_LAYOUT1,		"Appearance: File panel layout #1, see help" },
@@ -194,6 +205,8 @@ static struct {
 		"Command line prompt (AUTO = according to shell)" },
 	{ CFG_QUOTE,		"Additional filename chars to be quoted, "
 						"see help" },
+	{ CFG_SHELL_COPROC,	"Keep one shell process running "
+						"to execute commands" },
 	{ CFG_SHELLPROG,	"Shell program, see help "
 						"(AUTO = your login shell)" },
 	{ CFG_VIEWER_CMD,	"File viewer command" },
@@ -244,7 +257,10 @@ static CONFIG_ENTRY config[CFG_VARIABLES] = {
 	{ "VIEWER_CMD",		0,0,0,0,0 },
 	{ "NOPROMPT_CMDS",	0,0,0,0,0 },
 	{ "SHOW_HIDDEN",	0,0,0,0,0 },
-	{ "SHOW_LINKTRGT",	0,0,0,0,0 }
+	{ "SHOW_LINKTRGT",	0,0,0,0,0 },
+	{ "BATCH_JOBS",		0,0,0,0,0 },
+	{ "SHELL_COPROC",	0,0,0,0,0 },
+	{ "LATENCY_STATS",	0,0,0,0,0 }
 };	/* must exactly match CFG_XXX #defines */
 
 /* 'move' values MOV_X2Y understood by set_value() */
@@ -762,6 +778,9 @@ config_apply(void)
 		win_layout_reconfig();
 		reread = 1;
 	}
+	else if (config[CFG_SHOW_LINKTRGT].changed)
+		/* discard the file panel lines rendered with the old setting */
+		win_layout_reconfig();
 	if (config[CFG_FMT_NUMBER].changed
 	  || config[CFG_FMT_TIME].changed
 	  || config[CFG_FMT_DATE].changed
@@ -769,6 +788,10 @@ config_apply(void)
 		reread = 1;
 	if (config[CFG_SHOW_HIDDEN].changed)
 		reread = 1;
+	if (config[CFG_SHELL_COPROC].changed)
+		exec_shell_reconfig();
+	if (config[CFG_LATENCY_STATS].changed)
+		lat_reconfig();
 	if (config[CFG_SHELLPROG].changed) {
 		exec_shell_reconfig();
 		prompt = 1;
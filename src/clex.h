@@ -59,16 +59,22 @@ typedef short int CODE;				/* usually some #define-d value */
 #define MODE_COMPARE			 8
 #define MODE_DESELECT			 9
 #define MODE_DIR				10
-#define MODE_DIR_SPLIT			11
-#define MODE_FILE				12
-#define MODE_GROUP				13
-#define MODE_HELP				14
-#define MODE_HIST				15
-#define MODE_MAINMENU			16
-#define MODE_PASTE				17
-#define MODE_SELECT				18
-#define MODE_SORT				19
-#define MODE_USER				20
+#define MODE_DIR_JUMP			11
+#define MODE_DIR_SPLIT			12
+#define MODE_FILE				13
+#define MODE_GROUP				14
+#define MODE_HELP				15
+#define MODE_HIST				16
+#define MODE_HIST_SEARCH		17
+#define MODE_JOBS				18
+#define MODE_JOBS_OUT			19
+#define MODE_LATENCY			20
+#define MODE_MAINMENU			21
+#define MODE_PASTE				22
+#define MODE_SELECT				23
+#define MODE_SORT				24
+#define MODE_TREECMP			25
+#define MODE_USER				26
 /* pseudo-modes */
 #define MODE_SPECIAL_QUIT		98
 #define MODE_SPECIAL_RETURN		99
@@ -170,15 +176,20 @@ typedef struct {
 #define PANEL_TYPE_COMPARE		 2
 #define PANEL_TYPE_COMPL		 3
 #define PANEL_TYPE_DIR			 4
-#define PANEL_TYPE_DIR_SPLIT	 5
-#define PANEL_TYPE_FILE			 6
-#define PANEL_TYPE_GROUP		 7
-#define PANEL_TYPE_HELP			 8
-#define PANEL_TYPE_HIST			 9
-#define PANEL_TYPE_MAINMENU		10
-#define PANEL_TYPE_PASTE		11
-#define PANEL_TYPE_SORT			12
-#define PANEL_TYPE_USER			13
+#define PANEL_TYPE_DIR_JUMP		 5
+#define PANEL_TYPE_DIR_SPLIT	 6
+#define PANEL_TYPE_FILE			 7
+#define PANEL_TYPE_GROUP		 8
+#define PANEL_TYPE_HELP			 9
+#define PANEL_TYPE_HIST			10
+#define PANEL_TYPE_JOBS			11
+#define PANEL_TYPE_JOBS_OUT		12
+#define PANEL_TYPE_LATENCY		13
+#define PANEL_TYPE_MAINMENU		14
+#define PANEL_TYPE_PASTE		15
+#define PANEL_TYPE_SORT			16
+#define PANEL_TYPE_TREECMP		17
+#define PANEL_TYPE_USER			18
 #define PANEL_TYPE_NONE			99	/* not set (only during startup) */
 
 /*
@@ -278,6 +289,7 @@ typedef struct {
 	 */
 	unsigned int normal_mode:1;	/* file mode same as "normal" file */
 	unsigned int links:1;		/* has multiple hard links */
+	unsigned int gen;			/* new value after each update */
 	char atime_str[FE_TIME_STR];	/* access time */
 	char ctime_str[FE_TIME_STR];	/* inode change time */
 	char mtime_str[FE_TIME_STR];	/* file modification time */
@@ -287,6 +299,8 @@ typedef struct {
 	char size_str[FE_SIZE_DEV_STR];	/* file size or dev major/minor */
 } FILE_ENTRY;
 
+#define WATCH_NAMES		16	/* max number of changed files to remember */
+
 typedef struct ppanel_file {
 	PANEL_DESC *pd;
 	USTRING dir;			/* working directory */
@@ -299,6 +313,19 @@ typedef struct ppanel_file {
 	int fe_alloc;			/* allocated FILE_ENTRies in 'files' below */
 	FILE_ENTRY **files;		/* main part: list of files in panel's
 							   working directory 'dir' */
+	/* status of the directory at the time of the last read */
+	dev_t dir_dev;
+	ino_t dir_ino;
+	time_t dir_mtime, dir_ctime;
+	nlink_t dir_nlink;
+	off_t dir_size;
+	time_t timestamp;		/* time of the last read, 0 = failed */
+	FLAG outdated;			/* a command was executed since the last read */
+	int watch;				/* inotify watch descriptor, -1 = none */
+	int dirty;				/* changes reported by inotify: 0 = none,
+							   N = names of N changed files in 'changed',
+							   -1 = other or too many changes */
+	char *changed[WATCH_NAMES];
 } PANEL_FILE;
 /*
  * filter off: 0 .. cnt-1     = all file entries
@@ -357,7 +384,7 @@ typedef struct {
  * if you change this, you must also update
  * the config[] array in cfg.c
  */
-#define CFG_VARIABLES		38
+#define CFG_VARIABLES		41
 
 /* appearance */
 #define CFG_FRAME			 0
@@ -401,6 +428,9 @@ typedef struct {
 #define CFG_NOPROMPT_CMDS		35
 #define CFG_SHOW_HIDDEN			36
 #define CFG_SHOW_LINKTRGT		37
+#define CFG_BATCH_JOBS			38
+#define CFG_SHELL_COPROC		39
+#define CFG_LATENCY_STATS		40
 
 /* max string lengths */
 #define CFGVAR_LEN		16	/* name */
@@ -422,18 +452,69 @@ typedef struct {
 
 /********************************************************************/
 
+/* statistics of an executed command */
+typedef struct {
+	FLAG valid;				/* the data below is valid */
+	int status;				/* exit code or -N if killed by signal N */
+	long wall;				/* elapsed real time (in ms) */
+	long user, sys;			/* CPU time (in ms), -1 = unknown */
+	long maxrss;			/* max resident set size (in kB), -1 = unknown */
+} CMD_STATS;
+
 typedef struct {
 	USTRING cmd;			/* command text */
 	FLAG failed;			/* command failed or not */
+	CMD_STATS stats;		/* statistics of the last execution */
 } HIST_ENTRY;
 
 typedef struct {
 	PANEL_DESC *pd;
 	HIST_ENTRY **hist;		/* list of previously executed commands */
+	FLAG bytime;			/* sorted by duration (the longest first) */
 } PANEL_HIST;
 
 /********************************************************************/
 
+/* background job, see jobs.c */
+typedef struct {
+	int num;				/* job number */
+	char *cmd;				/* command text */
+	pid_t pid;				/* process ID, 0 = terminated */
+	int fd;					/* output pipe, -1 = closed */
+	char *out;				/* ring buffer with the latest output */
+	long long outlen;		/* total number of output bytes */
+	long long start;		/* start time (in ms since the epoch) */
+	CMD_STATS stats;		/* valid when the job has terminated */
+} JOB_ENTRY;
+
+typedef struct {
+	PANEL_DESC *pd;
+	JOB_ENTRY **job;		/* list of jobs, the newest first */
+} PANEL_JOBS;
+
+typedef struct {
+	PANEL_DESC *pd;
+	JOB_ENTRY *job;			/* job whose output is displayed */
+	long long *line;		/* output offsets where the lines begin */
+	int alloc;				/* allocated entries in 'line' */
+} PANEL_JOBS_OUT;
+
+/********************************************************************/
+
+/* measured operations, see latency.c */
+#define LAT_SCREEN		0	/* from the keypress to the screen update */
+#define LAT_ACTION		1	/* do_action() */
+#define LAT_FILTER		2	/* filter_update() */
+#define LAT_PANEL		3	/* draw_panel() */
+#define LAT_REFRESH		4	/* refresh() */
+#define LAT_OPS			5
+
+typedef struct {
+	PANEL_DESC *pd;			/* no additional data */
+} PANEL_LAT;
+
+/********************************************************************/
+
 typedef struct {
 	const char *txt;		/* help text to be displayed */
 	const char *aux;		/* additional data: link or page heading */
@@ -495,6 +576,47 @@ typedef struct {
 
 /********************************************************************/
 
+/* directory tree compare: kinds of differences */
+#define TC_ONLY1	0	/* found in the primary tree only */
+#define TC_ONLY2	1	/* found in the secondary tree only */
+#define TC_TYPE		2	/* different file types */
+#define TC_SIZE		3	/* different sizes */
+#define TC_LINK		4	/* symbolic links to different targets */
+#define TC_DATA		5	/* different contents */
+#define TC_ERROR	6	/* could not be compared */
+/* duplicate files search */
+#define TC_DUP1		7	/* duplicate file in the primary tree */
+#define TC_DUP2		8	/* duplicate file in the secondary tree */
+
+typedef struct {
+	char *path;			/* pathname relative to the tree root */
+	CODE diff;			/* one of TC_XXX */
+	FLAG dir;			/* it is a directory */
+	int group;			/* TC_DUPx: group of identical files */
+} TREECMP_ENTRY;
+
+typedef struct {
+	PANEL_DESC *pd;
+	TREECMP_ENTRY *diff;	/* list of differences or duplicates */
+	int alloc;				/* allocated entries in 'diff' */
+	char *root1, *root2;	/* roots of the compared trees */
+	FLAG dups;				/* list of duplicates */
+} PANEL_TREECMP;
+
+/********************************************************************/
+
+/* content digest of a file, see digest.c */
+typedef unsigned long long DIGEST;
+
+typedef struct {
+	DIGEST acc[4];			/* accumulators */
+	DIGEST total;			/* number of bytes processed */
+	unsigned char mem[32];	/* incomplete stripe */
+	int memsize;			/* number of bytes in 'mem' */
+} DIGEST_CTX;
+
+/********************************************************************/
+
 /* global variables */
 
 extern const void *pcfg[CFG_VARIABLES];
@@ -508,12 +630,16 @@ extern PANEL_FILE *ppanel_file;
 extern PANEL_CFG panel_cfg;
 extern PANEL_BM panel_bm_lst, panel_bm_mng;
 extern PANEL_COMPL panel_compl;
-extern PANEL_DIR panel_dir;	
+extern PANEL_DIR panel_dir, panel_dir_jump;
 extern PANEL_DIR_SPLIT panel_dir_split;	
 extern PANEL_GROUP panel_group;
 extern PANEL_HELP panel_help;
 extern PANEL_HIST panel_hist;
+extern PANEL_JOBS panel_jobs;
+extern PANEL_JOBS_OUT panel_jobs_out;
+extern PANEL_LAT panel_lat;
 extern PANEL_MENU panel_mainmenu, panel_compare, panel_paste;
 extern PANEL_SORT panel_sort;
+extern PANEL_TREECMP panel_treecmp;
 extern PANEL_USER panel_user;
 extern CODE next_mode;			/* see control.c comments */
@@ -45,7 +45,7 @@
 #include "cfg.h"		/* config_num() */
 #include "control.h"	/* control_loop() */
 #include "edit.h"		/* edit_update() */
-#include "history.h"	/* get_hist_entry() */
+#include "history.h"	/* hist_search_init() */
 #include "inout.h"		/* win_waitmsg() */
 #include "list.h"		/* stat2type() */
 #include "sdstring.h"	/* SDSTR() */
@@ -313,13 +313,12 @@ complete_environ(void)
 static void
 complete_history()
 {
-	int i;
 	const HIST_ENTRY *ph;
 
-	for (i = 0; (ph = get_history_entry(i)); i++)
-		if (strncmp(USTR(ph->cmd),rq.str,rq.strlen) == 0)
-			register_candidate(USTR(ph->cmd),0,0,
-			  ph->failed ? "this command failed last time" : 0);
+	hist_search_init(rq.str,rq.strlen,1);
+	while ( (ph = hist_search_next()) )
+		register_candidate(USTR(ph->cmd),0,0,
+		  ph->failed ? "this command failed last time" : 0);
 }
 
 static void
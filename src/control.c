@@ -27,19 +27,24 @@
 #include "clex.h"
 #include "control.h"
 
+#include "batch.h"			/* cx_batch() */
 #include "bookmarks.h"		/* bm_list_prepare() */
 #include "cfg.h"			/* config_prepare() */
 #include "completion.h"		/* compl_prepare() */
 #include "directory.h"		/* dir_main_prepare() */
 #include "edit.h"			/* cx_edit_xxx() */
+#include "fileops.h"		/* cx_fileop_copy() */
 #include "filepanel.h"		/* cx_files_xxx() */
 #include "filter.h"			/* cx_filteredit_xxx() */
 #include "help.h"			/* help_prepare() */
 #include "history.h"		/* history_prepare() */
 #include "inout.h"			/* win_panel() */
+#include "jobs.h"			/* jobs_prepare() */
+#include "latency.h"		/* lat_begin() */
 #include "panel.h"			/* cx_pan_xxx() */
 #include "select.h"			/* select_prepare() */
 #include "sort.h"			/* sort_prepare() */
+#include "treecmp.h"		/* treecmp_prepare() */
 #include "tty.h"			/* tty_reset() */
 #include "undo.h"			/* undo_reset() */
 #include "userdata.h"		/* user_prepare() */
@@ -93,9 +98,13 @@ static CXM(cfg,CFG)
 static CXM(compare,COMPARE)
 static CXM(deselect,DESELECT)
 static CXM(dir,DIR)
+static CXM(dir_jump,DIR_JUMP)
 static CXM(group,GROUP)
 static CXM(history,HIST)
+static CXM(hist_search,HIST_SEARCH)
 static CXM(help,HELP)
+static CXM(jobs,JOBS)
+static CXM(latency,LATENCY)
 static CXM(mainmenu,MAINMENU)
 static CXM(paste,PASTE)
 static CXM(select,SELECT)
@@ -192,6 +201,10 @@ static KEY_BINDING tab_compare[] = {
 	{ 0,  '3',			cx_compare,	0	},
 	{ 0,  '4',			cx_compare,	0	},
 	{ 0,  '5',			cx_compare,	0	},
+	{ 0,  '6',			cx_compare,	0	},
+	{ 0,  '7',			cx_compare,	0	},
+	{ 0,  '8',			cx_compare,	0	},
+	{ 0,  '9',			cx_compare,	0	},
 /* compare menu ends here */
 	{ 0,  CH_CTRL('M'),	cx_compare,	0	},
 	{ 0,  0,			0,			0	}
@@ -210,6 +223,11 @@ static KEY_BINDING tab_dir[] = {
 	{ 0,  0,			0,					0	}
 };
 
+static KEY_BINDING tab_dir_jump[] = {
+	{ 0,  CH_CTRL('M'),	cx_dir_jump_enter,	OPT_CURS	},
+	{ 0,  0,			0,					0	}
+};
+
 static KEY_BINDING tab_edit[] = {
 	{ 1,  'b',			cx_edit_w_left,		0	},
 #ifdef KEY_SLEFT
@@ -304,9 +322,25 @@ static KEY_BINDING tab_hist[] = {
 	{ 0,  CH_CTRL('M'),	cx_hist_enter,	OPT_CURS	},
 	{ 0,  CH_CTRL('N'),	cx_pan_up,		0			},	/* redefine history next */
 	{ 0,  CH_CTRL('P'),	cx_pan_down,	0			},	/* redefine history prev */
+	{ 0,  CH_CTRL('R'),	cx_pan_down,	0			},	/* next older match */
+	{ 1,  's',			cx_hist_sort,	0			},
 	{ 0,  0,			0				}
 };
 
+static KEY_BINDING tab_jobs[] = {
+	{ 1,  '\177',		cx_jobs_kill,	OPT_CURS	},
+	{ 1,  CH_CTRL('H'),	cx_jobs_kill,	OPT_CURS	},
+	{ 0,  CH_CTRL('M'),	cx_jobs_output,	OPT_CURS	},
+	{ 0,  0,			0,				0			}
+};
+
+static KEY_BINDING tab_lat[] = {
+	{ 1,  '\177',		cx_lat_reset,	0	},
+	{ 1,  CH_CTRL('H'),	cx_lat_reset,	0	},
+	{ 0,  CH_CTRL('W'),	cx_lat_save,	0	},
+	{ 0,  0,			0,				0	}
+};
+
 /* pseudo-table returned by do_action() */
 static KEY_BINDING tab_insertchar[] = {
 	{ 0, 0,	0, 0	}
@@ -332,7 +366,14 @@ static KEY_BINDING tab_mainmenu[] = {
 	{ 1,  '.',			cx_files_cd_parent,	0	},
 	{ 1,  '~',			cx_files_cd_home,	0	},
 	{ 1,  'k',			cx_mode_bm_list,	0	},
+	{ 1,  'j',			cx_mode_dir_jump,	0	},
 	{ 1,  'h',			cx_mode_history,	0	},
+	{ 1,  'r',			cx_mode_hist_search,	0	},
+	{ 1,  'o',			cx_mode_jobs,		0	},
+	{ 1,  'x',			cx_batch,			0	},
+	{ 1,  'y',			cx_fileop_copy,		0	},
+	{ 1,  't',			cx_fileop_move,		0	},
+	{ 1,  'e',			cx_fileop_delete,	0	},
 	{ 1,  's',			cx_mode_sort,		0	},
 	{ 0,  CH_CTRL('R'),	cx_files_reread,	0	},
 	{ 1,  '=',			cx_mode_compare,	0	},
@@ -343,6 +384,7 @@ static KEY_BINDING tab_mainmenu[] = {
 	{ 1,  '+',			cx_mode_select,		0	},
 	{ 1,  '-',			cx_mode_deselect,	0	},
 	{ 1,  '*',			cx_select_invert,	0	},
+	{ 1,  'i',			cx_mode_latency,	0	},
 	{ 1,  'c',			cx_mode_cfg,		0	},
 	{ 1,  'v',			cx_version,			0	},
 	{ 0,  0,			cx_trans_quit,		0	},	/* key in tab_common */
@@ -362,6 +404,13 @@ static KEY_BINDING tab_mainmenu2[] = {
 	{ 0,  0,			noop,				0	},
 	{ 0,  0,			noop,				0	},
 	{ 0,  0,			noop,				0	},
+	{ 0,  0,			noop,				0	},
+	{ 0,  0,			noop,				0	},
+	{ 0,  0,			noop,				0	},
+	{ 0,  0,			noop,				0	},
+	{ 0,  0,			noop,				0	},
+	{ 0,  0,			noop,				0	},
+	{ 0,  0,			noop,				0	},
 	{ 0,  CH_CTRL('F'),	cx_filter_toggle,	0	},
 	{ 1,  'g',			cx_mode_group,		0	},
 	{ 0,  '+',			cx_select_allfiles,	0	},
@@ -372,6 +421,7 @@ static KEY_BINDING tab_mainmenu2[] = {
 	{ 0,  0,			noop,				0	},
 	{ 0,  0,			noop,				0	},
 	{ 0,  0,			noop,				0	},
+	{ 0,  0,			noop,				0	},
 /* the main menu ends here, the following entry is hidden */
 	{ 0,  CH_CTRL('M'),	cx_menu_pick,		0	},
 	{ 0,  0,			0,					0	}
@@ -425,6 +475,11 @@ static KEY_BINDING tab_sort[] = {
 	{ 0,  0,			0,				0		}
 };
 
+static KEY_BINDING tab_treecmp[] = {
+	{ 0,  CH_CTRL('M'),	cx_treecmp_enter,	OPT_CURS	},
+	{ 0,  0,			0,					0			}
+};
+
 typedef struct {
 	CODE mode;
 	void (*prepare_fn)(void);
@@ -446,15 +501,21 @@ static MODE_DEFINITION mode_definition[] = {
 	{ MODE_COMPL, compl_prepare, { tab_compl,tab_panel,0 } },
 	{ MODE_DESELECT, select_prepare, { tab_select,tab_panel,0 } },
 	{ MODE_DIR, dir_main_prepare, { tab_dir,tab_panel,0 } },
+	{ MODE_DIR_JUMP, dir_jump_prepare, { tab_dir_jump,tab_panel,0 } },
 	{ MODE_DIR_SPLIT, dir_split_prepare, { tab_dir,tab_panel,0 } },
 	{ MODE_FILE, files_main_prepare, { tab_editcmd,tab_mainmenu,tab_panel,0 } },
 	{ MODE_GROUP, group_prepare, { tab_panel,0 } },
 	{ MODE_HELP, help_prepare, { tab_help,tab_panel,0 } },
 	{ MODE_HIST, hist_prepare, { tab_hist,tab_panel,0 } },
+	{ MODE_HIST_SEARCH, hist_search_prepare, { tab_hist,tab_panel,0 } },
+	{ MODE_JOBS, jobs_prepare, { tab_jobs,tab_panel,0 } },
+	{ MODE_JOBS_OUT, jobs_out_prepare, { tab_panel,0 } },
+	{ MODE_LATENCY, lat_prepare, { tab_lat,tab_panel,0 } },
 	{ MODE_MAINMENU, menu_prepare, { tab_mainmenu,tab_mainmenu2,tab_panel,0 } },
 	{ MODE_SELECT, select_prepare, { tab_select,tab_panel,0 } },
 	{ MODE_PASTE, paste_prepare, { tab_pastemenu,tab_panel,0 } },
 	{ MODE_SORT, sort_prepare, { tab_sort,tab_panel,0 } },
+	{ MODE_TREECMP, treecmp_prepare, { tab_treecmp,tab_panel,0 } },
 	{ MODE_USER, user_prepare, { tab_panel,0 } },
 	{ 0, 0, { 0 } }
 };
@@ -539,11 +600,17 @@ do_action(int key, KEY_BINDING **tables)
 		return 0;
 
 	if (panel->filtering == 1 && (key == CH_CTRL('M') || key == CH_CTRL('C'))) {
-		if (panel->type != PANEL_TYPE_DIR || panel->filter->size == 0)
-			filter_off();
-		else
+		if (panel->type == PANEL_TYPE_HIST && key == CH_CTRL('M')
+		  && panel->filter->size > 0)
+			/* end of the search, <enter> selects the command */
 			panel->filtering = 2;
-		return 0;
+		else {
+			if (panel->type != PANEL_TYPE_DIR || panel->filter->size == 0)
+				filter_off();
+			else
+				panel->filtering = 2;
+			return 0;
+		}
 	}
 
 	/* extra lines */
@@ -607,10 +674,12 @@ do_action(int key, KEY_BINDING **tables)
 void
 control_loop(int mode)
 {
+	int key;
 	MODE_DEFINITION *modedef;
 	KEY_BINDING *kb_tab;
 	struct operation_mode current_mode;
 	FLAG filter, nr;
+	long long start;
 
 	current_mode.previous = clex_mode;
 	clex_mode = &current_mode;
@@ -646,7 +715,10 @@ control_loop(int mode)
 
 		for (; /* until break */;) {
 			undo_before();
-			kb_tab = do_action(kbd_input(),modedef->table);
+			key = kbd_input();
+			start = lat_begin();
+			kb_tab = do_action(key,modedef->table);
+			lat_end(LAT_ACTION,start);
 			undo_after();
 			if (next_mode) {
 				if (next_mode == MODE_SPECIAL_RETURN
@@ -654,6 +726,10 @@ control_loop(int mode)
 					win_remark("to quit CLEX press <esc> Q");
 					next_mode = 0;
 				}
+				else if (next_mode == MODE_SPECIAL_QUIT && jobs_running()
+				  && !win_question("Background jobs are running, "
+				  "quit anyway ?"))
+					next_mode = 0;
 				else
 					break;
 			}
@@ -673,6 +749,12 @@ control_loop(int mode)
 					win_panel_opt();
 				}
 				break;
+			case MODE_DIR_JUMP:
+				if (kb_tab == tab_edit || kb_tab == tab_insertchar) {
+					dir_jump_panel();
+					win_panel();
+				}
+				break;
 			case MODE_MAINMENU:
 				if (kb_tab == tab_mainmenu || kb_tab == tab_mainmenu2)
 					next_mode = MODE_SPECIAL_RETURN;
@@ -684,8 +766,11 @@ control_loop(int mode)
 				break;
 		}
 
-		if (next_mode == MODE_SPECIAL_QUIT)
+		if (next_mode == MODE_SPECIAL_QUIT) {
+			/* not an err_exit() cleanup, it may call err_exit() */
+			dir_save();
 			err_exit("Normal exit");
+		}
 
 		if (next_mode == MODE_SPECIAL_RETURN) {
 			next_mode = 0;
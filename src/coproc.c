@@ -0,0 +1,400 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2006 Vlado Potisk <vlado_potisk@clex.sk>
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from http://www.clex.sk
+ *
+ */
+
+/*
+ * Shell coprocess: one shell process is kept running on its own
+ * pseudo-terminal and executes the commands one after another.
+ * Commands are written to the shell's standard input (a pipe),
+ * each of them is followed by a command printing a marker with
+ * the exit code. CLEX copies the keyboard input to the
+ * pseudo-terminal and its output to the screen until the marker
+ * appears.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>		/* pid_t */
+#include <errno.h>			/* errno */
+#include <fcntl.h>			/* open() */
+#include <signal.h>			/* sigaction() */
+#include <stdio.h>			/* fwrite() */
+#include <stdlib.h>			/* posix_openpt() */
+#include <string.h>			/* strlen() */
+#include <time.h>			/* time() */
+#include <unistd.h>			/* fork() */
+
+#if defined(HAVE_POSIX_OPENPT) && defined(HAVE_SYS_IOCTL_H)
+# include <sys/ioctl.h>		/* TIOCSWINSZ */
+# include <poll.h>			/* poll() */
+# include <termios.h>		/* tcsetattr() */
+# define USE_COPROC
+#endif
+
+/* waitpid() */
+#ifdef HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
+#ifndef WEXITSTATUS
+# define WEXITSTATUS(status) ((unsigned)(status) >> 8)
+#endif
+#ifndef WIFEXITED
+# define WIFEXITED(status) (((status) & 255) == 0)
+#endif
+
+#include "clex.h"
+#include "coproc.h"
+
+#include "tty.h"			/* tty_setpassthru() */
+#include "ustring.h"		/* us_setsize() */
+
+#ifdef USE_COPROC
+
+static pid_t copid = 0;		/* shell process, 0 = not running */
+static int cmdfd = -1;		/* shell's standard input */
+static int ptyfd = -1;		/* master side of the pseudo-terminal */
+
+/* the marker is: MARK_BEGIN token ':' exit_code MARK_END */
+#define MARK_BEGIN	"\001\002CLEX"
+#define MARK_END	';'
+static char mark[32];		/* marker up to the exit code */
+static int marklen;
+
+static void
+write_all(int fd, const char *buff, size_t len)
+{
+	ssize_t wr;
+
+	while (len > 0)
+		if ( (wr = write(fd,buff,len)) > 0) {
+			buff += wr;
+			len -= wr;
+		}
+		else if (wr < 0 && errno != EINTR && errno != EAGAIN)
+			return;
+}
+
+/* write to the shell without getting killed by SIGPIPE */
+static void
+coproc_write(const char *buff, size_t len)
+{
+	struct sigaction act, oldact;
+
+	act.sa_handler = SIG_IGN;
+	act.sa_flags = 0;
+	sigemptyset(&act.sa_mask);
+	sigaction(SIGPIPE,&act,&oldact);
+	write_all(cmdfd,buff,len);
+	sigaction(SIGPIPE,&oldact,0);
+}
+
+static void
+coproc_close(void)
+{
+	close(cmdfd);
+	close(ptyfd);
+	cmdfd = ptyfd = -1;
+	copid = 0;
+}
+
+static int
+coproc_start(char *const *argv)
+{
+	int i, slave, pfd[2];
+	const char *name;
+	struct sigaction act;
+	static const int sigs[] = { SIGINT, SIGQUIT,
+#ifdef _POSIX_JOB_CONTROL
+	  SIGTSTP, SIGTTIN, SIGTTOU,
+#endif
+	  0 };
+
+	if ( (ptyfd = posix_openpt(O_RDWR | O_NOCTTY)) < 0)
+		return -1;
+	if (grantpt(ptyfd) < 0 || unlockpt(ptyfd) < 0
+	  || (name = ptsname(ptyfd)) == 0
+	  || (slave = open(name,O_RDWR | O_NOCTTY)) < 0) {
+		close(ptyfd);
+		ptyfd = -1;
+		return -1;
+	}
+	if (pipe(pfd) < 0) {
+		close(slave);
+		close(ptyfd);
+		ptyfd = -1;
+		return -1;
+	}
+	cmdfd = pfd[1];
+	fcntl(cmdfd,F_SETFD,FD_CLOEXEC);
+	fcntl(ptyfd,F_SETFD,FD_CLOEXEC);
+	fcntl(ptyfd,F_SETFL,fcntl(ptyfd,F_GETFL) | O_NONBLOCK);
+
+	if ( (copid = fork()) < 0) {
+		close(slave);
+		close(pfd[0]);
+		coproc_close();
+		return -1;
+	}
+	if (copid == 0) {
+		/* child process = shell */
+		setsid();
+#ifdef TIOCSCTTY
+		ioctl(slave,TIOCSCTTY,0);
+#else
+		close(open(name,O_RDWR));	/* SysV: the first open wins */
+#endif
+		dup2(pfd[0],STDIN_FILENO);
+		dup2(slave,STDOUT_FILENO);
+		dup2(slave,STDERR_FILENO);
+		close(pfd[0]);
+		close(slave);
+
+		/* CLEX ignores these, the shell must not inherit that */
+		act.sa_handler = SIG_DFL;
+		act.sa_flags = 0;
+		sigemptyset(&act.sa_mask);
+		for (i = 0; sigs[i]; i++)
+			sigaction(sigs[i],&act,0);
+		execv(argv[0],argv);
+		_exit(99);
+	}
+
+	/* parent process = CLEX */
+	close(pfd[0]);
+	close(slave);
+
+	sprintf(mark,MARK_BEGIN "%lx%lx:",
+	  (long)copid,(long)time(0) & 0xFFFFF);
+	marklen = strlen(mark);
+
+	/*
+	 * the shell survives ctrl-C, the subshell with the command
+	 * (trap reset to default) does not
+	 */
+	coproc_write("trap : INT QUIT\n",16);
+	return 0;
+}
+
+void
+coproc_stop(void)
+{
+	if (copid == 0)
+		return;
+	kill(copid,SIGHUP);
+	while (waitpid(copid,0,0) < 0 && errno == EINTR)
+		;
+	coproc_close();
+}
+
+/*
+ * terminal settings of the pseudo-terminal follow the real
+ * terminal, suspend (ctrl-Z) is disabled, there is no job control
+ */
+static void
+coproc_tty(void)
+{
+	struct termios tio;
+	struct winsize ws;
+
+	if (tcgetattr(STDIN_FILENO,&tio) == 0) {
+#if defined(VSUSP) && defined(_POSIX_VDISABLE)
+		tio.c_cc[VSUSP] = _POSIX_VDISABLE;
+#endif
+		tcsetattr(ptyfd,TCSANOW,&tio);
+	}
+	if (ioctl(STDOUT_FILENO,TIOCGWINSZ,&ws) == 0)
+		ioctl(ptyfd,TIOCSWINSZ,&ws);
+}
+
+/* append 'str' in single quotes */
+static char *
+quote(char *dst, const char *str)
+{
+	*dst++ = '\'';
+	for (; *str; str++)
+		if (*str == '\'') {
+			strcpy(dst,"'\\''");
+			dst += 4;
+		}
+		else
+			*dst++ = *str;
+	*dst++ = '\'';
+	return dst;
+}
+
+static size_t
+quoted_len(const char *str)
+{
+	size_t len;
+
+	for (len = 2; *str; str++)
+		len += *str == '\'' ? 4 : 1;
+	return len;
+}
+
+/* send the command and the marker to the shell */
+static void
+coproc_send(const char *dir, const char *command)
+{
+	char *pch;
+	static USTRING line = { 0,0 };
+
+	us_setsize(&line,quoted_len(dir) + quoted_len(command)
+	  + marklen + 64);
+	pch = USTR(line);
+	strcpy(pch,"(cd -- ");
+	pch = quote(pch + 7,dir);
+	strcpy(pch," && eval ");
+	pch = quote(pch + 9,command);
+	sprintf(pch,") 0<&1; printf '%s%%d%c' \"$?\"\n",mark,MARK_END);
+	/* the \001 and \002 characters are passed literally */
+	coproc_write(USTR(line),strlen(USTR(line)));
+}
+
+/*
+ * copy the output to the screen, but not the marker,
+ * return value: exit code >= 0 when the marker is complete
+ */
+static int
+coproc_output(const char *buff, int len)
+{
+	int i, start;
+	static int match = 0, code = 0;
+
+	if (buff == 0) {
+		/* new command */
+		match = code = 0;
+		return -1;
+	}
+
+	for (start = i = 0; i < len; i++) {
+		if (match == marklen) {
+			/* reading the exit code */
+			if (buff[i] >= '0' && buff[i] <= '9') {
+				code = 10 * code + buff[i] - '0';
+				continue;
+			}
+			/* MARK_END */
+			i++;
+			fwrite(buff + i,1,len - i,stdout);
+			fflush(stdout);
+			return code;
+		}
+		if (buff[i] == mark[match]) {
+			if (match++ == 0)
+				fwrite(buff + start,1,i - start,stdout);
+			start = i + 1;
+		}
+		else if (match > 0) {
+			/* false alarm, output what was held back */
+			fwrite(mark,1,match,stdout);
+			match = 0;
+			start = i--;	/* check this character again */
+		}
+	}
+	if (match == 0)
+		fwrite(buff + start,1,len - start,stdout);
+	fflush(stdout);
+	return -1;
+}
+
+/*
+ * execute the 'command' in the directory 'dir' by the shell coprocess,
+ * the shell is started with the 'argv' arguments if necessary
+ *
+ * return value: -1 = coprocess not available, use the normal way,
+ *    otherwise 0 and the '*pstatus' is set to exit code or -signal
+ */
+int
+coproc_execute(char *const *argv, const char *dir, const char *command,
+  int *pstatus)
+{
+	int code, status, nfds;
+	ssize_t rd;
+	char buff[4096];
+	struct pollfd pfd[3];
+
+	/* the shell might have exited since the last command */
+	if (copid && waitpid(copid,&status,WNOHANG) != 0)
+		coproc_close();
+	if (copid == 0 && coproc_start(argv) < 0)
+		return -1;
+
+	coproc_tty();
+	coproc_output(0,0);
+	coproc_send(dir,command);
+
+	tty_setpassthru();
+	for (code = -1, nfds = 3; code < 0; ) {
+		pfd[0].fd = ptyfd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = cmdfd;
+		pfd[1].events = 0;		/* POLLERR = the shell has exited */
+		pfd[2].fd = STDIN_FILENO;
+		pfd[2].events = POLLIN;
+		if (poll(pfd,nfds,-1) < 0) {
+			if (errno == EINTR) {
+				/* probably SIGWINCH */
+				coproc_tty();
+				continue;
+			}
+			break;
+		}
+
+		if (nfds == 3 && pfd[2].revents) {
+			if ( (rd = read(STDIN_FILENO,buff,sizeof(buff))) > 0)
+				write_all(ptyfd,buff,rd);
+			else if (rd == 0)
+				nfds = 2;
+		}
+		if (pfd[0].revents) {
+			rd = read(ptyfd,buff,sizeof(buff));
+			if (rd > 0)
+				code = coproc_output(buff,rd);
+			else if (rd == 0 || (errno != EINTR && errno != EAGAIN))
+				break;	/* EIO: the shell has exited */
+		}
+		else if (pfd[1].revents)
+			break;
+	}
+
+	if (code >= 0) {
+		/* the shell reports death by signal N as 128+N */
+		*pstatus = code > 128 && code < 128 + 64 ? 128 - code : code;
+		return 0;
+	}
+
+	/* the shell has exited, e.g. 'exec' was a part of the command */
+	while (waitpid(copid,&status,0) < 0 && errno == EINTR)
+		;
+	coproc_close();
+	*pstatus = WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+	return 0;
+}
+
+#else
+
+void
+coproc_stop(void)
+{
+	;
+}
+
+int
+coproc_execute(char *const *argv, const char *dir, const char *command,
+  int *pstatus)
+{
+	return -1;
+}
+
+#endif
@@ -0,0 +1,2 @@
+extern void coproc_stop(void);
+extern int coproc_execute(char *const *, const char *, const char *, int *);
@@ -0,0 +1,383 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2006 Vlado Potisk <vlado_potisk@clex.sk>
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from http://www.clex.sk
+ *
+ */
+
+/*
+ * Content digests of files are used to compare files by contents
+ * without reading their data again if they did not change since
+ * the last comparison.
+ *
+ * The digest is a 64-bit non-cryptographic hash computed with the
+ * XXH64 algorithm (by Yann Collet).
+ *
+ * The digests are cached in the file ~/.clexdigest, one record per
+ * line, all numbers are hexadecimal:
+ *     device inode size mtime ctime digest <newline>
+ * A cached digest is valid only if all five key values match the
+ * current status of the file.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>	/* clex.h */
+#include <sys/stat.h>	/* struct stat */
+#include <stdio.h>		/* fopen() */
+#include <stdlib.h>		/* free() */
+#include <string.h>		/* strlen() */
+#include <unistd.h>		/* unlink() */
+
+#include "clex.h"
+#include "digest.h"
+
+#include "inout.h"		/* win_warning() */
+#include "util.h"		/* emalloc() */
+
+#define PRIME1	0x9E3779B185EBCA87ULL
+#define PRIME2	0xC2B2AE3D27D4EB4FULL
+#define PRIME3	0x165667B19E3779F9ULL
+#define PRIME4	0x85EBCA77C2B2AE63ULL
+#define PRIME5	0x27D4EB2F165667C5ULL
+
+#define ROTL(X,N)	(((X) << (N)) | ((X) >> (64 - (N))))
+
+/* max number of cache records written to the file */
+#define DIGEST_LIMIT	100000
+
+typedef struct {
+	unsigned long long dev, ino, size;	/* key */
+	unsigned long mtime, ctime;			/* key */
+	DIGEST digest;
+	FLAG valid;				/* not replaced by a newer record */
+	int hnext;				/* next entry in the hash chain or -1 */
+} DIGEST_ENTRY;
+
+static const char *user_digest_file = 0;	/* cache filename */
+static DIGEST_ENTRY *dg_table = 0;	/* all records */
+static int dg_cnt = 0, dg_alloc = 0;	/* used and allocated records */
+static int *dg_hash = 0;			/* hash table: head of chain or -1 */
+static int dg_hashsize = 0;
+static FLAG dg_changed = 0;			/* the file needs to be written */
+
+/*** hash function ***/
+
+static DIGEST
+read64(const unsigned char *p)
+{
+	return (DIGEST)p[0] | (DIGEST)p[1] << 8 | (DIGEST)p[2] << 16
+	  | (DIGEST)p[3] << 24 | (DIGEST)p[4] << 32 | (DIGEST)p[5] << 40
+	  | (DIGEST)p[6] << 48 | (DIGEST)p[7] << 56;
+}
+
+static DIGEST
+read32(const unsigned char *p)
+{
+	return (DIGEST)p[0] | (DIGEST)p[1] << 8 | (DIGEST)p[2] << 16
+	  | (DIGEST)p[3] << 24;
+}
+
+static DIGEST
+round64(DIGEST acc, DIGEST input)
+{
+	acc += input * PRIME2;
+	acc = ROTL(acc,31);
+	return acc * PRIME1;
+}
+
+static DIGEST
+merge64(DIGEST acc, DIGEST val)
+{
+	acc ^= round64(0,val);
+	return acc * PRIME1 + PRIME4;
+}
+
+/* process complete 32 byte stripes, return the number of bytes used */
+static size_t
+stripes(DIGEST *acc, const unsigned char *p, size_t len)
+{
+	size_t done;
+
+	for (done = 0; len - done >= 32; done += 32, p += 32) {
+		acc[0] = round64(acc[0],read64(p));
+		acc[1] = round64(acc[1],read64(p + 8));
+		acc[2] = round64(acc[2],read64(p + 16));
+		acc[3] = round64(acc[3],read64(p + 24));
+	}
+	return done;
+}
+
+/* the digest functions are thread-safe */
+void
+digest_init(DIGEST_CTX *ctx)
+{
+	ctx->acc[0] = PRIME1 + PRIME2;
+	ctx->acc[1] = PRIME2;
+	ctx->acc[2] = 0;
+	ctx->acc[3] = 0 - PRIME1;
+	ctx->total = 0;
+	ctx->memsize = 0;
+}
+
+void
+digest_update(DIGEST_CTX *ctx, const void *data, size_t len)
+{
+	const unsigned char *p;
+	size_t fill, done;
+
+	p = data;
+	ctx->total += len;
+	if (ctx->memsize + len < 32) {
+		memcpy(ctx->mem + ctx->memsize,p,len);
+		ctx->memsize += len;
+		return;
+	}
+	if (ctx->memsize) {
+		fill = 32 - ctx->memsize;
+		memcpy(ctx->mem + ctx->memsize,p,fill);
+		stripes(ctx->acc,ctx->mem,32);
+		p += fill;
+		len -= fill;
+		ctx->memsize = 0;
+	}
+	done = stripes(ctx->acc,p,len);
+	memcpy(ctx->mem,p + done,len - done);
+	ctx->memsize = len - done;
+}
+
+DIGEST
+digest_final(const DIGEST_CTX *ctx)
+{
+	DIGEST h;
+	const unsigned char *p, *end;
+
+	if (ctx->total >= 32) {
+		h = ROTL(ctx->acc[0],1) + ROTL(ctx->acc[1],7)
+		  + ROTL(ctx->acc[2],12) + ROTL(ctx->acc[3],18);
+		h = merge64(h,ctx->acc[0]);
+		h = merge64(h,ctx->acc[1]);
+		h = merge64(h,ctx->acc[2]);
+		h = merge64(h,ctx->acc[3]);
+	}
+	else
+		h = PRIME5;
+	h += ctx->total;
+
+	for (p = ctx->mem, end = p + ctx->memsize; p + 8 <= end; p += 8) {
+		h ^= round64(0,read64(p));
+		h = ROTL(h,27) * PRIME1 + PRIME4;
+	}
+	if (p + 4 <= end) {
+		h ^= read32(p) * PRIME1;
+		h = ROTL(h,23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * PRIME5;
+		h = ROTL(h,11) * PRIME1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+/*** digest cache ***/
+
+static unsigned int
+dg_hashval(unsigned long long dev, unsigned long long ino)
+{
+	return (unsigned int)((ino ^ dev * PRIME5) % dg_hashsize);
+}
+
+static void
+dg_rehash(void)
+{
+	int i;
+	unsigned int h;
+
+	free(dg_hash);
+	dg_hash = emalloc(dg_hashsize * sizeof(int));
+	for (i = 0; i < dg_hashsize; i++)
+		dg_hash[i] = -1;
+	for (i = 0; i < dg_cnt; i++) {
+		h = dg_hashval(dg_table[i].dev,dg_table[i].ino);
+		dg_table[i].hnext = dg_hash[h];
+		dg_hash[h] = i;
+	}
+}
+
+/* find the record for a file (valid records only), -1 if not found */
+static int
+dg_find(unsigned long long dev, unsigned long long ino)
+{
+	int i;
+
+	if (dg_cnt == 0)
+		return -1;
+	for (i = dg_hash[dg_hashval(dev,ino)]; i >= 0; i = dg_table[i].hnext)
+		if (dg_table[i].ino == ino && dg_table[i].dev == dev
+		  && dg_table[i].valid)
+			return i;
+	return -1;
+}
+
+/* add a record, it replaces the previous record for the same file */
+static void
+dg_add(const DIGEST_ENTRY *pde)
+{
+	int i;
+	unsigned int h;
+
+	if ( (i = dg_find(pde->dev,pde->ino)) >= 0)
+		dg_table[i].valid = 0;
+
+	if (dg_cnt == dg_alloc) {
+		dg_alloc = dg_alloc ? 2 * dg_alloc : 1024;
+		dg_table = erealloc(dg_table,dg_alloc * sizeof(DIGEST_ENTRY));
+	}
+	dg_table[dg_cnt] = *pde;
+	dg_table[dg_cnt].valid = 1;
+	if (dg_cnt >= dg_hashsize) {
+		dg_cnt++;
+		dg_hashsize = 2 * dg_alloc + 1;
+		dg_rehash();
+	}
+	else {
+		h = dg_hashval(pde->dev,pde->ino);
+		dg_table[dg_cnt].hnext = dg_hash[h];
+		dg_hash[h] = dg_cnt++;
+	}
+}
+
+/* read the cache file; records already in memory take precedence */
+static void
+dg_read(void)
+{
+	FILE *fp;
+	char buff[160];
+	DIGEST_ENTRY de;
+
+	if ( (fp = fopen(user_digest_file,"r")) == 0)
+		return;
+	while (fgets(buff,sizeof(buff),fp))
+		if (sscanf(buff,"%llx %llx %llx %lx %lx %llx",&de.dev,&de.ino,
+		  &de.size,&de.mtime,&de.ctime,&de.digest) == 6
+		  && dg_find(de.dev,de.ino) < 0)
+			dg_add(&de);
+	fclose(fp);
+}
+
+/*
+ * digest_prepare() loads the cache; it must be called by the main
+ * thread before digest_lookup() can be used
+ */
+void
+digest_prepare(void)
+{
+	if (user_digest_file)
+		return;
+	pathname_set_directory(clex_data.homedir);
+	user_digest_file = estrdup(pathname_join(".clexdigest"));
+	dg_read();
+}
+
+/*
+ * digest_lookup() finds the cached digest of a file with status 'pst'
+ * it may be called by several threads at once provided that the cache
+ * is not modified meanwhile
+ *
+ * return value: 1 = found (stored in *pdg), 0 = not found
+ */
+int
+digest_lookup(const struct stat *pst, DIGEST *pdg)
+{
+	int i;
+
+	if ((i = dg_find(pst->st_dev,pst->st_ino)) < 0
+	  || dg_table[i].size != pst->st_size
+	  || dg_table[i].mtime != (unsigned long)pst->st_mtime
+	  || dg_table[i].ctime != (unsigned long)pst->st_ctime)
+		return 0;
+	*pdg = dg_table[i].digest;
+	return 1;
+}
+
+/*
+ * digest_store() caches the digest of a file with status 'pst'
+ * the digest computation started at time 'start'; if the file was
+ * modified in the same second, it could have been modified again
+ * without changing its status and the digest is not cached
+ */
+void
+digest_store(const struct stat *pst, DIGEST dg, time_t start)
+{
+	DIGEST_ENTRY de;
+
+	if (pst->st_mtime >= start || pst->st_ctime >= start)
+		return;
+	de.dev = pst->st_dev;
+	de.ino = pst->st_ino;
+	de.size = pst->st_size;
+	de.mtime = pst->st_mtime;
+	de.ctime = pst->st_ctime;
+	de.digest = dg;
+	dg_add(&de);
+	dg_changed = 1;
+}
+
+/* write the cache file, only the newest DIGEST_LIMIT records are kept */
+void
+digest_save(void)
+{
+	static FLAG warn = 1;
+	int i, cnt;
+	FLAG errflag;
+	FILE *fp;
+	char *tmpname;
+	DIGEST_ENTRY *pde;
+
+	if (!TCLR(dg_changed))
+		return;
+
+	/* another CLEX session might have updated the file meanwhile */
+	dg_read();
+
+	tmpname = emalloc(strlen(user_digest_file) + 16);
+	sprintf(tmpname,"%s.%d",user_digest_file,(int)clex_data.pid);
+	umask(clex_data.umask | 077);
+	fp = fopen(tmpname,"w");
+	umask(clex_data.umask);
+	if (fp == 0)
+		errflag = 1;
+	else {
+		for (cnt = 0, i = dg_cnt - 1; i >= 0 && cnt < DIGEST_LIMIT; i--)
+			if (dg_table[i].valid)
+				cnt++;
+		for (i++; i < dg_cnt; i++) {
+			pde = dg_table + i;
+			if (pde->valid)
+				fprintf(fp,"%llx %llx %llx %lx %lx %016llx\n",pde->dev,
+				  pde->ino,pde->size,pde->mtime,pde->ctime,pde->digest);
+		}
+		errflag = ferror(fp) != 0;
+		if (fclose(fp) || errflag || rename(tmpname,user_digest_file) < 0) {
+			errflag = 1;
+			unlink(tmpname);
+		}
+	}
+	free(tmpname);
+	if (errflag && TCLR(warn))
+		win_warning("COMPARE: Cannot write the digest cache file.");
+}
@@ -0,0 +1,7 @@
+extern void digest_init(DIGEST_CTX *);
+extern void digest_update(DIGEST_CTX *, const void *, size_t);
+extern DIGEST digest_final(const DIGEST_CTX *);
+extern void digest_prepare(void);
+extern int digest_lookup(const struct stat *, DIGEST *);
+extern void digest_store(const struct stat *, DIGEST, time_t);
+extern void digest_save(void);
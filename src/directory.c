@@ -15,8 +15,13 @@
 #include <config.h>
 
 #include <sys/types.h>		/* clex.h */
+#include <sys/stat.h>		/* umask() */
+#include <errno.h>			/* errno */
+#include <stdio.h>			/* fopen() */
 #include <stdlib.h>			/* qsort() */
-#include <string.h>			/* strcmp() */
+#include <string.h>			/* memcmp() */
+#include <time.h>			/* time() */
+#include <unistd.h>			/* unlink() */
 
 #include "clex.h"
 #include "directory.h"
@@ -32,7 +37,7 @@
 #include "undo.h"			/* undo_init() */
 #include "ustring.h"		/* us_copy() */
 #include "userdata.h"		/* dir_tilde() */
-#include "util.h"			/* emalloc() */
+#include "util.h"			/* hash_str() */
 
 /*
  * The directory list 'dirlist' maintained here contains:
@@ -44,21 +49,45 @@
  *
  * the 'dirlist' is never empty, the first element is inserted
  * already during startup
+ *
+ * 'dirlist' is a doubly linked list ordered by the time of the last
+ * visit (most recently used first), all entries are indexed also
+ * by a hash table 'dirhash', both lookup and move to the front
+ * are constant time operations regardless of the list length
+ *
+ * the 'dirlist' is preserved in the file ~/.clexdir between sessions,
+ * the number of visits and the time of the last visit is recorded
+ * for the directory jump panel which ranks the directories by
+ * "frecency" (frequency combined with recency)
  */
 
-/* additional entries to be allocated when the 'dirlist' table is full */
+/* limits to protect resources */
+#define DIR_FILESIZE_LIMIT	1000000
+#define DIR_ENTRIES_LIMIT	5000
+
+/* additional entries to be allocated when there are no free entries */
 #define SAVEDIR_ALLOC_UNIT	32
-#define SAVEDIR_ALLOC_MAX	384	/* 'dirlist' size limit */
+/* initial size of the hash table (must be a power of two) */
+#define SAVEDIR_HASH_INIT	64
 
-typedef struct {
+typedef struct savedir {
 	USTRING dirname;		/* directory name */
 	SDSTRING savefile;		/* file panel's current file */
 	int savetop, savecurs;	/* top line, cursor line */
+	int visits;				/* number of visits */
+	int loaded;				/* visits recorded in the directory file */
+	time_t lastvisit;		/* time of the last visit */
+	unsigned int hash;		/* hash_str(dirname) */
+	struct savedir *prev, *next;	/* 'dirlist' links */
+	struct savedir *hnext;	/* hash chain link */
 } SAVEDIR;
 
-static SAVEDIR **dirlist;	/* list of visited directories */
-static int diralloc = 0;	/* number of allocated entries in 'dirlist' */
-static int dircnt = 0;		/* number of used entries in 'dirlist' */
+static SAVEDIR *dirlist = 0;	/* list of visited directories */
+static SAVEDIR *dirfree = 0;	/* list of unused entries */
+static SAVEDIR **dirhash;		/* hash table */
+static unsigned int hashsize = 0;	/* size of the 'dirhash' table */
+static int dircnt = 0;			/* number of entries in 'dirlist' */
+static const char *user_dir_file = 0;	/* personal directory list filename */
 
 /* directory panel's data is built from 'dirlist' */
 #define DP_LIST (panel_dir.dir)
@@ -69,6 +98,11 @@ static int dp_max;			/* max number of entries to be used */
 #define DPS_LIST (panel_dir_split.dir)
 static int dps_alloc = 0;	/* max number of entries in the dir_split panel */
 
+/* directory jump panel */
+#define DJ_LIST (panel_dir_jump.dir)
+
+static void read_dir_file(void);
+
 void
 dir_initialize(void)
 {
@@ -77,6 +111,10 @@ dir_initialize(void)
 	edit_setprompt(&line_dir,"Change directory: ");
 
 	dir_reconfig();
+
+	pathname_set_directory(clex_data.homedir);
+	user_dir_file = estrdup(pathname_join(".clexdir"));
+	read_dir_file();
 }
 
 void
@@ -92,92 +130,203 @@ dir_reconfig(void)
 }
 
 /*
- * length of the common part of two directory names (FQDNs)
- * (this is not the same as common part of two strings)
+ * The directory panel is built from a trie of pathname components.
+ * Every node represents a directory, it is identified by a prefix
+ * of one of the pathnames from the 'dirlist'. The nodes are stored
+ * in a pool 'dt_pool' which is re-used each time the panel is built.
  */
-static size_t
-common_part(const char *dir1, const char *dir2)
+#define DT_ALLOC_UNIT	128
+
+typedef struct dir_node {
+	const char *path;		/* only the first 'len' chars of 'path' belong here */
+	size_t len;				/* the root directory has 'len' 0 */
+	unsigned int hash;		/* hash_strn(path,len) */
+	SDSTRING comp;			/* last component of the path (sort key) */
+	const char *name;		/* name shown in the panel or NULL if not shown */
+	FLAG keep;				/* the shown name is protected from compacting */
+	int below;				/* number of shown names in the subtree (excl. this) */
+	struct dir_node *parent, *child, *sibling;	/* trie links */
+	struct dir_node *hnext;	/* hash chain link */
+} DIR_NODE;
+
+static DIR_NODE **dt_pool;		/* pool of nodes allocated in blocks */
+static int dt_blocks = 0;		/* number of allocated blocks */
+static int dt_cnt;				/* number of used nodes */
+static DIR_NODE **dt_hash;		/* hash table of used nodes */
+static unsigned int dt_hashsize = 0;	/* size of 'dt_hash' */
+static DIR_NODE **dt_sort;		/* sort buffer for the trie traversal */
+static int dt_sortalloc = 0, dt_sortcnt;
+
+static void
+dir_tree_reset(void)
 {
-	char ch1, ch2;
-	size_t i, slash;
-
-	for (i = slash = 0; /* until return */; i++) {
-		ch1 = dir1[i];
-		ch2 = dir2[i];
-		if (ch1 == '\0')
-			return ch2 == '/' || ch2 == '\0' ? i : slash;
-		if (ch2 == '\0')
-			return ch1 == '/' ? i : slash;
-		if (ch1 != ch2)
-			return slash;
-		if (ch1 == '/')
-			slash = i;
+	unsigned int i;
+
+	dt_cnt = 0;
+	for (i = 0; i < dt_hashsize; i++)
+		dt_hash[i] = 0;
+}
+
+/* find or create the node for the first 'len' chars of 'path' */
+static DIR_NODE *
+dir_tree_node(const char *path, size_t len, DIR_NODE *parent)
+{
+	int i;
+	unsigned int hash;
+	DIR_NODE *pn, **pph;
+
+	hash = hash_strn(path,len);
+	if (dt_hashsize)
+		for (pn = dt_hash[hash & (dt_hashsize - 1)]; pn; pn = pn->hnext)
+			if (pn->hash == hash && pn->len == len
+			  && memcmp(pn->path,path,len) == 0)
+				return pn;
+
+	if (dt_cnt == dt_blocks * DT_ALLOC_UNIT) {
+		dt_pool = erealloc(dt_pool,(dt_blocks + 1) * sizeof(DIR_NODE *));
+		pn = dt_pool[dt_blocks++] = emalloc(DT_ALLOC_UNIT * sizeof(DIR_NODE));
+		for (i = 0; i < DT_ALLOC_UNIT; i++)
+			SD_INIT(pn[i].comp);
 	}
+	if (dt_cnt >= dt_hashsize) {
+		/* the table is rebuilt from scratch */
+		if (dt_hashsize)
+			free(dt_hash);
+		dt_hashsize = dt_hashsize ? 2 * dt_hashsize : DT_ALLOC_UNIT;
+		dt_hash = emalloc(dt_hashsize * sizeof(DIR_NODE *));
+		for (i = 0; i < dt_hashsize; i++)
+			dt_hash[i] = 0;
+		for (i = 0; i < dt_cnt; i++) {
+			pn = dt_pool[i / DT_ALLOC_UNIT] + i % DT_ALLOC_UNIT;
+			pph = dt_hash + (pn->hash & (dt_hashsize - 1));
+			pn->hnext = *pph;
+			*pph = pn;
+		}
+	}
+
+	pn = dt_pool[dt_cnt / DT_ALLOC_UNIT] + dt_cnt % DT_ALLOC_UNIT;
+	dt_cnt++;
+	pn->path = path;
+	pn->len = len;
+	pn->hash = hash;
+	if (parent) {
+		/* 'path' + 'parent->len' points to the slash */
+		sd_copyn(&pn->comp,path + parent->len + 1,len - parent->len - 1);
+		pn->sibling = parent->child;
+		parent->child = pn;
+	}
+	else {
+		sd_copy(&pn->comp,"/");
+		pn->sibling = 0;
+	}
+	pn->parent = parent;
+	pn->child = 0;
+	pn->name = 0;
+	pn->below = 0;
+	pph = dt_hash + (hash & (dt_hashsize - 1));
+	pn->hnext = *pph;
+	*pph = pn;
+	return pn;
 }
 
-/*
- * check the relationship of two directories (FQDNs)
- *   return -1: dir2 is subdir of dir1 (/dir2 = /dir1 + /sub)
- *   return +1: dir1 is subdir of dir2 (/dir1 = /dir2 + /sub)
- *   return  0: otherwise
- */
-static int
-check_subdir(const char *dir1, const char *dir2)
+/* insert a directory name (FQDN) into the trie */
+static DIR_NODE *
+dir_tree_insert(const char *dirname)
 {
-	size_t slash;
+	size_t i;
+	DIR_NODE *pn;
+
+	pn = dir_tree_node(dirname,0,0);
+	if (dirname[1] == '\0')
+		return pn;		/* root directory */
+	for (i = 1; dirname[i]; i++)
+		if (dirname[i] == '/')
+			pn = dir_tree_node(dirname,i,pn);
+	return dir_tree_node(dirname,i,pn);
+}
 
-	slash = common_part(dir1,dir2);
-	return (dir2[slash] == '\0') - (dir1[slash] == '\0');
+/* add or remove a shown name in the node 'pn' */
+static void
+dir_tree_show(DIR_NODE *pn, int delta)
+{
+	while ((pn = pn->parent))
+		pn->below += delta;
 }
 
-/*
- * comparison function for qsort() - comparing directories
- * (this is not the same as comparing strings)
- */
 static int
 qcmp(const void *e1, const void *e2)
 {
-	static USTRING dup1 = { 0,0 }, dup2 = { 0,0 };
-	size_t slash, len1, len2;
-	const char *dir1, *dir2;
+	return (config_num(CFG_COLLATION) ? STRCOLL : strcmp)
+	  (SDSTR((*(DIR_NODE **)e1)->comp),SDSTR((*(DIR_NODE **)e2)->comp));
+}
 
-	dir1 = ((DIR_ENTRY *)e1)->name;
-	dir2 = ((DIR_ENTRY *)e2)->name;
+/*
+ * pre-order traversal of the trie, the shown names are stored
+ * into the panel's list in the order in which they are found
+ *
+ * Two lines like these:
+ *     /aaa/bbb/111
+ *     /aaa/bbb/2222
+ * are displayed as:
+ *     /aaa/bbb/111
+ *           __/2222
+ * and for that purpose a string length 'shlen' is computed
+ *     |<---->|
+ * it is the length of the lowest common ancestor of two consecutive
+ * lines, i.e. the shortest path visited between them
+ */
+static void
+dir_tree_list(DIR_NODE *pn, int *pcnt, size_t *plca)
+{
+	int first, last, i;
+	DIR_NODE *child;
+
+	if (pn->name) {
+		DP_LIST[*pcnt].name = pn->name;
+		DP_LIST[*pcnt].shlen = *plca;
+		(*pcnt)++;
+		*plca = pn->len;
+	}
+	if (pn->below == 0)
+		return;
 
-	/* skip the common part */
-	slash = common_part(dir1,dir2);
-	if (dir1[slash] == '\0' && dir2[slash] == '\0')
-		return 0;
-	if (dir1[slash] == '\0')
-		return -1;
-	if (dir2[slash] == '\0')
-		return 1;
-
-	/* compare one directory component */
-	slash++;
-	for (len1 = slash; dir1[len1] != '/' && dir1[len1] != '\0'; len1++)
-		;
-	us_copyn(&dup1,dir1 + slash,len1);
-	for (len2 = slash; dir2[len2] != '/' && dir2[len2] != '\0'; len2++)
-		;
-	us_copyn(&dup2,dir2 + slash,len2);
+	first = dt_sortcnt;
+	for (child = pn->child; child; child = child->sibling)
+		if (child->name || child->below) {
+			if (dt_sortcnt == dt_sortalloc) {
+				dt_sortalloc += DT_ALLOC_UNIT;
+				dt_sort = erealloc(dt_sort,dt_sortalloc * sizeof(DIR_NODE *));
+			}
+			dt_sort[dt_sortcnt++] = child;
+		}
+	last = dt_sortcnt;
+	qsort(dt_sort + first,last - first,sizeof(DIR_NODE *),qcmp);
 
-	return (config_num(CFG_COLLATION) ? STRCOLL : strcmp)
-	  (USTR(dup1),USTR(dup2));
+	for (i = first; i < last; i++) {
+		dir_tree_list(dt_sort[i],pcnt,plca);
+		LIMIT_MAX(*plca,pn->len);
+	}
+	dt_sortcnt = first;
 }
 
 /*
  * In order not to waste CPU cycles, the panel 'panel_dir'
  * is not maintained continuously. Following function builds the
  * directory panel from the 'dirlist'.
+ *
+ * Compacting: a directory is not shown if any of its subdirectories
+ * is shown and it replaces a shown parent directory; the top
+ * NO_COMPACT directory names are preserved.
  */
 #define NO_COMPACT	5	/* preserve top 5 directory names */
 void
 dir_main_panel(void)
 {
-	int i, j, cnt, sub;
-	FLAG store;
+	int i, cnt;
+	size_t lca;
 	const char *dirname, *filter;
+	SAVEDIR *pd;
+	DIR_NODE *pn, *root, *up;
 
 	/* D_PANEL_SIZE = AUTO */
 	if (config_num(CFG_D_SIZE) == 0) {
@@ -191,45 +340,36 @@ dir_main_panel(void)
 
 	filter = panel_dir.pd->filtering ? panel_dir.pd->filter->line : 0;
 
-	for (i = cnt = 0; i < dircnt; i++) {
+	dir_tree_reset();
+	root = dir_tree_node("/",0,0);
+	for (pd = dirlist, i = cnt = 0; pd; pd = pd->next, i++) {
 		if (cnt == dp_max)
 			break;
-		dirname = USTR(dirlist[i]->dirname);
+		dirname = USTR(pd->dirname);
 		if (filter && !substring(dirname,filter,0))
 			continue;
+		pn = dir_tree_insert(dirname);
 		/* compacting */
-		store = 1;
-		if (i >= NO_COMPACT)
-			for (j = 0; j < cnt; j++) {
-				sub = check_subdir(dirname,DP_LIST[j].name);
-				if (sub == -1)
-					store = 0;
-				else if (sub == 1 && j >= NO_COMPACT) {
-					DP_LIST[j].name = dirname;
-					store = 0;
+		if (i >= NO_COMPACT) {
+			if (pn->below)
+				continue;
+			for (up = pn->parent; up; up = up->parent)
+				if (up->name && !up->keep) {
+					up->name = 0;
+					dir_tree_show(up,-1);
+					cnt--;
 				}
 		}
-		if (store)
-			DP_LIST[cnt++].name = dirname;
+		pn->name = dirname;
+		pn->keep = cnt < NO_COMPACT;
+		dir_tree_show(pn,1);
+		cnt++;
 	}
 
-	qsort(DP_LIST,cnt,sizeof(DIR_ENTRY),qcmp);
-
-	/*
-	 * Two lines like these:
-	 *     /aaa/bbb/111
-	 *     /aaa/bbb/2222
-	 * are displayed as:
-	 *     /aaa/bbb/111
-	 *           __/2222
-	 * and for that purpose a string length 'shlen' is computed
-	 *     |<---->|
-	 */
-	DP_LIST[0].shlen = 0;
-	for (i = 1; i < cnt; i++)
-		DP_LIST[i].shlen =
-			common_part(DP_LIST[i].name,DP_LIST[i - 1].name);
-
+	cnt = 0;
+	lca = 0;
+	dt_sortcnt = 0;
+	dir_tree_list(root,&cnt,&lca);
 	panel_dir.pd->cnt = cnt;
 }
 
@@ -245,7 +385,7 @@ dir_main_prepare(void)
 	panel_dir.pd->top = panel_dir.pd->min;
 	/* set cursor to previously used directory */
 	panel_dir.pd->curs = 0;
-	prevdir = USTR(dirlist[(dircnt >= 2)]->dirname);	/* [1] or [0] */
+	prevdir = USTR((dirlist->next ? dirlist->next : dirlist)->dirname);
 	for (i = 0; i < panel_dir.pd->cnt; i++)
 		if (DP_LIST[i].name == prevdir) {
 			panel_dir.pd->curs = i;
@@ -312,6 +452,101 @@ dir_split_prepare(void)
 	/* textline inherited */
 }
 
+static SAVEDIR *
+savedir_find(const char *dir, unsigned int hash)
+{
+	SAVEDIR *pd;
+
+	for (pd = dirhash[hash & (hashsize - 1)]; pd; pd = pd->hnext)
+		if (pd->hash == hash && strcmp(USTR(pd->dirname),dir) == 0)
+			return pd;
+	return 0;
+}
+
+/* double the hash table size, the load factor is kept below 1 */
+static void
+savedir_rehash(void)
+{
+	unsigned int i;
+	SAVEDIR *pd, **pph;
+
+	if (hashsize)
+		free(dirhash);
+	hashsize = hashsize ? 2 * hashsize : SAVEDIR_HASH_INIT;
+	dirhash = emalloc(hashsize * sizeof(SAVEDIR *));
+	for (i = 0; i < hashsize; i++)
+		dirhash[i] = 0;
+	for (pd = dirlist; pd; pd = pd->next) {
+		pph = dirhash + (pd->hash & (hashsize - 1));
+		pd->hnext = *pph;
+		*pph = pd;
+	}
+}
+
+/* create a new entry (not inserted into 'dirlist' yet) */
+static SAVEDIR *
+savedir_new(const char *dir, unsigned int hash)
+{
+	int i;
+	SAVEDIR *pd, **pph;
+
+	if (dirfree == 0) {
+		pd = emalloc(SAVEDIR_ALLOC_UNIT * sizeof(SAVEDIR));
+		for (i = 0; i < SAVEDIR_ALLOC_UNIT; i++) {
+			US_INIT(pd[i].dirname);
+			SD_INIT(pd[i].savefile);
+			pd[i].next = dirfree;
+			dirfree = pd + i;
+		}
+	}
+	pd = dirfree;
+	dirfree = pd->next;
+
+	us_copy(&pd->dirname,dir);
+	pd->hash = hash;
+	if (++dircnt > hashsize)
+		savedir_rehash();
+	pph = dirhash + (hash & (hashsize - 1));
+	pd->hnext = *pph;
+	*pph = pd;
+	return pd;
+}
+
+/*
+ * move the entry to the front of the 'dirlist'
+ * return value: 1 = moved, 0 = it was already there
+ */
+static int
+savedir_use(SAVEDIR *pd)
+{
+	if (pd == dirlist)
+		return 0;
+	if (pd->prev) {
+		/* unlink */
+		pd->prev->next = pd->next;
+		if (pd->next)
+			pd->next->prev = pd->prev;
+	}
+	pd->prev = 0;
+	pd->next = dirlist;
+	if (dirlist)
+		dirlist->prev = pd;
+	dirlist = pd;
+	return 1;
+}
+
+/* append the entry to the end of the 'dirlist' */
+static void
+savedir_append(SAVEDIR *pd, SAVEDIR *last)
+{
+	pd->next = 0;
+	pd->prev = last;
+	if (last)
+		last->next = pd;
+	else
+		dirlist = pd;
+}
+
 /*
  * save the current directory name and the current cursor position
  * in the file panel to 'dirlist'
@@ -319,73 +554,65 @@ dir_split_prepare(void)
 void
 filepos_save(void)
 {
-	int i;
 	FLAG new;
-	SAVEDIR *x, *top;
+	unsigned int hash;
+	const char *dir;
+	SAVEDIR *pd;
 
-	if (dircnt == diralloc && diralloc < SAVEDIR_ALLOC_MAX) {
-		diralloc += SAVEDIR_ALLOC_UNIT;
-		dirlist = erealloc(dirlist,diralloc * sizeof(SAVEDIR *));
-		x = emalloc(SAVEDIR_ALLOC_UNIT * sizeof(SAVEDIR));
-		for (i = 0; i < SAVEDIR_ALLOC_UNIT; i++) {
-			US_INIT(x[i].dirname);
-			SD_INIT(x[i].savefile);
-			dirlist[dircnt + i] = x + i;
-		}
+	dir = USTR(ppanel_file->dir);
+	hash = hash_str(dir);
+	if (hashsize && (pd = savedir_find(dir,hash)))
+		new = 0;
+	else {
+		/* no duplicates allowed */
+		pd = savedir_new(dir,hash);
+		pd->prev = 0;
+		pd->visits = pd->loaded = 0;
+		new = 1;
 	}
-
-	for (new = 1, top = dirlist[0], i = 0; i <= dircnt && i < SAVEDIR_ALLOC_MAX; i++) {
-		x = dirlist[i];
-		dirlist[i] = top;
-		top = x;
-		if (i == dircnt) {
-			dircnt++;
-			break;
-		}
-		if (strcmp(USTR(top->dirname),USTR(ppanel_file->dir)) == 0) {
-			/* no duplicates allowed */
-			new = 0;
-			break;
-		}
+	if (savedir_use(pd) || new) {
+		/* a change of the working directory is counted as a visit */
+		pd->visits++;
+		pd->lastvisit = time(0);
 	}
-	if (new)
-		us_copy(&top->dirname,USTR(ppanel_file->dir));
+
 	if (ppanel_file->pd->cnt) {
-		sd_copy(&top->savefile,
+		sd_copy(&pd->savefile,
 		  SDSTR(ppanel_file->files[ppanel_file->pd->curs]->file));
-		top->savecurs = ppanel_file->pd->curs;
-		top->savetop = ppanel_file->pd->top;
+		pd->savecurs = ppanel_file->pd->curs;
+		pd->savetop = ppanel_file->pd->top;
 	}
 	else if (new) {
-		sd_copy(&top->savefile,"..");
-		top->savecurs = 0;
-		top->savetop = 0;
+		sd_copy(&pd->savefile,"..");
+		pd->savecurs = 0;
+		pd->savetop = 0;
 	}
-	dirlist[0] = top;
 }
 
 /* set the file panel cursor according to data stored in 'dirlist' */
 void
 filepos_set(void)
 {
-	char *dir;
-	int i, line;
-	size_t len;
-	SAVEDIR *pe;
+	const char *dir;
+	int line;
+	SAVEDIR *pd;
 
 	if (ppanel_file->pd->cnt) {
 		dir = USTR(ppanel_file->dir);
-		len = strlen(dir);
-		for (i = 0; i < dircnt; i++) {
-			pe = dirlist[i];
-			if (strcmp(dir,USTR(pe->dirname)) == 0) {
-				/* found */
-				line = files_find(SDSTR(pe->savefile));
-				ppanel_file->pd->curs = line >= 0 ? line : pe->savecurs;
-				ppanel_file->pd->top = pe->savetop;
-				pan_adjust(ppanel_file->pd);
-				return;
+		if (hashsize && (pd = savedir_find(dir,hash_str(dir)))) {
+			/* found */
+			line = pd->savecurs;
+			/* the file is usually still at the saved position */
+			if (line >= ppanel_file->pd->cnt || strcmp(SDSTR(pd->savefile),
+			  SDSTR(ppanel_file->files[line]->file)) != 0) {
+				line = files_find(SDSTR(pd->savefile));
+				if (line < 0)
+					line = pd->savecurs;
 			}
+			ppanel_file->pd->curs = line;
+			ppanel_file->pd->top = pd->savetop;
+			pan_adjust(ppanel_file->pd);
+			return;
 		}
 
 		/* not found */
@@ -396,6 +623,242 @@ filepos_set(void)
 	pan_adjust(ppanel_file->pd);
 }
 
+/*
+ * the ~/.clexdir file format - one line per directory:
+ *   visits <space> last_visit <space> top <space> cursor
+ *     <tab> current_file <tab> directory <newline>
+ * lines are ordered by the time of the last visit
+ */
+
+/*
+ * read the directory file and merge it with the 'dirlist',
+ * new directories are appended at the end, existing directories
+ * get the visits recorded since the file was read the last time
+ * (concurrent sessions add their visits too) and the later time
+ */
+static void
+read_dir_file(void)
+{
+	int error, visits, top, curs;
+	long lastvisit;
+	size_t filesize;
+	unsigned int hash;
+	char *source, *ptr, *next, *file, *dir;
+	SAVEDIR *pd, *last;
+
+	filesize = DIR_FILESIZE_LIMIT;
+	source = read_file(user_dir_file,&filesize,&error);
+	if (source == 0) {
+		if (error != 1 || errno != ENOENT)
+			win_warning_fmt("DIRECTORY: Cannot read the directory file \"%s\"",
+			  user_dir_file);
+		return;
+	}
+
+	for (last = dirlist; last && last->next; last = last->next)
+		;
+	for (ptr = source; ptr < source + filesize; ptr = next) {
+		for (next = ptr; *next != '\n'; next++)
+			;
+		*next++ = '\0';
+		if (dircnt >= DIR_ENTRIES_LIMIT)
+			break;
+		if (sscanf(ptr,"%d %ld %d %d",&visits,&lastvisit,&top,&curs) != 4
+		  || (file = strchr(ptr,'\t')) == 0
+		  || (dir = strchr(++file,'\t')) == 0 || *++dir != '/')
+			continue;	/* invalid line */
+		dir[-1] = '\0';
+
+		hash = hash_str(dir);
+		if (hashsize && (pd = savedir_find(dir,hash))) {
+			pd->visits += visits - pd->loaded;
+			pd->loaded = visits;
+			LIMIT_MIN(pd->lastvisit,lastvisit);
+			continue;
+		}
+		pd = savedir_new(dir,hash);
+		sd_copy(&pd->savefile,*file ? file : "..");
+		pd->savetop = top;
+		pd->savecurs = curs;
+		pd->visits = pd->loaded = visits;
+		pd->lastvisit = lastvisit;
+		savedir_append(pd,last);
+		last = pd;
+	}
+	free(source);
+}
+
+/*
+ * save the 'dirlist' to the directory file, this is done when
+ * quitting CLEX normally; it allocates memory and therefore it
+ * must not be called from err_exit() which is reached also from
+ * a signal handler or after an allocation failure
+ */
+void
+dir_save(void)
+{
+	int i;
+	FLAG errflag;
+	FILE *fp;
+	const char *file;
+	char *tmpname;
+	SAVEDIR *pd;
+
+	if (user_dir_file == 0 || dirlist == 0)
+		return;
+
+	/* another CLEX session might have updated the file meanwhile */
+	read_dir_file();
+
+	tmpname = emalloc(strlen(user_dir_file) + 16);
+	sprintf(tmpname,"%s.%d",user_dir_file,(int)clex_data.pid);
+	umask(clex_data.umask | 077);
+	fp = fopen(tmpname,"w");
+	umask(clex_data.umask);
+	if (fp == 0) {
+		win_warning_fmt("DIRECTORY: Cannot open the directory file \"%s\" "
+		  "for writing",tmpname);
+		free(tmpname);
+		return;
+	}
+
+	for (pd = dirlist, i = 0; pd && i < DIR_ENTRIES_LIMIT; pd = pd->next) {
+		if (strpbrk(USTR(pd->dirname),"\t\n"))
+			continue;
+		file = SDSTR(pd->savefile);
+		if (strpbrk(file,"\t\n"))
+			file = "";
+		fprintf(fp,"%d %ld %d %d\t%s\t%s\n",pd->visits,(long)pd->lastvisit,
+		  pd->savetop,pd->savecurs,file,USTR(pd->dirname));
+		pd->loaded = pd->visits;
+		i++;
+	}
+	errflag = ferror(fp) != 0;
+	if (fclose(fp) || errflag || rename(tmpname,user_dir_file) < 0) {
+		unlink(tmpname);
+		win_warning_fmt("DIRECTORY: Cannot write the directory file \"%s\"",
+		  user_dir_file);
+	}
+	free(tmpname);
+}
+
+/*
+ * frecency: number of visits weighted by the time elapsed since
+ * the last visit (weight 4, 2, 1/2 and 1/4 for an hour, a day,
+ * a week and more)
+ */
+static long
+frecency(const SAVEDIR *pd, time_t now)
+{
+	time_t age;
+
+	age = now - pd->lastvisit;
+	if (age < 3600)
+		return 16L * pd->visits;
+	if (age < 86400)
+		return 8L * pd->visits;
+	if (age < 7 * 86400)
+		return 2L * pd->visits;
+	return pd->visits;
+}
+
+typedef struct {
+	const char *name;
+	long score;
+	int order;				/* the 'dirlist' order */
+} DJ_RANK;
+
+static int
+qcmp_rank(const void *e1, const void *e2)
+{
+	long diff;
+
+	diff = ((DJ_RANK *)e2)->score - ((DJ_RANK *)e1)->score;
+	if (diff)
+		return diff > 0 ? 1 : -1;
+	return ((DJ_RANK *)e1)->order - ((DJ_RANK *)e2)->order;
+}
+
+/* all space separated words of 'query' must be found in 'dir' */
+static int
+dir_match(const char *dir, const char *query)
+{
+	static USTRING word = { 0,0 };
+	const char *end;
+
+	for (; /* until return */; query = end) {
+		while (*query == ' ')
+			query++;
+		if (*query == '\0')
+			return 1;
+		for (end = query; *end && *end != ' '; end++)
+			;
+		us_copyn(&word,query,end - query);
+		if (!substring(dir,USTR(word),1))
+			return 0;
+	}
+}
+
+/* rank the directories matching the text in the input line */
+void
+dir_jump_panel(void)
+{
+	static DJ_RANK *rank;
+	static int rank_alloc = 0;
+	int i, cnt;
+	time_t now;
+	const char *query, *cwd;
+	SAVEDIR *pd;
+
+	if (dircnt > rank_alloc) {
+		if (rank_alloc) {
+			free(rank);
+			free(DJ_LIST);
+		}
+		rank_alloc = dircnt + SAVEDIR_ALLOC_UNIT;
+		rank = emalloc(rank_alloc * sizeof(DJ_RANK));
+		DJ_LIST = emalloc(rank_alloc * sizeof(DIR_ENTRY));
+	}
+
+	now = time(0);
+	query = USTR(textline->line);
+	cwd = USTR(ppanel_file->dir);
+	for (pd = dirlist, cnt = 0; pd; pd = pd->next)
+		if (strcmp(USTR(pd->dirname),cwd) && dir_match(USTR(pd->dirname),query)) {
+			rank[cnt].name = USTR(pd->dirname);
+			rank[cnt].score = frecency(pd,now);
+			rank[cnt].order = cnt;
+			cnt++;
+		}
+	/* the 'dirlist' order breaks ties in favor of recent entries */
+	qsort(rank,cnt,sizeof(DJ_RANK),qcmp_rank);
+
+	for (i = 0; i < cnt; i++) {
+		DJ_LIST[i].name = rank[i].name;
+		DJ_LIST[i].shlen = 0;
+	}
+	panel_dir_jump.pd->cnt = cnt;
+	panel_dir_jump.pd->top = panel_dir_jump.pd->min;
+	panel_dir_jump.pd->curs = cnt ? 0 : -1;
+}
+
+void
+dir_jump_prepare(void)
+{
+	textline = &line_tmp;
+	edit_setprompt(textline,"Jump to: ");
+	edit_nu_kill();
+	panel = panel_dir_jump.pd;
+	dir_jump_panel();
+}
+
+void
+cx_dir_jump_enter(void)
+{
+	if (changedir(DJ_LIST[panel_dir_jump.pd->curs].name) == 0)
+		next_mode = MODE_SPECIAL_RETURN;
+}
+
 /* following cx_dir_xxx functions are used in both MODE_DIR_XXX modes */
 
 static const char *
@@ -5,6 +5,10 @@ extern void dir_main_panel(void);
 extern void dir_split_prepare(void);
 extern void filepos_save(void);
 extern void filepos_set(void);
+extern void dir_save(void);
+extern void dir_jump_panel(void);
+extern void dir_jump_prepare(void);
+extern void cx_dir_jump_enter(void);
 extern void cx_dir_tab(void);
 extern void cx_dir_enter(void);
 extern void cx_dir_bookmark(void);
@@ -16,16 +16,41 @@
 
 #include <sys/types.h>		/* pid_t */
 #include <errno.h>			/* errno */
+#include <fcntl.h>			/* open() */
 #include <signal.h>			/* sigaction() */
 #include <stdio.h>			/* puts() */
 #include <stdlib.h>			/* exit() */
 #include <string.h>			/* strcmp() */
 #include <unistd.h>			/* fork() */
 
+/* posix_spawn() */
+#if defined(HAVE_SPAWN_H) && defined(HAVE_POSIX_SPAWN)
+# include <spawn.h>
+# define USE_SPAWN
+#endif
+
+/* gettimeofday() */
+#if TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# if HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+
 /* waitpid() */
 #ifdef HAVE_SYS_WAIT_H
 # include <sys/wait.h>
 #endif
+
+/* wait4() */
+#if defined(HAVE_WAIT4) && defined(HAVE_SYS_RESOURCE_H)
+# include <sys/resource.h>
+# define USE_WAIT4
+#endif
 #ifndef WEXITSTATUS
 # define WEXITSTATUS(status) ((unsigned)(status) >> 8)
 #endif
@@ -38,11 +63,13 @@
 
 #include "cfg.h"			/* config_str() */
 #include "control.h"		/* get_current_mode() */
+#include "coproc.h"			/* coproc_execute() */
 #include "edit.h"			/* edit_islong() */
 #include "inout.h"			/* win_remark() */
 #include "filepanel.h"		/* changedir() */
 #include "history.h"		/* hist_save() */
-#include "list.h"			/* list_directory() */
+#include "jobs.h"			/* job_start() */
+#include "list.h"			/* list_refresh() */
 #include "tty.h"			/* tty_setraw() */
 #include "undo.h"			/* undo_init() */
 #include "util.h"			/* base_name() */
@@ -53,9 +80,13 @@
 #include "sort.h"			/* sort_files() */
 
 extern int errno;
+#ifdef USE_SPAWN
+extern char **environ;
+#endif
 
 #define MAX_SHELL_ARGS	8
 static char *shell_argv[MAX_SHELL_ARGS + 2 + 1], *shell_iargv[2];
+static char *shell_cargv[MAX_SHELL_ARGS + 1 + 1];	/* coprocess */
 static int cmd_index;		/* which parameter is the command
 							   to be executed */
 #define MAX_NPL_CMDS 128
@@ -138,6 +169,14 @@ parse_shellprog(const char *shellprog)
 
 	clex_data.shelltype = shelltype(shell_argv[0]);
 
+	/* coprocess: the same options, but commands are read from stdin */
+	for (ac = 0; ac < cmd_index; ac++)
+		shell_cargv[ac] = shell_argv[ac];
+	if (strcmp(shell_cargv[ac - 1],"-c") == 0)
+		ac--;
+	shell_cargv[ac++] = "-s";
+	shell_cargv[ac] = 0;
+
 	return 0;
 }
 
@@ -145,6 +184,8 @@ parse_shellprog(const char *shellprog)
 void
 exec_shell_reconfig(void)
 {
+	coproc_stop();
+
 	if (*config_str(CFG_SHELLPROG)) {
 		if (parse_shellprog(config_str(CFG_SHELLPROG)) == 0)
 			return;		/* success */
@@ -212,52 +253,244 @@ template_aliases_reconfig(void)
 	}
 }
 
-int
-execute(const char *command, FLAG prompt_user)
+#ifdef USE_WAIT4
+# define TV2MS(TV)	((TV).tv_sec * 1000L + (TV).tv_usec / 1000)
+#endif
+
+static void
+print_stats(const CMD_STATS *ps)
+{
+	printf("\nreal %s",duration_str(ps->wall));
+	if (ps->user >= 0) {
+		printf("  user %s",duration_str(ps->user));
+		printf("  sys %s",duration_str(ps->sys));
+	}
+	if (ps->maxrss >= 0)
+		printf("  max RSS %ld kB",ps->maxrss);
+}
+
+#ifdef USE_SPAWN
+/*
+ * start the shell with posix_spawn(), the parent's page tables are
+ * not copied as with fork(), this matters when CLEX holds a large
+ * directory listing in memory
+ */
+static pid_t
+spawn_command(const char *command)
+{
+	int err;
+	pid_t childpid;
+	sigset_t sigs;
+	posix_spawnattr_t attr;
+	posix_spawn_file_actions_t *pactions;
+#if defined(_POSIX_JOB_CONTROL) \
+  && defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDTCSETPGRP_NP)
+	posix_spawn_file_actions_t actions;
+#endif
+
+	if ( (err = posix_spawnattr_init(&attr)) ) {
+		printf("EXEC: Cannot create new process (%s)\n",strerror(err));
+		return -1;
+	}
+
+	/* reset signal dispositions */
+	sigemptyset(&sigs);
+	sigaddset(&sigs,SIGINT);
+	sigaddset(&sigs,SIGQUIT);
+#ifdef _POSIX_JOB_CONTROL
+	sigaddset(&sigs,SIGTSTP);
+	sigaddset(&sigs,SIGTTIN);
+	sigaddset(&sigs,SIGTTOU);
+#endif
+	posix_spawnattr_setsigdefault(&attr,&sigs);
+	sigemptyset(&sigs);
+	posix_spawnattr_setsigmask(&attr,&sigs);
+
+	pactions = 0;
+#ifdef _POSIX_JOB_CONTROL
+	/* move the new process to a new foreground process group */
+	posix_spawnattr_setpgroup(&attr,0);
+	posix_spawnattr_setflags(&attr,POSIX_SPAWN_SETSIGDEF
+	  | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+# ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDTCSETPGRP_NP
+	if (posix_spawn_file_actions_init(&actions) == 0) {
+		pactions = &actions;
+		posix_spawn_file_actions_addtcsetpgrp_np(pactions,STDIN_FILENO);
+	}
+# endif
+#else
+	posix_spawnattr_setflags(&attr,POSIX_SPAWN_SETSIGDEF
+	  | POSIX_SPAWN_SETSIGMASK);
+#endif
+
+	((const char **)shell_argv)[cmd_index] = command;
+	err = posix_spawn(&childpid,shell_argv[0],pactions,&attr,
+	  *command ? shell_argv : shell_iargv,environ);
+	if (pactions)
+		posix_spawn_file_actions_destroy(pactions);
+	posix_spawnattr_destroy(&attr);
+	if (err) {
+		printf("EXEC: Cannot execute shell %s (%s)\n",
+		  shell_argv[0],strerror(err));
+		return -1;
+	}
+	return childpid;
+}
+#else
+/* start the shell with fork() and exec() */
+static pid_t
+spawn_command(const char *command)
 {
 	pid_t childpid;
-	FLAG failed;
-	int status, code;
 	struct sigaction act;
-	const char *signame;
-	const char *title = *command ? command : base_name(shell_argv[0]);
 
-	failed = 1;
-	xterm_title_set(1,title);
 	childpid = fork();
-	if (childpid == -1)
+	if (childpid == -1) {
 		printf("EXEC: Cannot create new process (%s)\n",
 		  strerror(errno));
-	else if (childpid == 0) {
-		/* child process = command */
+		return -1;
+	}
+	if (childpid > 0)
+		return childpid;
+
+	/* child process = command */
 #ifdef _POSIX_JOB_CONTROL
-		/* move this process to a new foreground process group */
-		childpid = getpid();
-		setpgid(childpid,childpid);
-		tcsetpgrp(STDIN_FILENO,childpid);
+	/* move this process to a new foreground process group */
+	childpid = getpid();
+	setpgid(childpid,childpid);
+	tcsetpgrp(STDIN_FILENO,childpid);
 #endif
 
-		/* reset signal dispositions */
-		act.sa_handler = SIG_DFL;
-		act.sa_flags = 0;
-		sigemptyset(&act.sa_mask);
-		sigaction(SIGINT,&act,0);
-		sigaction(SIGQUIT,&act,0);
+	/* reset signal dispositions */
+	act.sa_handler = SIG_DFL;
+	act.sa_flags = 0;
+	sigemptyset(&act.sa_mask);
+	sigaction(SIGINT,&act,0);
+	sigaction(SIGQUIT,&act,0);
 #ifdef _POSIX_JOB_CONTROL
-		sigaction(SIGTSTP,&act,0);
-		sigaction(SIGTTIN,&act,0);
-		sigaction(SIGTTOU,&act,0);
+	sigaction(SIGTSTP,&act,0);
+	sigaction(SIGTTIN,&act,0);
+	sigaction(SIGTTOU,&act,0);
 #endif
 
-		/* execute the command */
-		((const char **)shell_argv)[cmd_index] = command;
-		execv(shell_argv[0],*command ? shell_argv : shell_iargv);
-		printf("EXEC: Cannot execute shell %s (%s)\n",
-		  shell_argv[0],strerror(errno));
-		exit(99);
-		/* NOTREACHED */
+	/* execute the command */
+	((const char **)shell_argv)[cmd_index] = command;
+	execv(shell_argv[0],*command ? shell_argv : shell_iargv);
+	printf("EXEC: Cannot execute shell %s (%s)\n",
+	  shell_argv[0],strerror(errno));
+	exit(99);
+	/* NOTREACHED */
+	return -1;
+}
+#endif
+
+/*
+ * exec_background() starts the 'command' in the shell as a background
+ * job in its own process group, the standard input is /dev/null and
+ * the standard output and error output go to 'outfd'
+ *
+ * return value: process ID or -1 on error (errno is set)
+ */
+pid_t
+exec_background(const char *command, int outfd)
+{
+	pid_t childpid;
+#ifdef USE_SPAWN
+	int err;
+	sigset_t sigs;
+	posix_spawnattr_t attr;
+	posix_spawn_file_actions_t actions;
+
+	if ( (err = posix_spawnattr_init(&attr)) ) {
+		errno = err;
+		return -1;
+	}
+	if ( (err = posix_spawn_file_actions_init(&actions)) ) {
+		posix_spawnattr_destroy(&attr);
+		errno = err;
+		return -1;
+	}
+	sigemptyset(&sigs);
+	sigaddset(&sigs,SIGINT);
+	sigaddset(&sigs,SIGQUIT);
+	posix_spawnattr_setsigdefault(&attr,&sigs);
+	sigemptyset(&sigs);
+	posix_spawnattr_setsigmask(&attr,&sigs);
+	posix_spawnattr_setpgroup(&attr,0);
+	posix_spawnattr_setflags(&attr,POSIX_SPAWN_SETSIGDEF
+	  | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+	posix_spawn_file_actions_addopen(&actions,STDIN_FILENO,"/dev/null",
+	  O_RDONLY,0);
+	posix_spawn_file_actions_adddup2(&actions,outfd,STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions,outfd,STDERR_FILENO);
+
+	((const char **)shell_argv)[cmd_index] = command;
+	err = posix_spawn(&childpid,shell_argv[0],&actions,&attr,
+	  shell_argv,environ);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	if (err) {
+		errno = err;
+		return -1;
+	}
+#else
+	int fd;
+	struct sigaction act;
+
+	if ( (childpid = fork()) != 0)
+		return childpid;
+
+	/* child process = background job */
+	setpgid(0,0);
+	act.sa_handler = SIG_DFL;
+	act.sa_flags = 0;
+	sigemptyset(&act.sa_mask);
+	sigaction(SIGINT,&act,0);
+	sigaction(SIGQUIT,&act,0);
+	if ( (fd = open("/dev/null",O_RDONLY)) >= 0 && fd != STDIN_FILENO) {
+		dup2(fd,STDIN_FILENO);
+		close(fd);
+	}
+	dup2(outfd,STDOUT_FILENO);
+	dup2(outfd,STDERR_FILENO);
+	((const char **)shell_argv)[cmd_index] = command;
+	execv(shell_argv[0],shell_argv);
+	_exit(99);
+#endif
+	return childpid;
+}
+
+/*
+ * execute() runs the 'command' in the shell, if 'stats' is not null
+ * the statistics of the execution are stored there
+ * return value: 0 = command was successful, 1 = command failed
+ */
+int
+execute(const char *command, FLAG prompt_user, CMD_STATS *stats)
+{
+	pid_t childpid;
+	FLAG failed, core;
+	int status, code;
+	struct timeval start, stop;
+#ifdef USE_WAIT4
+	struct rusage ru;
+#endif
+	CMD_STATS st;
+	const char *signame;
+	const char *title = *command ? command : base_name(shell_argv[0]);
+
+	failed = 1;
+	st.valid = core = 0;
+	xterm_title_set(1,title);
+	gettimeofday(&start,0);
+	if (*command && config_num(CFG_SHELL_COPROC) && clex_data.shelltype == 0
+	  && coproc_execute(shell_cargv,USTR(ppanel_file->dir),command,
+	  &st.status) == 0) {
+		/* the shell's children are not ours, no usage data */
+		st.valid = 1;
+		st.user = st.sys = st.maxrss = -1;
 	}
-	else {
+	else if ( (childpid = spawn_command(command)) > 0) {
 		/* parent process = CLEX */
 #ifdef _POSIX_JOB_CONTROL
 		/* move child process to a new foreground process group */
@@ -266,7 +499,11 @@ execute(const char *command, FLAG prompt_user)
 #endif
 		for (; /* until break */;) {
 			/* wait for child process exit or stop */
+#ifdef USE_WAIT4
+			while (wait4(childpid,&status,WUNTRACED,&ru) < 0)
+#else
 			while (waitpid(childpid,&status,WUNTRACED) < 0)
+#endif
 				/* ignore EINTR */;
 #ifdef _POSIX_JOB_CONTROL
 			/* move CLEX to foreground */
@@ -275,6 +512,19 @@ execute(const char *command, FLAG prompt_user)
 			if (!WIFSTOPPED(status))
 				break;
 
+#if defined(USE_SPAWN) && defined(_POSIX_JOB_CONTROL)
+			/*
+			 * without posix_spawn_file_actions_addtcsetpgrp_np()
+			 * the command might have accessed the terminal before
+			 * it was moved to the foreground above
+			 */
+			if (WSTOPSIG(status) == SIGTTIN
+			  || WSTOPSIG(status) == SIGTTOU) {
+				tcsetpgrp(STDIN_FILENO,childpid);
+				kill(-childpid,SIGCONT);
+				continue;
+			}
+#endif
 			puts(
 				"\r\n"
 				"\r\n"
@@ -290,9 +540,37 @@ execute(const char *command, FLAG prompt_user)
 			kill(-childpid,SIGCONT);
 		}
 
+		st.valid = 1;
+#ifdef USE_WAIT4
+		st.user = TV2MS(ru.ru_utime);
+		st.sys = TV2MS(ru.ru_stime);
+		st.maxrss = ru.ru_maxrss;
+#else
+		st.user = st.sys = st.maxrss = -1;
+#endif
+		if (WIFEXITED(status))
+			st.status = WEXITSTATUS(status);
+		else {
+			st.status = -WTERMSIG(status);
+#ifdef WCOREDUMP
+			core = WCOREDUMP(status) != 0;
+#endif
+		}
+	}
+
+	if (st.valid) {
+		gettimeofday(&stop,0);
 		tty_reset();
-		if (WIFEXITED(status)) {
-			code = WEXITSTATUS(status);
+
+		st.wall = (stop.tv_sec - start.tv_sec) * 1000L
+		  + (stop.tv_usec - start.tv_usec) / 1000;
+		if (st.wall < 0)
+			/* the clock was set back */
+			st.wall = 0;
+		print_stats(&st);
+
+		if (st.status >= 0) {
+			code = st.status;
 			if (code == 0) {
 				failed = 0;
 				fputs("\nCommand successful. ",stdout);
@@ -301,7 +579,7 @@ execute(const char *command, FLAG prompt_user)
 				printf("\nExit code = %d. ",code);
 		}
 		else {
-			code = WTERMSIG(status);
+			code = -st.status;
 			printf("\nAbnormal termination, signal %d",code);
 #ifdef HAVE_STRSIGNAL
 			signame = strsignal(code);
@@ -315,10 +593,8 @@ execute(const char *command, FLAG prompt_user)
 #endif
 #endif
 
-#ifdef WCOREDUMP
-			if (WCOREDUMP(status))
+			if (core)
 				fputs(", core image dumped",stdout);
-#endif
 			putchar('\n');
 		}
 	}
@@ -330,12 +606,14 @@ execute(const char *command, FLAG prompt_user)
 	 * list_directory() must check if curses mode is active.
 	 */
 	xterm_title_set(0,title);
-	list_directory();
-	ppanel_file->other->expired = 1;
+	list_refresh();
+	ppanel_file->other->outdated = 1;
 
 	if (prompt_user || failed) tty_press_enter();
 	xterm_title_set(0,0);
 
+	if (stats)
+		*stats = st;
 	return failed;
 }
 
@@ -374,7 +652,7 @@ test_word(const char *line, const char *word)
  *   1 = only mandatory warning(s)
  *   2 = configurable warning(s)
  */
-static int
+int
 print_warnings(const char *cmd)
 {
 	static USTRING cwd = { 0,0 };
@@ -420,6 +698,62 @@ print_warnings(const char *cmd)
 	return warn;
 }
 
+/*
+ * the warnings of print_warnings() for a background job, they are
+ * displayed on the information line instead of in the text mode
+ *
+ * return value: 1 = start the job, 0 = cancelled by the user
+ */
+static int
+background_confirm(const char *cmd)
+{
+	static USTRING cwd = { 0,0 };
+
+	if (get_cwd_us(&cwd) < 0) {
+		if (!win_question("Current working directory is not accessible,"
+		  " start the job ?"))
+			return 0;
+	}
+	else if (strcmp(USTR(ppanel_file->dir),USTR(cwd))) {
+		us_copy(&ppanel_file->dir,USTR(cwd));
+		win_heading();
+		if (!win_question("Current working directory has been renamed,"
+		  " start the job ?"))
+			return 0;
+	}
+
+	if (config_num(CFG_WARN_RM) && test_word(cmd,"rm ")
+	  && !win_question("The rm command deletes files, start the job ?"))
+		return 0;
+
+	if (get_current_mode() == MODE_FILE
+	  && config_num(CFG_WARN_LONG) && edit_islong()
+	  && !win_question("This long command did not fit to the command line,"
+	  " start the job ?"))
+		return 0;
+
+	return 1;
+}
+
+/*
+ * return the length of the command without the trailing '&' if
+ * the command is to be run in the background, otherwise 0
+ */
+static size_t
+check_background(const char *cmd)
+{
+	size_t len;
+
+	for (len = strlen(cmd); len > 0 && cmd[len - 1] == ' '; len--)
+		;
+	if (len < 2 || cmd[len - 1] != '&' || cmd[len - 2] == '&'
+	  || cmd[len - 2] == '\\' || cmd[len - 2] == '>' || cmd[len - 2] == '|')
+		return 0;
+	for (len--; len > 0 && cmd[len - 1] == ' '; len--)
+		;
+	return len;
+}
+
 static const char *
 check_cd(const char *str)
 {
@@ -487,9 +821,11 @@ execute_cmd(const char *cmd, FLAG prompt_user)
 {
 	static FLAG hint = 1;
 	int do_exec, warn_level, i;
+	size_t len;
 	const char *dir, *s1, *s2;
 	char *mod_cmd = NULL, *go_filename = NULL;
-	FLAG wcd = 0, br = 0;
+	FLAG wcd = 0, br = 0, failed;
+	CMD_STATS stats;
 	FILE *go_file;
 	char line_buff[1024];
 	int fd;
@@ -498,13 +834,21 @@ execute_cmd(const char *cmd, FLAG prompt_user)
 	if ( (dir = check_cd(cmd)) ) {
 		if (changedir(dir) != 0)
 			return 0;
-		hist_save(cmd,0);
+		hist_save(cmd,0,0);
 		win_heading();
 		win_panel();
 		win_remark("directory changed");
 		return 1;
 	}
 
+	/* command& runs in the background */
+	if ( (len = check_background(cmd)) ) {
+		if (!background_confirm(cmd) || job_start(cmd,len) < 0)
+			return 0;
+		hist_save(cmd,0,0);
+		return 1;
+	}
+
 	/* intercept 'wcmd' command */
 	if (!strncmp(cmd,"wcd ",3)) {
 		mod_cmd = emalloc(strlen(cmd)+6);
@@ -592,8 +936,10 @@ execute_cmd(const char *cmd, FLAG prompt_user)
 
 	warn_level = print_warnings(cmd);
 	do_exec = warn_level == 0 || user_confirm();
-	if (do_exec)
-		hist_save(cmd,execute(cmd,prompt_user) != 0);
+	if (do_exec) {
+		failed = execute(cmd,prompt_user,&stats);
+		hist_save(cmd,failed,&stats);
+	}
 
 	if (wcd || br) {
 		go_file = fopen(go_filename, "r");
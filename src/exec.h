@@ -3,8 +3,10 @@ extern void exec_shell_reconfig(void);
 extern void exec_prompt_reconfig(void);
 extern void exec_nplist_reconfig(void);
 extern void template_aliases_reconfig(void);
-extern int execute(const char *command, FLAG prompt_user);
+extern int execute(const char *command, FLAG prompt_user, CMD_STATS *);
+extern pid_t exec_background(const char *, int);
 extern int execute_cmd(const char *, FLAG prompt_user);
+extern int print_warnings(const char *);
 
 /* values for prompt_user argument in execute_cmd()  */
 #define DONOT_PROMPT_USER 0
@@ -0,0 +1,1176 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2006 Vlado Potisk <vlado_potisk@clex.sk>
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from http://www.clex.sk
+ *
+ */
+
+/*
+ * Built-in file operations: the selected files are copied or moved
+ * from the current working directory to the secondary working
+ * directory or deleted without starting external commands.
+ *
+ * Every file or directory is one task of the worker pool (see
+ * workers.c), a directory task creates the target directory and
+ * adds its entries as new tasks, so many small files are copied
+ * concurrently. File data is copied by the kernel where possible:
+ * reflink (FICLONE), copy_file_range(), sendfile() and large
+ * read()/write() as the last resort.
+ *
+ * Existing files are never overwritten. Directory attributes are
+ * set after all files are copied, otherwise the modification time
+ * would change and a read-only directory could not be filled.
+ *
+ * The task functions run on worker threads, they must not call
+ * emalloc() and other non thread-safe functions.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>	/* clex.h */
+#include <sys/stat.h>	/* lstat() */
+#include <errno.h>		/* errno */
+#include <fcntl.h>		/* open() */
+#include <stdio.h>		/* sprintf() */
+#include <stdlib.h>		/* malloc() */
+#include <string.h>		/* strcmp() */
+#include <unistd.h>		/* read() */
+
+/* readdir() */
+#ifdef HAVE_DIRENT_H
+# include <dirent.h>
+#else
+# define dirent direct
+# ifdef HAVE_SYS_NDIR_H
+#  include <sys/ndir.h>
+# endif
+# ifdef HAVE_SYS_DIR_H
+#  include <sys/dir.h>
+# endif
+# ifdef HAVE_NDIR_H
+#  include <ndir.h>
+# endif
+#endif
+
+/* gettimeofday() */
+#if TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# if HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+
+/* FICLONE */
+#if defined(HAVE_LINUX_FS_H) && defined(HAVE_SYS_IOCTL_H)
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
+
+/* sendfile() */
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE)
+# include <sys/sendfile.h>
+# define USE_SENDFILE
+#endif
+
+/* unlinkat(), openat() */
+#if defined(HAVE_UNLINKAT) && defined(HAVE_FSTATAT) && defined(HAVE_OPENAT) \
+  && defined(HAVE_FDOPENDIR)
+# define USE_UNLINKAT
+#endif
+
+/* file times with nanoseconds */
+#if defined(HAVE_FUTIMENS) && defined(HAVE_UTIMENSAT) \
+  && defined(HAVE_STRUCT_STAT_ST_MTIM)
+# define USE_UTIMENS
+#else
+# include <utime.h>		/* utime() */
+#endif
+
+#include "clex.h"
+#include "fileops.h"
+
+#include "inout.h"		/* win_remark() */
+#include "list.h"		/* list_refresh() */
+#include "panel.h"		/* pan_adjust() */
+#include "sdstring.h"	/* SDSTR() */
+#include "ustring.h"	/* USTR() */
+#include "util.h"		/* emalloc() */
+#include "workers.h"	/* work_run_tasks() */
+
+/* data are copied in chunks of this size (progress, cancel) */
+#define FO_CHUNK	(8 * 1024 * 1024)
+/* buffer size for read() and write() */
+#define FO_BUFFER	(1024 * 1024)
+
+/* a directory waiting for its attributes */
+typedef struct {
+	char *path;
+	struct stat st;
+} FO_DIR;
+
+/*
+ * a directory being deleted, it is removed when the 'pending'
+ * counter drops to zero, i.e. after its own scan and after
+ * all its subdirectories were removed
+ */
+typedef struct fo_node {
+	struct fo_node *parent;	/* 0 = top-level entry */
+	int pending;			/* own scan + subdirectories not removed */
+	int top;				/* index into 'names', -1 = not top-level */
+	int fd;					/* the open directory, -1 = not open */
+	FLAG failed;			/* something could not be removed */
+	const char *name;		/* the last component of the 'path' */
+	char path[1];			/* allocated as needed */
+} FO_NODE;
+
+/* results collected by one thread */
+typedef struct {
+	int files;				/* files copied or deleted */
+	long long bytes;		/* bytes copied */
+	int errors;				/* number of errors */
+	char *errpath;			/* the first error: relative pathname */
+	int errnum;				/*   and errno value */
+	FO_DIR *dir;			/* created directories */
+	int dircnt, diralloc;
+	FO_NODE **node;			/* directories being deleted */
+	int nodecnt, nodealloc;
+	FLAG nomem;				/* out of memory */
+} FO_RESULT;
+
+static FO_RESULT *result;
+static int result_cnt;
+static const char *src_root, *dst_root;
+static char **names;		/* the top-level entries */
+static int namecnt;
+
+/* join with a slash, malloc()-ed result */
+static char *
+fo_join(const char *dir, const char *name)
+{
+	size_t len;
+	char *path;
+
+	len = strlen(dir);
+	if ( (path = malloc(len + strlen(name) + 2)) == 0)
+		return 0;
+	strcpy(path,dir);
+	if (len && dir[len - 1] != '/')
+		path[len++] = '/';
+	strcpy(path + len,name);
+	return path;
+}
+
+static void
+fo_error(FO_RESULT *pr, const char *rel, int errnum)
+{
+	if (pr->errors++ == 0) {
+		pr->errpath = malloc(strlen(rel) + 1);
+		if (pr->errpath)
+			strcpy(pr->errpath,rel);
+		pr->errnum = errnum;
+	}
+}
+
+/* set owner, mode and times of the open file 'fd' */
+static void
+fo_attributes(int fd, const struct stat *pst)
+{
+#ifdef USE_UTIMENS
+	struct timespec ts[2];
+#endif
+
+	/* the owner can be preserved by root only, ignore errors */
+	if (fchown(fd,pst->st_uid,pst->st_gid) < 0)
+		;
+	fchmod(fd,pst->st_mode & 07777);
+#ifdef USE_UTIMENS
+	ts[0] = pst->st_atim;
+	ts[1] = pst->st_mtim;
+	futimens(fd,ts);
+#endif
+}
+
+/* set the times of 'path', symbolic links are not followed */
+static void
+fo_times(const char *path, const struct stat *pst)
+{
+#ifdef USE_UTIMENS
+	struct timespec ts[2];
+
+	ts[0] = pst->st_atim;
+	ts[1] = pst->st_mtim;
+	utimensat(AT_FDCWD,path,ts,AT_SYMLINK_NOFOLLOW);
+#else
+	struct utimbuf ut;
+
+	if (S_ISLNK(pst->st_mode))
+		return;
+	ut.actime = pst->st_atime;
+	ut.modtime = pst->st_mtime;
+	utime(path,&ut);
+#endif
+}
+
+/*
+ * copy the data from 'in' to 'out', the fastest method available
+ * is tried first; return value: 0 = ok, otherwise errno value
+ */
+static int
+fo_data(int in, int out, off_t size)
+{
+	ssize_t rd, wr, done;
+	off_t copied;
+	char *buff;
+	FLAG kernel;
+
+	if (size == 0)
+		return 0;
+
+#ifdef FICLONE
+	/* reflink: the copy shares the data blocks (btrfs, xfs) */
+	if (ioctl(out,FICLONE,in) == 0) {
+		work_add(size);
+		return 0;
+	}
+#endif
+
+	/*
+	 * the kernel methods fail at the start if not supported, some
+	 * filesystems (e.g. /proc) report EOF instead, data copied so
+	 * far is valid, the next method continues at the file position
+	 */
+	copied = 0;
+	kernel = 1;
+#ifdef HAVE_COPY_FILE_RANGE
+	for (; kernel; ) {
+		if (work_cancelled())
+			return EINTR;
+		if ( (rd = copy_file_range(in,0,out,0,FO_CHUNK,0)) == 0) {
+			if (copied)
+				return 0;
+			break;
+		}
+		if (rd > 0) {
+			copied += rd;
+			work_add(rd);
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+		if (errno != EXDEV && errno != EINVAL && errno != ENOSYS
+		  && errno != EOPNOTSUPP)
+			return errno;
+		kernel = 0;
+	}
+#endif
+
+#ifdef USE_SENDFILE
+	for (kernel = 1; kernel; ) {
+		if (work_cancelled())
+			return EINTR;
+		if ( (rd = sendfile(out,in,0,FO_CHUNK)) == 0) {
+			if (copied)
+				return 0;
+			break;
+		}
+		if (rd > 0) {
+			copied += rd;
+			work_add(rd);
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+		if (errno != EINVAL && errno != ENOSYS)
+			return errno;
+		kernel = 0;
+	}
+#endif
+
+	/* malloc() and not emalloc(), see above */
+	if ( (buff = malloc(FO_BUFFER)) == 0)
+		return ENOMEM;
+	for (;;) {
+		if (work_cancelled()) {
+			free(buff);
+			return EINTR;
+		}
+		if ( (rd = read(in,buff,FO_BUFFER)) == 0)
+			break;
+		if (rd < 0) {
+			if (errno == EINTR)
+				continue;
+			free(buff);
+			return errno;
+		}
+		for (done = 0; done < rd; done += wr)
+			if ( (wr = write(out,buff + done,rd - done)) < 0) {
+				if (errno == EINTR) {
+					wr = 0;
+					continue;
+				}
+				free(buff);
+				return errno;
+			}
+		work_add(rd);
+	}
+	free(buff);
+	return 0;
+}
+
+static void
+fo_file(FO_RESULT *pr, const char *rel, const char *src, const char *dst,
+  const struct stat *pst)
+{
+	int in, out, err;
+
+	if ( (in = open(src,O_RDONLY)) < 0) {
+		fo_error(pr,rel,errno);
+		return;
+	}
+	if ( (out = open(dst,O_WRONLY | O_CREAT | O_EXCL,0600)) < 0) {
+		fo_error(pr,rel,errno);
+		close(in);
+		return;
+	}
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise(in,0,0,POSIX_FADV_SEQUENTIAL);
+#endif
+	err = fo_data(in,out,pst->st_size);
+	if (err == 0) {
+		fo_attributes(out,pst);
+		pr->files++;
+		pr->bytes += pst->st_size;
+	}
+	close(in);
+	if (close(out) < 0 && err == 0)
+		err = errno;
+	if (err) {
+		unlink(dst);
+		if (err != EINTR)
+			fo_error(pr,rel,err);
+	}
+}
+
+static void
+fo_symlink(FO_RESULT *pr, const char *rel, const char *src, const char *dst,
+  const struct stat *pst)
+{
+	char *target;
+	ssize_t len;
+
+	if ( (target = malloc(pst->st_size + 1)) == 0) {
+		fo_error(pr,rel,ENOMEM);
+		return;
+	}
+	if ( (len = readlink(src,target,pst->st_size + 1)) < 0
+	  || len > pst->st_size) {
+		fo_error(pr,rel,len < 0 ? errno : ENAMETOOLONG);
+		free(target);
+		return;
+	}
+	target[len] = '\0';
+	if (symlink(target,dst) < 0)
+		fo_error(pr,rel,errno);
+	else {
+		if (lchown(dst,pst->st_uid,pst->st_gid) < 0)
+			;
+		fo_times(dst,pst);
+		pr->files++;
+	}
+	free(target);
+}
+
+/* create the target directory and add its entries as new tasks */
+static void
+fo_dir(int thr, FO_RESULT *pr, const char *rel, const char *src,
+  const char *dst, const struct stat *pst)
+{
+	int alloc;
+	char *path;
+	DIR *dd;
+	struct dirent *direntry;
+	FO_DIR *new;
+
+	if (mkdir(dst,0700) < 0) {
+		fo_error(pr,rel,errno);
+		return;
+	}
+	if (pr->dircnt == pr->diralloc) {
+		alloc = pr->diralloc ? 2 * pr->diralloc : 64;
+		if ( (new = realloc(pr->dir,alloc * sizeof(FO_DIR))) == 0) {
+			pr->nomem = 1;
+			return;
+		}
+		pr->dir = new;
+		pr->diralloc = alloc;
+	}
+	if ( (path = malloc(strlen(dst) + 1)) == 0) {
+		pr->nomem = 1;
+		return;
+	}
+	pr->dir[pr->dircnt].path = strcpy(path,dst);
+	pr->dir[pr->dircnt++].st = *pst;
+
+	if ( (dd = opendir(src)) == 0) {
+		fo_error(pr,rel,errno);
+		return;
+	}
+	while ( (direntry = readdir(dd)) && !work_cancelled()) {
+		if (direntry->d_name[0] == '.' && (direntry->d_name[1] == '\0'
+		  || (direntry->d_name[1] == '.' && direntry->d_name[2] == '\0')))
+			continue;
+		if ( (path = fo_join(rel,direntry->d_name)) == 0) {
+			pr->nomem = 1;
+			break;
+		}
+		work_push(thr,path);
+	}
+	closedir(dd);
+}
+
+/* worker pool task: copy 'rel' (relative to the roots) */
+static void
+fo_copy(void *task, int thr)
+{
+	int i;
+	char *rel, *src, *dst, *path;
+	struct stat st;
+	FO_RESULT *pr;
+
+	rel = task;
+	pr = result + thr;
+	if (*rel == '\0') {
+		/* the initial task: the top-level entries */
+		for (i = 0; i < namecnt; i++)
+			if ( (path = fo_join("",names[i])) == 0)
+				pr->nomem = 1;
+			else
+				work_push(thr,path);
+		free(rel);
+		return;
+	}
+
+	src = fo_join(src_root,rel);
+	dst = fo_join(dst_root,rel);
+	if (src == 0 || dst == 0)
+		pr->nomem = 1;
+	else if (lstat(src,&st) < 0)
+		fo_error(pr,rel,errno);
+	else if (S_ISREG(st.st_mode))
+		fo_file(pr,rel,src,dst,&st);
+	else if (S_ISDIR(st.st_mode))
+		fo_dir(thr,pr,rel,src,dst,&st);
+	else if (S_ISLNK(st.st_mode))
+		fo_symlink(pr,rel,src,dst,&st);
+	else if (mknod(dst,st.st_mode,st.st_rdev) < 0)
+		fo_error(pr,rel,errno);
+	else {
+		if (chown(dst,st.st_uid,st.st_gid) < 0)
+			;
+		fo_times(dst,&st);
+		pr->files++;
+	}
+	free(src);
+	free(dst);
+	free(rel);
+}
+
+/* remove a tree, return value: 0 = ok, otherwise errno value */
+static int
+fo_remove(const char *path)
+{
+	int i, err;
+	char *sub;
+	DIR *dd;
+	struct dirent *direntry;
+	struct stat st;
+
+	if (lstat(path,&st) < 0)
+		return errno;
+	if (!S_ISDIR(st.st_mode))
+		return unlink(path) < 0 ? errno : 0;
+
+	if ( (dd = opendir(path)) == 0)
+		return errno;
+	err = 0;
+	while ( (direntry = readdir(dd))) {
+		if (direntry->d_name[0] == '.' && (direntry->d_name[1] == '\0'
+		  || (direntry->d_name[1] == '.' && direntry->d_name[2] == '\0')))
+			continue;
+		sub = fo_join(path,direntry->d_name);
+		if (sub == 0)
+			err = ENOMEM;
+		else if ( (i = fo_remove(sub)) && err == 0)
+			err = i;
+		free(sub);
+	}
+	closedir(dd);
+	if (err)
+		return err;
+	return rmdir(path) < 0 ? errno : 0;
+}
+
+/* collect the names of the selected files */
+static int
+fo_names(const char *opname)
+{
+	int i;
+	FILE_ENTRY *pfe;
+
+	names = emalloc((ppanel_file->selected ? ppanel_file->selected : 1)
+	  * sizeof(char *));
+	namecnt = 0;
+	if (ppanel_file->selected) {
+		for (i = 0; i < ppanel_file->pd->cnt; i++)
+			if (ppanel_file->files[i]->select)
+				names[namecnt++] = SDSTR(ppanel_file->files[i]->file);
+	}
+	else if (ppanel_file->pd->cnt > 0) {
+		pfe = ppanel_file->files[ppanel_file->pd->curs];
+		if (!pfe->dotdir)
+			names[namecnt++] = SDSTR(pfe->file);
+	}
+	if (namecnt == 0) {
+		free(names);
+		win_remark_fmt("nothing to %s",opname);
+		return -1;
+	}
+	return 0;
+}
+
+static void
+fo_results(void)
+{
+	int i;
+
+	result_cnt = work_threads();
+	result = emalloc(result_cnt * sizeof(FO_RESULT));
+	for (i = 0; i < result_cnt; i++) {
+		result[i].files = result[i].errors = 0;
+		result[i].bytes = 0;
+		result[i].errpath = 0;
+		result[i].dir = 0;
+		result[i].dircnt = result[i].diralloc = 0;
+		result[i].node = 0;
+		result[i].nodecnt = result[i].nodealloc = 0;
+		result[i].nomem = 0;
+	}
+}
+
+/* check if the operation can be performed, collect the names */
+static int
+fo_prepare(const char *opname)
+{
+	int i, j;
+	size_t len;
+	const char *dir;
+
+	src_root = USTR(ppanel_file->dir);
+	dst_root = USTR(ppanel_file->other->dir);
+	if (strcmp(src_root,dst_root) == 0) {
+		win_remark("source and target directories are the same");
+		return -1;
+	}
+	if (fo_names(opname) < 0)
+		return -1;
+
+	/* a directory cannot be copied into itself */
+	len = strlen(src_root);
+	if (strncmp(dst_root,src_root,len) == 0
+	  && (len == 1 || dst_root[len] == '/')) {
+		dir = dst_root + len + (len > 1);
+		for (i = 0; i < namecnt; i++)
+			if (strncmp(dir,names[i],j = strlen(names[i])) == 0
+			  && (dir[j] == '\0' || dir[j] == '/')) {
+				win_remark_fmt("cannot %s '%s' into itself",
+				  opname,names[i]);
+				free(names);
+				return -1;
+			}
+	}
+
+	fo_results();
+	return 0;
+}
+
+/*
+ * run the copy job, set the directory attributes,
+ * return value: -1 = cancelled, otherwise the number of errors
+ */
+static int
+fo_run(int *files, long long *bytes, char **errpath, int *errnum)
+{
+	int i, j, cancelled, errors;
+	FLAG nomem;
+	FO_RESULT *pr;
+
+	win_waitmsg();
+	cancelled = work_run_tasks(fo_copy,estrdup(""));
+
+	*files = errors = 0;
+	*bytes = 0;
+	*errpath = 0;
+	for (nomem = 0, i = 0; i < result_cnt; i++) {
+		pr = result + i;
+		*files += pr->files;
+		*bytes += pr->bytes;
+		if (pr->errors && errors == 0) {
+			*errpath = pr->errpath;
+			*errnum = pr->errnum;
+		}
+		else
+			free(pr->errpath);
+		errors += pr->errors;
+		if (pr->nomem)
+			nomem = 1;
+		for (j = 0; j < pr->dircnt; j++) {
+			if (chown(pr->dir[j].path,pr->dir[j].st.st_uid,
+			  pr->dir[j].st.st_gid) < 0)
+				;
+			chmod(pr->dir[j].path,pr->dir[j].st.st_mode & 07777);
+			fo_times(pr->dir[j].path,&pr->dir[j].st);
+			free(pr->dir[j].path);
+		}
+		free(pr->dir);
+	}
+	free(result);
+	if (nomem) {
+		win_warning("FILE COPY: Out of memory, not all files were copied.");
+		errors++;
+	}
+	return cancelled ? -1 : errors;
+}
+
+static long
+fo_msec(const struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now,0);
+	return (now.tv_sec - start->tv_sec) * 1000L
+	  + (now.tv_usec - start->tv_usec) / 1000;
+}
+
+/* display the result */
+static void
+fo_report(const char *opname, int errors, int files, long long bytes,
+  long msec, char *errpath, int errnum)
+{
+	if (errors < 0)
+		win_remark_fmt("%s cancelled, %d files done",opname,files);
+	else if (errors)
+		win_warning_fmt("%s: %d error(s), the first one: %s: %s",
+		  opname,errors,errpath ? errpath : "?",strerror(errnum));
+	else if (msec > 0 && bytes >= 1000000)
+		win_remark_fmt("%s: %d files, %lld MB in %ld.%01ld s (%lld MB/s)",
+		  opname,files,bytes / 1000000,msec / 1000,msec % 1000 / 100,
+		  bytes / 1000 / msec);
+	else if (msec >= 1000)
+		win_remark_fmt("%s: %d files in %ld.%01ld s",
+		  opname,files,msec / 1000,msec % 1000 / 100);
+	else
+		win_remark_fmt("%s: %d files",opname,files);
+	free(errpath);
+}
+
+/* alt-Y: copy the selected files to the secondary directory */
+void
+cx_fileop_copy(void)
+{
+	int files, errors, errnum;
+	long long bytes;
+	char *errpath;
+	struct timeval start;
+
+	if (fo_prepare("copy") < 0)
+		return;
+	gettimeofday(&start,0);
+	errors = fo_run(&files,&bytes,&errpath,&errnum);
+	free(names);
+	ppanel_file->other->outdated = 1;
+	fo_report("copy",errors,files,bytes,fo_msec(&start),errpath,errnum);
+}
+
+/*
+ * alt-T: move the selected files to the secondary directory,
+ * files are renamed if possible, otherwise they are copied
+ * and removed if there was no error
+ */
+void
+cx_fileop_move(void)
+{
+	int i, cnt, files, errors, errnum, errnum2;
+	long long bytes;
+	char *errpath, *errpath2;
+	const char *name;
+	struct stat st;
+	struct timeval start;
+
+	if (fo_prepare("move") < 0)
+		return;
+	gettimeofday(&start,0);
+
+	/* rename() within a filesystem, collect the rest */
+	errors = files = errnum = 0;
+	bytes = 0;
+	errpath = 0;
+	for (cnt = i = 0; i < namecnt; i++) {
+		name = names[i];
+		pathname_set_directory(dst_root);
+		if (lstat(pathname_join(name),&st) == 0) {
+			/* rename() would replace it */
+			if (errors++ == 0) {
+				errpath = estrdup(name);
+				errnum = EEXIST;
+			}
+			continue;
+		}
+		if (rename(name,pathname_join(name)) == 0)
+			files++;
+		else if (errno == EXDEV)
+			names[cnt++] = (char *)name;
+		else if (errors++ == 0) {
+			errnum = errno;
+			errpath = estrdup(name);
+		}
+	}
+
+	namecnt = cnt;
+	if (namecnt) {
+		/* different filesystems: copy and remove */
+		i = fo_run(&cnt,&bytes,&errpath2,&errnum2);
+		files += cnt;
+		if (errpath == 0) {
+			errpath = errpath2;
+			errnum = errnum2;
+		}
+		else
+			free(errpath2);
+		if (i < 0)
+			errors = -1;
+		else if (i > 0)
+			/* keep all sources, the copies might be incomplete */
+			errors += i;
+		else
+			for (i = 0; i < namecnt; i++)
+				if ( (errnum2 = fo_remove(names[i])) && errors++ == 0) {
+					errpath = estrdup(names[i]);
+					errnum = errnum2;
+				}
+	}
+	else
+		free(result);
+	free(names);
+
+	list_refresh();
+	win_panel();
+	ppanel_file->other->outdated = 1;
+	fo_report("move",errors,files,bytes,fo_msec(&start),errpath,errnum);
+}
+
+/*
+ * Delete: the top-level entries and the contents of directories are
+ * unlinked by the tasks, every subdirectory is a new task. The last
+ * task finishing in a directory removes the directory itself and
+ * possibly also its parent (post-order).
+ *
+ * With unlinkat() every directory is opened and removed relative to
+ * the descriptor of its parent and symbolic links are not followed,
+ * a directory replaced by a symlink during the delete cannot redirect
+ * it outside of the deleted tree. The descriptor of a directory is
+ * kept open until all its subdirectories are removed.
+ */
+
+static volatile FLAG *gone;	/* top-level entry removed */
+static FLAG *shown;			/* top-level entry removed from the panel */
+static int root_fd;			/* the 'src_root' directory */
+
+#define FO_PARENTFD(PN)	((PN)->parent ? (PN)->parent->fd : root_fd)
+
+/* pathname relative to the 'src_root' for error messages */
+static const char *
+fo_rel(const char *path)
+{
+	size_t len;
+
+	len = strlen(src_root);
+	return strncmp(path,src_root,len) == 0 && path[len] == '/'
+	  ? path + len + 1 : path + len;
+}
+
+static FO_NODE *
+fo_node(FO_NODE *parent, const char *dir, const char *name)
+{
+	size_t len;
+	FO_NODE *pn;
+
+	len = strlen(dir);
+	if ( (pn = malloc(sizeof(FO_NODE) + len + strlen(name) + 1)) == 0)
+		return 0;
+	strcpy(pn->path,dir);
+	if (len && dir[len - 1] != '/')
+		pn->path[len++] = '/';
+	strcpy(pn->path + len,name);
+	pn->name = pn->path + len;
+	pn->parent = parent;
+	pn->pending = 1;
+	pn->top = -1;
+	pn->fd = -1;
+	pn->failed = 0;
+	return pn;
+}
+
+/*
+ * the node of a running task is referenced by its subdirectories,
+ * it is freed by the main thread after the job; nodes of tasks
+ * not started are freed by work_run_tasks()
+ */
+static int
+fo_keep(FO_RESULT *pr, FO_NODE *pn)
+{
+	int alloc;
+	FO_NODE **new;
+
+	if (pr->nodecnt == pr->nodealloc) {
+		alloc = pr->nodealloc ? 2 * pr->nodealloc : 64;
+		if ( (new = realloc(pr->node,alloc * sizeof(FO_NODE *))) == 0)
+			return -1;
+		pr->node = new;
+		pr->nodealloc = alloc;
+	}
+	pr->node[pr->nodecnt++] = pn;
+	return 0;
+}
+
+/*
+ * remove the non-directory 'name' in the directory 'dfd' ('dir'),
+ * return value: 0 = ok, -1 = it is a directory, otherwise errno value
+ */
+static int
+fo_unlink(int dfd, const char *dir, const char *name)
+{
+	int err;
+	struct stat st;
+#ifdef USE_UNLINKAT
+	/* no pathname lookup */
+	if (unlinkat(dfd,name,0) == 0)
+		return 0;
+	err = errno;
+	/* Linux: EISDIR, POSIX: EPERM */
+	if ((err == EISDIR || err == EPERM)
+	  && fstatat(dfd,name,&st,AT_SYMLINK_NOFOLLOW) == 0
+	  && S_ISDIR(st.st_mode))
+		return -1;
+#else
+	char *path;
+
+	if ( (path = fo_join(dir,name)) == 0)
+		return ENOMEM;
+	if (unlink(path) == 0) {
+		free(path);
+		return 0;
+	}
+	err = errno;
+	if ((err == EISDIR || err == EPERM)
+	  && lstat(path,&st) == 0 && S_ISDIR(st.st_mode))
+		err = -1;
+	free(path);
+#endif
+	return err;
+}
+
+/*
+ * open the directory 'pn' for reading, the descriptor stays
+ * in 'pn->fd' for removing the subdirectories later
+ */
+static DIR *
+fo_opendir(FO_NODE *pn)
+{
+#ifdef USE_UNLINKAT
+	int fd, err;
+	DIR *dd;
+
+	/* fails if the directory was replaced by a symlink */
+	if ( (pn->fd = openat(FO_PARENTFD(pn),pn->name,
+	  O_RDONLY | O_DIRECTORY | O_NOFOLLOW)) < 0)
+		return 0;
+	/* closedir() closes the descriptor it was given */
+	if ( (fd = dup(pn->fd)) < 0)
+		return 0;
+	if ( (dd = fdopendir(fd)) == 0) {
+		err = errno;
+		close(fd);
+		errno = err;
+	}
+	return dd;
+#else
+	return opendir(pn->path);
+#endif
+}
+
+/* remove the empty directory 'pn', return value: 0 = ok, -1 = error */
+static int
+fo_rmdir(FO_NODE *pn)
+{
+#ifdef USE_UNLINKAT
+	return unlinkat(FO_PARENTFD(pn),pn->name,AT_REMOVEDIR);
+#else
+	return rmdir(pn->path);
+#endif
+}
+
+/* one pending task of the directory 'pn' has finished */
+static void
+fo_finished(FO_RESULT *pr, FO_NODE *pn)
+{
+	for (; pn && work_count(&pn->pending,-1) == 0; pn = pn->parent) {
+		if (pn->fd >= 0) {
+			/* all subdirectories are gone */
+			close(pn->fd);
+			pn->fd = -1;
+		}
+		if (!pn->failed) {
+			if (fo_rmdir(pn) == 0) {
+				pr->files++;
+				work_done(1);
+				if (pn->top >= 0)
+					gone[pn->top] = 1;
+			}
+			else {
+				fo_error(pr,fo_rel(pn->path),errno);
+				pn->failed = 1;
+			}
+		}
+		/* the parent cannot be removed either */
+		if (pn->failed && pn->parent)
+			pn->parent->failed = 1;
+	}
+}
+
+/* worker pool task: delete the contents of the directory 'task' */
+static void
+fo_delete(void *task, int thr)
+{
+	int i, err, cnt;
+	char *path;
+	FO_NODE *pn, *sub;
+	FO_RESULT *pr;
+	DIR *dd;
+	struct dirent *direntry;
+	const char *name;
+
+	pn = task;
+	pr = result + thr;
+
+	if (pn->path[0] == '\0') {
+		/* the initial task: the top-level entries */
+		free(pn);
+#ifdef USE_UNLINKAT
+		if ( (root_fd = open(src_root,O_RDONLY | O_DIRECTORY)) < 0) {
+			fo_error(pr,".",errno);
+			return;
+		}
+#endif
+		for (i = 0; i < namecnt && !work_cancelled(); i++) {
+			if ( (err = fo_unlink(root_fd,src_root,names[i])) == 0) {
+				gone[i] = 1;
+				pr->files++;
+				work_done(1);
+			}
+			else if (err > 0)
+				fo_error(pr,names[i],err);
+			else if ( (sub = fo_node(0,src_root,names[i])) == 0)
+				pr->nomem = 1;
+			else {
+				sub->top = i;
+				work_push(thr,sub);
+			}
+		}
+		return;
+	}
+
+	if (fo_keep(pr,pn) < 0)
+		/* cannot be freed, there may be subdirectories */
+		pr->nomem = 1;
+	if ( (dd = fo_opendir(pn)) == 0) {
+		fo_error(pr,fo_rel(pn->path),errno);
+		pn->failed = 1;
+		fo_finished(pr,pn);
+		return;
+	}
+	cnt = 0;
+	while ( (direntry = readdir(dd)) && !work_cancelled()) {
+		name = direntry->d_name;
+		if (name[0] == '.' && (name[1] == '\0'
+		  || (name[1] == '.' && name[2] == '\0')))
+			continue;
+		if ( (err = fo_unlink(pn->fd,pn->path,name)) == 0)
+			cnt++;
+		else if (err > 0) {
+			if ( (path = fo_join(fo_rel(pn->path),name)) == 0)
+				pr->nomem = 1;
+			else {
+				fo_error(pr,path,err);
+				free(path);
+			}
+			pn->failed = 1;
+		}
+		else if ( (sub = fo_node(pn,pn->path,name)) == 0) {
+			pr->nomem = 1;
+			pn->failed = 1;
+		}
+		else {
+			work_count(&pn->pending,1);
+			work_push(thr,sub);
+		}
+	}
+	closedir(dd);
+	pr->files += cnt;
+	work_done(cnt);
+	if (!work_cancelled())
+		fo_finished(pr,pn);
+}
+
+/*
+ * main thread: remove the deleted top-level entries from the panel,
+ * the order of the remaining entries is preserved
+ */
+static void
+fo_delete_monitor(void)
+{
+	int i, j, k, cnt, curs, removed;
+	FILE_ENTRY *pfe, **tmp;
+
+	for (removed = i = 0; i < namecnt; i++)
+		if (gone[i] && !shown[i])
+			removed++;
+	/* the filter keeps a second list in the same array */
+	if (removed == 0 || ppanel_file->pd->filtering)
+		return;
+
+	cnt = ppanel_file->pd->cnt;
+	curs = ppanel_file->pd->curs;
+	tmp = emalloc(removed * sizeof(FILE_ENTRY *));
+	/* 'names' are in the same order as the entries in the panel */
+	for (i = j = k = removed = 0; i < cnt; i++) {
+		pfe = ppanel_file->files[i];
+		while (k < namecnt && shown[k])
+			k++;
+		if (k < namecnt && SDSTR(pfe->file) == names[k]) {
+			if (gone[k]) {
+				shown[k] = 1;
+				if (pfe->select) {
+					pfe->select = 0;
+					ppanel_file->selected--;
+				}
+				if (i < ppanel_file->pd->curs)
+					curs--;
+				tmp[removed++] = pfe;
+				k++;
+				continue;
+			}
+			k++;
+		}
+		ppanel_file->files[j++] = pfe;
+	}
+	/* keep the entries allocated for the next directory read */
+	for (i = 0; i < removed; i++)
+		ppanel_file->files[j + i] = tmp[i];
+	free(tmp);
+	ppanel_file->pd->cnt = j;
+	ppanel_file->pd->curs = curs;
+	pan_adjust(ppanel_file->pd);
+	win_panel();
+}
+
+/*
+ * alt-E: delete the selected files, the panel is updated while
+ * the files are being deleted
+ */
+void
+cx_fileop_delete(void)
+{
+	int i, j, files, errors, errnum, cancelled;
+	FLAG nomem;
+	char *errpath, msg[80];
+	struct timeval start;
+	FO_NODE *root;
+	FO_RESULT *pr;
+
+	src_root = USTR(ppanel_file->dir);
+	if (fo_names("delete") < 0)
+		return;
+	if (namecnt == 1)
+		sprintf(msg,"Delete '%.40s' permanently ?",names[0]);
+	else
+		sprintf(msg,"Delete %d selected files permanently ?",namecnt);
+	if (!win_question(msg)) {
+		free(names);
+		return;
+	}
+
+	fo_results();
+	gone = emalloc(namecnt * sizeof(FLAG));
+	shown = emalloc(namecnt * sizeof(FLAG));
+	for (i = 0; i < namecnt; i++)
+		gone[i] = shown[i] = 0;
+	root = emalloc(sizeof(FO_NODE));
+	root->path[0] = '\0';
+	root_fd = -1;
+
+	gettimeofday(&start,0);
+	win_waitmsg();
+	work_monitor(fo_delete_monitor);
+	cancelled = work_run_tasks(fo_delete,root);
+	if (root_fd >= 0)
+		close(root_fd);
+
+	files = errors = errnum = 0;
+	errpath = 0;
+	for (nomem = 0, i = 0; i < result_cnt; i++) {
+		pr = result + i;
+		files += pr->files;
+		if (pr->errors && errors == 0) {
+			errpath = pr->errpath;
+			errnum = pr->errnum;
+		}
+		else
+			free(pr->errpath);
+		errors += pr->errors;
+		if (pr->nomem)
+			nomem = 1;
+		for (j = 0; j < pr->nodecnt; j++) {
+			/* left open by a cancel */
+			if (pr->node[j]->fd >= 0)
+				close(pr->node[j]->fd);
+			free(pr->node[j]);
+		}
+		free(pr->node);
+	}
+	free(result);
+	free((void *)gone);
+	free(shown);
+	free(names);
+	if (nomem) {
+		win_warning("FILE DELETE: Out of memory, "
+		  "not all files were deleted.");
+		errors++;
+	}
+
+	list_refresh();
+	win_panel();
+	ppanel_file->other->outdated = 1;
+	fo_report("delete",cancelled ? -1 : errors,files,0,
+	  fo_msec(&start),errpath,errnum);
+}
@@ -0,0 +1,3 @@
+extern void cx_fileop_copy(void);
+extern void cx_fileop_move(void);
+extern void cx_fileop_delete(void);
@@ -60,6 +60,7 @@ files_initialize(void)
 			dir2 = USTR(panel_f1.dir);
 	}
 	us_copy(&panel_f2.dir,dir2);
+	panel_f1.watch = panel_f2.watch = -1;
 	panel_f1.other = &panel_f2;
 	ppanel_file = panel_f2.other = &panel_f1;
 }
@@ -275,6 +276,8 @@ cx_files_exchange(void)
 	else if (ppanel_file->expired)
 		list_directory();
 		/* list_directory() invokes filepos_save() */
+	else if (ppanel_file->outdated)
+		list_refresh();
 	else
 		/* put the new cwd to the top of the list */
 		filepos_save();
@@ -288,7 +291,7 @@ void
 cx_launch_file_viewer(void)
 {
 	edit_macro(config_str(CFG_VIEWER_CMD));
-	execute(USTR(textline->line),DONOT_PROMPT_USER);
+	execute(USTR(textline->line),DONOT_PROMPT_USER,0);
 	curses_restart();
 	cx_edit_kill();	undo_reset();
 }
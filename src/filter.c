@@ -22,6 +22,7 @@
 #include "directory.h"		/* dir_main_panel() */
 #include "history.h"		/* hist_panel() */
 #include "inout.h"			/* win_edit() */
+#include "latency.h"		/* lat_begin() */
 #include "match.h" 			/* match() */
 #include "panel.h" 			/* pan_adjust() */
 #include "sdstring.h"		/* SDSTR() */
@@ -236,6 +237,9 @@ filter_update_dir(void)
 void
 filter_update(void)
 {
+	long long start;
+
+	start = lat_begin();
 	switch (panel->type) {
 	case PANEL_TYPE_DIR:
 		filter_update_dir();
@@ -256,6 +260,7 @@ filter_update(void)
 	panel->filter->changed = 0;
 	pan_adjust(panel);
 	win_panel();
+	lat_end(LAT_FILTER,start);
 }
 
 /* * * filter_on, filter_off functions * * */
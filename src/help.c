@@ -387,6 +387,7 @@ help_prepare(void)
 		page = "config";
 		break;
 	case MODE_COMPARE:
+	case MODE_TREECMP:
 		page = "compare";
 		break;
 	case MODE_COMPL:
@@ -401,8 +402,16 @@ help_prepare(void)
 		break;
 	/* there is no case MODE_HELP: */
 	case MODE_HIST:
+	case MODE_HIST_SEARCH:
 		page = "history";
 		break;
+	case MODE_JOBS:
+	case MODE_JOBS_OUT:
+		page = "jobs";
+		break;
+	case MODE_LATENCY:
+		page = "latency";
+		break;
 	case MODE_MAINMENU:
 		page = "menu";
 		break;
@@ -15,8 +15,18 @@
 #include <config.h>
 
 #include <sys/types.h>		/* clex.h */
-#include <stdlib.h>			/* free() */
+#include <sys/stat.h>		/* fstat() */
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+# include <sys/mman.h>		/* mmap() */
+# define USE_MMAP
+#endif
+#include <ctype.h>			/* isdigit() */
+#include <errno.h>			/* errno */
+#include <fcntl.h>			/* open() */
+#include <stdio.h>			/* sprintf() */
+#include <stdlib.h>			/* qsort() */
 #include <string.h>			/* strcmp() */
+#include <unistd.h>			/* write() */
 
 #include "clex.h"
 #include "history.h"
@@ -28,44 +38,794 @@
 #include "util.h"			/* emalloc() */
 #include "ustring.h"		/* us_copy() */
 
-static HIST_ENTRY **history;/* command line history */
-static int hs_alloc = 0;	/* number of allocated entries */
-static int hs_cnt;			/* entries in use */
-static int pn_index;		/* index for previous/next cmd */
+/*
+ * The history entries are kept in a doubly linked list ordered from
+ * the most recent to the oldest one. A hash table indexed by the
+ * command string makes the duplicate check in hist_save() fast and
+ * moving an entry to the top or deleting it takes a constant time,
+ * the history size does not really matter.
+ */
+
+/* entries are allocated in blocks of HIST_ALLOC_UNIT */
+#define HIST_ALLOC_UNIT		256
+/* initial size of the hash table (must be a power of two) */
+#define HIST_HASH_INIT		64
+/* the history panel array is enlarged in steps of HP_ALLOC_UNIT */
+#define HP_ALLOC_UNIT		256
+/* stats with a longer execution time (in hours) are rejected */
+#define HIST_WALL_MAX		100000
+
+typedef struct hist_node {
+	HIST_ENTRY he;			/* must be the first member */
+	unsigned int hash;		/* hash_str(he.cmd) */
+	unsigned int seq;		/* search index sequence number */
+	struct hist_node *prev, *next;	/* list links, 'next' is older */
+	struct hist_node *hnext;	/* hash chain link */
+} HIST_NODE;
+
+static HIST_NODE *hs_first = 0;	/* the most recent command */
+static HIST_NODE *hs_last = 0;	/* the oldest command */
+static HIST_NODE *hs_free = 0;	/* list of unused entries */
+static HIST_NODE **hs_hash;		/* hash table */
+static unsigned int hashsize = 0;	/* size of the 'hs_hash' table */
+static int hs_alloc = 0;	/* max number of entries (H_PANEL_SIZE) */
+static int hs_cnt = 0;		/* entries in use */
+static int hp_alloc = 0;	/* size of the history panel array */
+static HIST_NODE *pn_entry;	/* entry for previous/next cmd, 0 = none */
 static USTRING save_line = { 0,0 };
 						/* for temporary saving of the command line */
 
-void
-hist_reconfig(void)
+/*
+ * The history search uses an inverted index of trigrams (all substrings
+ * of length 3). Each trigram has a posting list of sequence numbers
+ * of commands containing it. A command gets a new sequence number
+ * whenever it is put on the top of the history list, the posting lists
+ * are therefore sorted from the oldest to the most recent command.
+ * An entry removed from the list leaves stale numbers in the posting
+ * lists, these are recognized with the 'seqmap' table and removed
+ * when they make up a significant part of the list.
+ *
+ * To find commands containing a string, the shortest posting list
+ * of the string's trigrams is scanned backwards and each candidate is
+ * verified, the time depends on the number of hits and not on the
+ * history size. Strings shorter than a trigram are searched sequentially.
+ */
+
+/* trigrams are allocated in blocks of TG_ALLOC_UNIT */
+#define TG_ALLOC_UNIT		256
+/* initial size of the trigram hash table (must be a power of two) */
+#define TG_HASH_INIT		256
+/* posting lists are enlarged in steps of TG_POST_INIT, 2x, 4x, ... */
+#define TG_POST_INIT		4
+
+#define TRIGRAM_VAL(STR)	( (unsigned char)(STR)[0] << 16 \
+	| (unsigned char)(STR)[1] << 8 | (unsigned char)(STR)[2] )
+
+typedef struct trigram {
+	unsigned int val;		/* three characters (TRIGRAM_VAL) */
+	int cnt, alloc;			/* used and allocated entries in 'post' */
+	int stale;				/* estimated number of stale entries */
+	unsigned int *post;		/* posting list (sequence numbers) */
+	struct trigram *hnext;	/* hash chain link */
+} TRIGRAM;
+
+static TRIGRAM **tg_hash;		/* hash table */
+static unsigned int tg_hashsize = 0;	/* size of the 'tg_hash' table */
+static unsigned int tg_cnt = 0;	/* number of trigrams */
+static TRIGRAM *tg_free = 0;	/* unused trigrams */
+static HIST_NODE **seqmap = 0;	/* sequence number -> entry, 0 = stale */
+static unsigned int seq_alloc = 0;	/* size of the 'seqmap' */
+static unsigned int hs_seq = 0;	/* last used sequence number */
+
+static struct {
+	USTRING str;			/* string to search for */
+	size_t len;				/* its length */
+	FLAG prefix;			/* match at the beginning only */
+	TRIGRAM *ptg;			/* posting list to be scanned or 0 */
+	int idx;				/* posting list scan position */
+	HIST_NODE *pn;			/* sequential scan position */
+} search;
+
+/*
+ * The command history is preserved in the file ~/.clexhist which is
+ * an append-only log. Every hist_save() appends one record with a
+ * single write(), concurrent CLEX sessions may append to the same
+ * file. The record format is:
+ *     flags <tab> command <newline>
+ * where flags is 1 if the command failed, 0 otherwise, optionally
+ * followed by the execution statistics (see CMD_STATS):
+ *     flags wall user sys maxrss status <tab> command <newline>
+ * A command deleted from the history is recorded with flags 'D',
+ * older records of that command are then ignored.
+ *
+ * The log is mapped into memory and scanned backwards, the newest
+ * records become the history entries; their strings point directly
+ * into the mapped file (see USalloc in ustring.c), nothing is copied.
+ *
+ * When the log grows larger than twice the history size, it is
+ * compacted, i.e. replaced by a new file containing only the current
+ * history. The compacting holds a lock on the log and the appending
+ * waits for the lock and checks whether the file was not replaced
+ * meanwhile.
+ */
+
+/* log size limit if the file cannot be mapped into memory */
+#define HIST_FILESIZE_LIMIT	16000000
+
+static const char *user_hist_file = 0;	/* history log filename */
+static char *log_data = 0;		/* contents of the log */
+static size_t log_size;			/* size of the 'log_data' */
+static int log_records;			/* number of records in the log */
+static struct {
+	const char *cmd;			/* command deleted by a 'D' record */
+	unsigned int hash;			/* hash_str(cmd) */
+	int hnext;					/* hash chain link, -1 = end */
+} *del_list = 0;				/* 'D' records found by hist_load() */
+static int del_cnt, del_alloc = 0;
+static int *del_hash;			/* hash table of 'del_list' indices */
+static unsigned int del_hashsize = 0;	/* size of the 'del_hash' table */
+
+extern int errno;
+
+static void
+tg_rehash(void)
+{
+	unsigned int i, j;
+	TRIGRAM *ptg, *next, **old;
+
+	old = tg_hash;
+	j = tg_hashsize;
+	tg_hashsize = tg_hashsize ? 2 * tg_hashsize : TG_HASH_INIT;
+	tg_hash = emalloc(tg_hashsize * sizeof(TRIGRAM *));
+	for (i = 0; i < tg_hashsize; i++)
+		tg_hash[i] = 0;
+	while (j-- > 0)
+		for (ptg = old[j]; ptg; ptg = next) {
+			next = ptg->hnext;
+			i = hash_strn((char *)&ptg->val,sizeof(ptg->val))
+			  & (tg_hashsize - 1);
+			ptg->hnext = tg_hash[i];
+			tg_hash[i] = ptg;
+		}
+	if (old)
+		free(old);
+}
+
+/* find the trigram 'val', create it if it does not exist and 'create' is set */
+static TRIGRAM *
+tg_find(unsigned int val, int create)
 {
 	int i;
-	static HIST_ENTRY *storage;
+	TRIGRAM *ptg, **pph;
 
-	if (hs_alloc) {
-		free(storage);
-		free(history);
-		free(panel_hist.hist);
+	if (tg_hashsize) {
+		pph = tg_hash + (hash_strn((char *)&val,sizeof(val))
+		  & (tg_hashsize - 1));
+		for (ptg = *pph; ptg; ptg = ptg->hnext)
+			if (ptg->val == val)
+				return ptg;
 	}
+	if (!create)
+		return 0;
 
-	hs_alloc = config_num(CFG_H_SIZE);
-	storage = emalloc(hs_alloc * sizeof(HIST_ENTRY));
-	history = emalloc(hs_alloc * sizeof(HIST_ENTRY *));
-	panel_hist.hist = emalloc(hs_alloc * sizeof(HIST_ENTRY *));
-	for (i = 0; i < hs_alloc; i++) {
-		history[i] = storage + i;
-		US_INIT(history[i]->cmd);
+	if (tg_free == 0) {
+		ptg = emalloc(TG_ALLOC_UNIT * sizeof(TRIGRAM));
+		for (i = 0; i < TG_ALLOC_UNIT; i++) {
+			ptg[i].alloc = 0;
+			ptg[i].post = 0;
+			ptg[i].hnext = tg_free;
+			tg_free = ptg + i;
+		}
+	}
+	ptg = tg_free;
+	tg_free = ptg->hnext;
+
+	ptg->val = val;
+	ptg->cnt = ptg->stale = 0;
+	if (++tg_cnt > tg_hashsize)
+		tg_rehash();
+	pph = tg_hash + (hash_strn((char *)&val,sizeof(val)) & (tg_hashsize - 1));
+	ptg->hnext = *pph;
+	*pph = ptg;
+	return ptg;
+}
+
+/* remove stale entries from the posting list */
+static void
+tg_compact(TRIGRAM *ptg)
+{
+	int i, j;
+
+	for (i = j = 0; i < ptg->cnt; i++)
+		if (seqmap[ptg->post[i]])
+			ptg->post[j++] = ptg->post[i];
+	ptg->cnt = j;
+	ptg->stale = 0;
+}
+
+/* index the entry, it becomes the most recent one */
+static void
+hist_index_add(HIST_NODE *pn)
+{
+	const char *cmd;
+	TRIGRAM *ptg;
+
+	if (++hs_seq >= seq_alloc) {
+		seq_alloc = seq_alloc ? 2 * seq_alloc : 2 * HIST_ALLOC_UNIT;
+		seqmap = erealloc(seqmap,seq_alloc * sizeof(HIST_NODE *));
+	}
+	seqmap[pn->seq = hs_seq] = pn;
+
+	for (cmd = USTR(pn->he.cmd); cmd[0] && cmd[1] && cmd[2]; cmd++) {
+		ptg = tg_find(TRIGRAM_VAL(cmd),1);
+		/* a trigram occurring repeatedly in the command */
+		if (ptg->cnt && ptg->post[ptg->cnt - 1] == hs_seq)
+			continue;
+		if (ptg->cnt == ptg->alloc) {
+			ptg->alloc = ptg->alloc ? 2 * ptg->alloc : TG_POST_INIT;
+			ptg->post = erealloc(ptg->post,ptg->alloc * sizeof(unsigned int));
+		}
+		ptg->post[ptg->cnt++] = hs_seq;
+	}
+}
+
+/* invalidate the index entries of a removed entry */
+static void
+hist_index_del(HIST_NODE *pn)
+{
+	const char *cmd;
+	TRIGRAM *ptg;
+
+	seqmap[pn->seq] = 0;
+	for (cmd = USTR(pn->he.cmd); cmd[0] && cmd[1] && cmd[2]; cmd++)
+		if ( (ptg = tg_find(TRIGRAM_VAL(cmd),0)) && ++ptg->stale > ptg->cnt / 2)
+			tg_compact(ptg);
+}
+
+/* clear the index */
+static void
+hist_index_clear(void)
+{
+	unsigned int i;
+	TRIGRAM *ptg, *next;
+
+	for (i = 0; i < tg_hashsize; i++) {
+		for (ptg = tg_hash[i]; ptg; ptg = next) {
+			next = ptg->hnext;
+			ptg->hnext = tg_free;
+			tg_free = ptg;
+		}
+		tg_hash[i] = 0;
+	}
+	tg_cnt = 0;
+	hs_seq = 0;
+}
+
+static void
+hist_rehash(void)
+{
+	unsigned int i;
+	HIST_NODE *pn, **pph;
+
+	if (hashsize)
+		free(hs_hash);
+	hashsize = hashsize ? 2 * hashsize : HIST_HASH_INIT;
+	hs_hash = emalloc(hashsize * sizeof(HIST_NODE *));
+	for (i = 0; i < hashsize; i++)
+		hs_hash[i] = 0;
+	for (pn = hs_first; pn; pn = pn->next) {
+		pph = hs_hash + (pn->hash & (hashsize - 1));
+		pn->hnext = *pph;
+		*pph = pn;
 	}
+}
+
+static HIST_NODE *
+hist_find(const char *cmd, unsigned int hash)
+{
+	HIST_NODE *pn;
+
+	if (hashsize == 0)
+		return 0;
+	for (pn = hs_hash[hash & (hashsize - 1)]; pn; pn = pn->hnext)
+		if (pn->hash == hash && strcmp(USTR(pn->he.cmd),cmd) == 0)
+			return pn;
+	return 0;
+}
+
+/* get an unused entry, the caller must fill in the command and the hash */
+static HIST_NODE *
+hist_node_new(void)
+{
+	int i;
+	HIST_NODE *pn;
+
+	if (hs_free == 0) {
+		pn = emalloc(HIST_ALLOC_UNIT * sizeof(HIST_NODE));
+		for (i = 0; i < HIST_ALLOC_UNIT; i++) {
+			US_INIT(pn[i].he.cmd);
+			pn[i].next = hs_free;
+			hs_free = pn + i;
+		}
+	}
+	pn = hs_free;
+	hs_free = pn->next;
+	return pn;
+}
+
+/* insert the entry at the top (most recent) or at the bottom of the list */
+static void
+hist_insert(HIST_NODE *pn, int top)
+{
+	HIST_NODE **pph;
+
+	if (++hs_cnt > hashsize)
+		hist_rehash();
+	pph = hs_hash + (pn->hash & (hashsize - 1));
+	pn->hnext = *pph;
+	*pph = pn;
+
+	if (top) {
+		pn->prev = 0;
+		pn->next = hs_first;
+		if (hs_first)
+			hs_first->prev = pn;
+		else
+			hs_last = pn;
+		hs_first = pn;
+	}
+	else {
+		pn->next = 0;
+		pn->prev = hs_last;
+		if (hs_last)
+			hs_last->next = pn;
+		else
+			hs_first = pn;
+		hs_last = pn;
+	}
+}
 
+/* remove the entry from the list, the entry is not freed */
+static void
+hist_unlink(HIST_NODE *pn)
+{
+	HIST_NODE **pph;
+
+	hist_index_del(pn);
+	for (pph = hs_hash + (pn->hash & (hashsize - 1)); *pph != pn;
+	  pph = &(*pph)->hnext)
+		;
+	*pph = pn->hnext;
+
+	if (pn->prev)
+		pn->prev->next = pn->next;
+	else
+		hs_first = pn->next;
+	if (pn->next)
+		pn->next->prev = pn->prev;
+	else
+		hs_last = pn->prev;
+	hs_cnt--;
+}
+
+static void
+hist_node_free(HIST_NODE *pn)
+{
+	us_reset(&pn->he.cmd);
+	pn->next = hs_free;
+	hs_free = pn;
+}
+
+/* remove all entries */
+static void
+hist_clear(void)
+{
+	unsigned int i;
+	HIST_NODE *pn;
+
+	while ( (pn = hs_first) ) {
+		hs_first = pn->next;
+		hist_node_free(pn);
+	}
+	hs_last = 0;
 	hs_cnt = 0;
+	for (i = 0; i < hashsize; i++)
+		hs_hash[i] = 0;
+	hist_index_clear();
 	hist_reset_index();
 }
 
+static void
+hist_log_warning(const char *msg)
+{
+	static FLAG warned = 0;
+
+	/* do not repeat the same warning after every command */
+	if (!TSET(warned))
+		win_warning_fmt("HISTORY: %s \"%s\" (%s).",msg,user_hist_file,
+		  strerror(errno));
+}
+
+static void
+hist_log_free(void)
+{
+	if (log_data == 0)
+		return;
+#ifdef USE_MMAP
+	munmap(log_data,log_size);
+#else
+	free(log_data);
+#endif
+	log_data = 0;
+}
+
+/* open the log file for appending and lock it */
+static int
+hist_log_open(void)
+{
+	int fd;
+	struct flock lck;
+	struct stat st1, st2;
+
+	for (; /* until return */;) {
+		umask(clex_data.umask | 077);
+		fd = open(user_hist_file,O_RDWR | O_APPEND | O_CREAT,0600);
+		umask(clex_data.umask);
+		if (fd < 0)
+			return -1;
+
+		lck.l_type = F_WRLCK;
+		lck.l_whence = SEEK_SET;
+		lck.l_start = lck.l_len = 0;
+		while (fcntl(fd,F_SETLKW,&lck) < 0)
+			if (errno != EINTR)
+				/* locking not supported, continue without a lock */
+				return fd;
+
+		/* the log might have been compacted while we were waiting */
+		if (fstat(fd,&st1) == 0 && stat(user_hist_file,&st2) == 0
+		  && st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino)
+			return fd;
+		close(fd);
+	}
+}
+
+/* the flags field of a log record */
+static const char *
+flags_str(const HIST_ENTRY *pe)
+{
+	static char buff[80];
+	const CMD_STATS *ps;
+
+	ps = &pe->stats;
+	if (ps->valid)
+		sprintf(buff,"%d %ld %ld %ld %ld %d",pe->failed,
+		  ps->wall,ps->user,ps->sys,ps->maxrss,ps->status);
+	else
+		sprintf(buff,"%d",pe->failed);
+	return buff;
+}
+
+/* parse the flags field of a log record */
+static void
+record_flags(const char *rec, HIST_ENTRY *pe)
+{
+	CMD_STATS *ps;
+
+	ps = &pe->stats;
+	pe->failed = *rec == '1';
+	ps->valid = rec[1] == ' ' && sscanf(rec + 2,"%ld %ld %ld %ld %d",
+	  &ps->wall,&ps->user,&ps->sys,&ps->maxrss,&ps->status) == 5
+	  /* the file is shared with other sessions, do not trust it */
+	  && ps->wall >= 0 && ps->wall / 3600000 < HIST_WALL_MAX
+	  && ps->user >= 0 && ps->sys >= 0 && ps->maxrss >= 0;
+}
+
+/* forget all deleted commands */
+static void
+hist_del_clear(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < del_hashsize; i++)
+		del_hash[i] = -1;
+	del_cnt = 0;
+}
+
+static void
+hist_del_rehash(void)
+{
+	int i, *ph;
+
+	if (del_hashsize)
+		free(del_hash);
+	del_hashsize = del_hashsize ? 2 * del_hashsize : HIST_HASH_INIT;
+	del_hash = emalloc(del_hashsize * sizeof(int));
+	for (i = 0; i < del_hashsize; i++)
+		del_hash[i] = -1;
+	for (i = 0; i < del_cnt; i++) {
+		ph = del_hash + (del_list[i].hash & (del_hashsize - 1));
+		del_list[i].hnext = *ph;
+		*ph = i;
+	}
+}
+
+/* remember a command deleted by a 'D' record */
+static void
+hist_del_add(const char *cmd, unsigned int hash)
+{
+	int *ph;
+
+	if (del_cnt == del_alloc) {
+		del_alloc = del_alloc ? 2 * del_alloc : 16;
+		del_list = erealloc(del_list,del_alloc * sizeof(*del_list));
+	}
+	if (del_cnt >= del_hashsize)
+		hist_del_rehash();
+	ph = del_hash + (hash & (del_hashsize - 1));
+	del_list[del_cnt].cmd = cmd;
+	del_list[del_cnt].hash = hash;
+	del_list[del_cnt].hnext = *ph;
+	*ph = del_cnt++;
+}
+
+static int
+hist_del_find(const char *cmd, unsigned int hash)
+{
+	int i;
+
+	if (del_hashsize == 0)
+		return 0;
+	for (i = del_hash[hash & (del_hashsize - 1)]; i >= 0;
+	  i = del_list[i].hnext)
+		if (del_list[i].hash == hash && strcmp(del_list[i].cmd,cmd) == 0)
+			return 1;
+	return 0;
+}
+
+/*
+ * replace the history with the contents of the log
+ * 'fd' is an open log file or -1
+ */
+static void
+hist_load(int fd)
+{
+	FLAG myfd;
+	unsigned int hash;
+	struct stat st;
+	char *end, *rec, *cmd;
+	HIST_NODE *pn;
+
+	hist_clear();
+	log_records = 0;
+	hist_del_clear();
+	hist_log_free();
+
+	if ( (myfd = fd < 0) && (fd = open(user_hist_file,O_RDONLY)) < 0) {
+		if (errno != ENOENT)
+			hist_log_warning("Cannot open the history file");
+		return;
+	}
+	fstat(fd,&st);	/* cannot fail with valid descriptor */
+	log_size = st.st_size;
+	if (log_size > 0) {
+#ifdef USE_MMAP
+		log_data = mmap(0,log_size,PROT_READ | PROT_WRITE,MAP_PRIVATE,fd,0);
+		if (log_data == MAP_FAILED)
+			log_data = 0;
+#else
+		if (log_size <= HIST_FILESIZE_LIMIT) {
+			log_data = emalloc(log_size);
+			if (read_fd(fd,log_data,log_size) != log_size) {
+				free(log_data);
+				log_data = 0;
+			}
+		}
+		else
+			errno = EFBIG;
+#endif
+		if (log_data == 0)
+			hist_log_warning("Cannot read the history file");
+	}
+	if (myfd)
+		close(fd);
+	if (log_data == 0)
+		return;
+
+	/* an incomplete record at the end is ignored */
+	for (end = log_data + log_size; end > log_data && end[-1] != '\n'; end--)
+		;
+	for (; end > log_data; end = rec) {
+		for (rec = end - 1; rec > log_data && rec[-1] != '\n'; rec--)
+			;
+		log_records++;
+		if (hs_cnt == hs_alloc || (cmd = memchr(rec,'\t',end - rec)) == 0)
+			continue;
+		cmd++;
+		end[-1] = '\0';
+		/* avoid duplicates, the most recent record is valid */
+		hash = hash_str(cmd);
+		if (hist_find(cmd,hash) || hist_del_find(cmd,hash))
+			continue;
+		if (rec[0] == 'D' && rec[1] == '\t') {
+			hist_del_add(cmd,hash);
+			continue;
+		}
+		pn = hist_node_new();
+		pn->he.cmd.USstr = cmd;	/* not allocated */
+		pn->he.cmd.USalloc = 0;
+		record_flags(rec,&pn->he);
+		pn->hash = hash;
+		hist_insert(pn,0);
+	}
+
+	/* the most recent entry must get the highest sequence number */
+	for (pn = hs_last; pn; pn = pn->prev)
+		hist_index_add(pn);
+}
+
+/* rewrite the log with the current history */
+static void
+hist_compact(void)
+{
+	int fd;
+	FLAG errflag;
+	FILE *fp;
+	char *tmpname;
+	HIST_NODE *pn;
+
+	if ( (fd = hist_log_open()) < 0) {
+		hist_log_warning("Cannot open the history file");
+		return;
+	}
+	/* merge with the commands from concurrent sessions */
+	hist_load(fd);
+
+	tmpname = emalloc(strlen(user_hist_file) + 16);
+	sprintf(tmpname,"%s.%d",user_hist_file,(int)clex_data.pid);
+	umask(clex_data.umask | 077);
+	fp = fopen(tmpname,"w");
+	umask(clex_data.umask);
+	if (fp == 0)
+		hist_log_warning("Cannot create a new history file");
+	else {
+		for (pn = hs_last; pn; pn = pn->prev)
+			fprintf(fp,"%s\t%s\n",flags_str(&pn->he),USTR(pn->he.cmd));
+		errflag = ferror(fp) != 0;
+		if (fclose(fp) || errflag || rename(tmpname,user_hist_file) < 0) {
+			hist_log_warning("Cannot write the history file");
+			unlink(tmpname);
+		}
+		else
+			log_records = hs_cnt;
+	}
+	free(tmpname);
+	close(fd);
+}
+
+/* append one record to the log, the caller checks if it needs compacting */
+static void
+hist_log_append(const char *flags, const char *cmd)
+{
+	static USTRING rec = { 0,0 };
+	int fd;
+	size_t len;
+
+	/* commands containing a newline cannot be stored */
+	if (user_hist_file == 0 || strchr(cmd,'\n'))
+		return;
+
+	len = strlen(flags) + strlen(cmd) + 2;
+	us_setsize(&rec,len + 1);
+	sprintf(USTR(rec),"%s\t%s\n",flags,cmd);
+	if ( (fd = hist_log_open()) < 0) {
+		hist_log_warning("Cannot open the history file");
+		return;
+	}
+	if (write(fd,USTR(rec),len) != len)
+		hist_log_warning("Cannot write the history file");
+	close(fd);
+	log_records++;
+}
+
+static void
+hist_append(const HIST_ENTRY *pe)
+{
+	hist_log_append(flags_str(pe),USTR(pe->cmd));
+	if (log_records > 2 * hs_alloc)
+		hist_compact();
+}
+
+void
+hist_reconfig(void)
+{
+	hist_clear();
+	hs_alloc = config_num(CFG_H_SIZE);
+
+	if (user_hist_file == 0) {
+		pathname_set_directory(clex_data.homedir);
+		user_hist_file = estrdup(pathname_join(".clexhist"));
+	}
+	hist_load(-1);
+	if (log_records > 2 * hs_alloc)
+		hist_compact();
+}
+
+/*
+ * duration filter: the filter expression '>TIME' or '<TIME' selects
+ * commands that ran longer or shorter than TIME, it may be followed by
+ * a space and a text to search for; TIME is a number with an optional
+ * unit: ms, s (default), m, or h
+ *
+ * return value: the text to search for (with 'op' set to '<' or '>'),
+ * or 'filter' if it is not a duration filter (with 'op' set to 0)
+ */
+static const char *
+duration_filter(const char *filter, int *op, long *msec)
+{
+	const char *str;
+	long num;
+
+	*op = 0;
+	str = filter;
+	if ((*str != '<' && *str != '>') || !isdigit((unsigned char)str[1]))
+		return filter;
+	for (num = 0, str++; isdigit((unsigned char)*str); str++)
+		num = 10 * num + (*str - '0');
+	if (str[0] == 'm' && str[1] == 's')
+		str += 2;
+	else if (*str == 'm') {
+		num *= 60 * 1000;
+		str++;
+	}
+	else if (*str == 'h') {
+		num *= 60 * 60 * 1000;
+		str++;
+	}
+	else {
+		num *= 1000;
+		if (*str == 's')
+			str++;
+	}
+	if (*str != '\0' && *str != ' ')
+		return filter;
+
+	*op = *filter;
+	*msec = num;
+	while (*str == ' ')
+		str++;
+	return str;
+}
+
+/* sort by duration, entries without statistics at the end */
+static int
+qcmp_time(const void *e1, const void *e2)
+{
+	const HIST_NODE *pn1, *pn2;
+
+	pn1 = *(const HIST_NODE **)e1;
+	pn2 = *(const HIST_NODE **)e2;
+	if (pn1->he.stats.valid != pn2->he.stats.valid)
+		return pn1->he.stats.valid ? -1 : 1;
+	if (pn1->he.stats.valid && pn1->he.stats.wall != pn2->he.stats.wall)
+		return pn1->he.stats.wall > pn2->he.stats.wall ? -1 : 1;
+	/* the most recent first */
+	return pn1->seq > pn2->seq ? -1 : 1;
+}
+
 void
 hist_panel(void)
 {
-	int i, j;
+	int i, j, op;
+	long msec;
 	const char *filter;
-	HIST_ENTRY *curs;
+	HIST_ENTRY *curs, *pe;
+
+	if (hp_alloc < hs_cnt) {
+		hp_alloc = (1 + (hs_cnt - 1) / HP_ALLOC_UNIT) * HP_ALLOC_UNIT;
+		panel_hist.hist =
+		  erealloc(panel_hist.hist,hp_alloc * sizeof(HIST_ENTRY *));
+	}
 
 	if (VALID_CURSOR(panel_hist.pd))
 		curs = panel_hist.hist[panel_hist.pd->curs];
@@ -73,82 +833,175 @@ hist_panel(void)
 		curs = 0;
 		panel_hist.pd->curs = 0;
 	}
-	filter = panel_hist.pd->filtering ? panel_hist.pd->filter->line : 0;
-	for (i = j = 0; i < hs_cnt; i++) {
-		if (history[i] == curs)
-			panel_hist.pd->curs = j;
-		if (filter && !substring(USTR(history[i]->cmd),filter,0))
+	filter = panel_hist.pd->filtering ? panel_hist.pd->filter->line : "";
+	filter = duration_filter(filter,&op,&msec);
+	hist_search_init(filter,strlen(filter),0);
+	for (j = 0; (pe = hist_search_next()); ) {
+		if (op && !(pe->stats.valid
+		  && (op == '>' ? pe->stats.wall > msec : pe->stats.wall < msec)))
 			continue;
-		panel_hist.hist[j++] = history[i];
+		if (pe == curs)
+			panel_hist.pd->curs = j;
+		panel_hist.hist[j++] = pe;
 	}
 	panel_hist.pd->cnt = j;
+
+	if (panel_hist.bytime) {
+		qsort(panel_hist.hist,j,sizeof(HIST_ENTRY *),qcmp_time);
+		for (i = 0; i < j; i++)
+			if (panel_hist.hist[i] == curs) {
+				panel_hist.pd->curs = i;
+				break;
+			}
+	}
 }
 
 void
 hist_prepare(void)
 {
+	int i;
+
 	panel_hist.pd->filtering = 0;
 	hist_panel();
 	panel_hist.pd->top = panel_hist.pd->min;
-	panel_hist.pd->curs = pn_index > 0 ? pn_index : 0;
+	panel_hist.pd->curs = 0;
+	if (pn_entry)
+		for (i = 0; i < panel_hist.pd->cnt; i++)
+			if (panel_hist.hist[i] == &pn_entry->he) {
+				panel_hist.pd->curs = i;
+				break;
+			}
 
 	panel = panel_hist.pd;
 	textline = &line_cmd;
 }
 
-const HIST_ENTRY *
-get_history_entry(int i)
+/* history panel with the filter turned on, i.e. incremental search */
+void
+hist_search_prepare(void)
 {
-	return i < hs_cnt ? history[i] : 0;
+	hist_prepare();
+	panel_hist.pd->filtering = 1;
+	panel_hist.pd->filter->line[0] = '\0';
+	panel_hist.pd->filter->size = panel_hist.pd->filter->curs = 0;
+	panel_hist.pd->filter->changed = 0;
+}
+
+/*
+ * hist_search_init() starts a search for commands containing
+ * the string 'str' of length 'len' ('str' does not need to be null
+ * terminated) or beginning with it if 'prefix' is set, the matching
+ * entries are then returned by hist_search_next() from the most
+ * recent to the oldest one, the end is marked by a null ptr
+ */
+void
+hist_search_init(const char *str, size_t len, int prefix)
+{
+	int i;
+	TRIGRAM *ptg;
+
+	us_copyn(&search.str,str,len);
+	search.len = len;
+	search.prefix = prefix;
+	search.ptg = 0;
+	search.pn = 0;
+
+	if (len < 3) {
+		search.pn = hs_first;
+		return;
+	}
+	str = USTR(search.str);
+	for (i = 0; i + 3 <= len; i++) {
+		if ( (ptg = tg_find(TRIGRAM_VAL(str + i),0)) == 0) {
+			/* no match at all */
+			search.ptg = 0;
+			return;
+		}
+		if (search.ptg == 0 || ptg->cnt < search.ptg->cnt)
+			search.ptg = ptg;
+	}
+	search.idx = search.ptg->cnt;
+}
+
+static int
+search_match(const HIST_NODE *pn)
+{
+	return search.prefix
+	  ? strncmp(USTR(pn->he.cmd),USTR(search.str),search.len) == 0
+	  : substring(USTR(pn->he.cmd),USTR(search.str),0);
+}
+
+HIST_ENTRY *
+hist_search_next(void)
+{
+	HIST_NODE *pn;
+
+	if (search.ptg) {
+		while (search.idx > 0)
+			if ( (pn = seqmap[search.ptg->post[--search.idx]])
+			  && search_match(pn))
+				return &pn->he;
+		return 0;
+	}
+
+	while ( (pn = search.pn) ) {
+		search.pn = pn->next;
+		if (search_match(pn))
+			return &pn->he;
+	}
+	return 0;
 }
 
 void
 hist_reset_index(void)
 {
-	pn_index = -1;
+	pn_entry = 0;
 }
 
 /*
  * hist_save() puts the command 'cmd' on the top
- * of the command history list.
+ * of the command history list. 'stats' may be null.
  */
 void
-hist_save(const char *cmd, int failed)
+hist_save(const char *cmd, int failed, const CMD_STATS *stats)
 {
-	int i;
-	FLAG new;
-	HIST_ENTRY *x, *top;
+	unsigned int hash;
+	HIST_NODE *pn;
 
 	hist_reset_index();
 
-	new = 1;
-	for (top = history[0], i = 0; i < hs_alloc; i++) {
-		x = history[i];
-		history[i] = top;
-		top = x;
-		if (i == hs_cnt) {
-			hs_cnt++;
-			break;
-		}
-		if (strcmp(USTR(top->cmd),cmd) == 0) {
-			/* avoid duplicates */
-			new = 0;
-			break;
+	hash = hash_str(cmd);
+	if ( (pn = hist_find(cmd,hash)) )
+		/* avoid duplicates */
+		hist_unlink(pn);
+	else {
+		if (hs_cnt >= hs_alloc) {
+			/* the list is full, reuse the oldest entry */
+			pn = hs_last;
+			hist_unlink(pn);
 		}
+		else
+			pn = hist_node_new();
+		us_copy(&pn->he.cmd,cmd);
+		pn->hash = hash;
 	}
-	if (new)
-		us_copy(&top->cmd,cmd);
-	top->failed = failed;
-	
-	history[0] = top;
+	pn->he.failed = failed;
+	if (stats)
+		pn->he.stats = *stats;
+	else
+		pn->he.stats.valid = 0;
+	hist_insert(pn,1);
+	hist_index_add(pn);
+
+	hist_append(&pn->he);
 }
 
 /* file panel functions */
 
 static void
-warn_fail(int n)
+warn_fail(const HIST_NODE *pn)
 {
-	if (history[n]->failed)
+	if (pn->he.failed)
 		win_remark("this command failed last time");
 }
 
@@ -156,16 +1009,16 @@ warn_fail(int n)
 void
 cx_hist_next(void)
 {
-	if (pn_index == -1) {
+	if (pn_entry == 0) {
 		win_remark("top of the history list");
 		return;
 	}
 
-	if (pn_index-- == 0)
+	if ( (pn_entry = pn_entry->prev) == 0)
 		edit_putstr(USTR(save_line));
 	else {
-		edit_putstr(USTR(history[pn_index]->cmd));
-		warn_fail(pn_index);
+		edit_putstr(USTR(pn_entry->he.cmd));
+		warn_fail(pn_entry);
 	}
 }
 
@@ -173,15 +1026,18 @@ cx_hist_next(void)
 void
 cx_hist_prev(void)
 {
-	if (pn_index >= hs_cnt - 1) {
+	HIST_NODE *pn;
+
+	if ( (pn = pn_entry ? pn_entry->next : hs_first) == 0) {
 		win_remark("bottom of the history list");
 		return;
 	}
 
-	if (++pn_index == 0)
+	if (pn_entry == 0)
 		us_xchg(&save_line,&line_cmd.line);
-	edit_putstr(USTR(history[pn_index]->cmd));
-	warn_fail(pn_index);
+	pn_entry = pn;
+	edit_putstr(USTR(pn_entry->he.cmd));
+	warn_fail(pn_entry);
 }
 
 /* history panel functions */
@@ -201,27 +1057,32 @@ cx_hist_enter(void)
 	next_mode = MODE_SPECIAL_RETURN;
 }
 
+/* toggle the sort order: most recent first / longest first */
+void
+cx_hist_sort(void)
+{
+	panel_hist.bytime = !panel_hist.bytime;
+	hist_panel();
+	pan_adjust(panel_hist.pd);
+	win_panel();
+	win_remark(panel_hist.bytime ?
+	  "sorted by duration" : "sorted by time of execution");
+}
+
 void
 cx_hist_del(void)
 {
-	int i;
-	HIST_ENTRY *del;
-	FLAG move;
+	HIST_NODE *del;
 
-	del = panel_hist.hist[panel_hist.pd->curs];
-	hs_cnt--;
-	for (move = 0, i = 0; i < hs_cnt; i++) {
-		if (history[i] == del) {
-			if (pn_index > i)
-				pn_index--;
-			else if (pn_index == i)
-				hist_reset_index();
-			move = 1;
-		}
-		if (move)
-			history[i] = history[i + 1];
-	}
-	history[hs_cnt] = del;
+	del = (HIST_NODE *)panel_hist.hist[panel_hist.pd->curs];
+	if (del == pn_entry)
+		hist_reset_index();
+	/* the next hist_load() must not bring the command back */
+	hist_log_append("D",USTR(del->he.cmd));
+	hist_unlink(del);
+	hist_node_free(del);
+	if (log_records > 2 * hs_alloc)
+		hist_compact();
 	hist_panel();
 	pan_adjust(panel_hist.pd);
 	win_panel();
@@ -16,8 +16,23 @@
 
 #include <sys/types.h>	/* clex.h */
 #include <ctype.h>		/* iscntrl() */
+#include <poll.h>		/* poll() */
 #include <stdarg.h>		/* va_list */
+#include <stdlib.h>		/* free() */
 #include <string.h>		/* strcpy() */
+#include <unistd.h>		/* STDIN_FILENO */
+
+/* gettimeofday() */
+#if TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# if HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
 #ifdef HAVE_NCURSES_H
 # include <ncurses.h>	/* initscr() */
 #else
@@ -37,12 +52,15 @@
 #include "cfg.h"		/* config_num() */
 #include "control.h"	/* get_current_mode() */
 #include "edit.h"		/* edit_adjust() */
+#include "jobs.h"		/* jobs_update() */
+#include "latency.h"	/* lat_begin() */
 #include "panel.h"		/* pan_adjust() */
 #include "sdstring.h"	/* SDSTR() */
 #include "signals.h"	/* signal_initialize() */
 #include "tty.h"		/* tty_press_enter() */
 #include "userdata.h"	/* get_mylogin_at_host() */
 #include "ustring.h"	/* USTR() */
+#include "util.h"		/* duration_str() */
 
 #ifndef A_NORMAL
 # define A_NORMAL 0
@@ -69,12 +87,37 @@
 
 #define BLANK(X)	do { char_line(' ',X); } while (0)
 
-static const char
-	*layout_panel,		/* layout: file panel part */
-	*layout_line;		/* layout: info line part */
+/*
+ * compiled layout: literal text and fields with precomputed
+ * widths, see layout_compile()
+ */
+#define LAYOUT_END		0	/* end of the program */
+#define LAYOUT_TEXT		1	/* literal text */
+#define LAYOUT_FIXED	2	/* fixed text in a field ($$, $|, errors) */
+typedef struct {
+	int code;			/* LAYOUT_XXX or field: 'a', 'd', ... */
+	FLAG left_align;	/* field follows a non-space character */
+	int width;			/* field width or text length */
+	const char *text;	/* text, not null-terminated */
+} LAYOUT_OP;
+static LAYOUT_OP
+	*layout_panel = 0,	/* layout: file panel part */
+	*layout_line = 0;	/* layout: info line part */
+static char layout_fields[32];	/* fields used in the layout */
 static const char
 	*info_remark = 0,	/* this remark is in the information line */
-	*info_warnmsg = 0;	/* this warning is in the information line */
+	*info_warnmsg = 0,	/* this warning is in the information line */
+	*info_prompt;		/* text following the warning */
+
+/*
+ * frame skipping: while keys are arriving faster than they can
+ * be displayed (key repeat), cursor movements are not drawn and
+ * the screen is not refreshed, but at least every FRAME_MSEC
+ */
+#define FRAME_MSEC	100
+static struct timeval frame_time;	/* last screen refresh */
+static FLAG panel_deferred = 0;		/* cursor movement not drawn yet */
+static int deferred_curs;			/* cursor after the last movement */
 
 /* pos_xxx are used for win_position() control */
 static CODE pos_resize = 0;	/* --( COLSxLINES )-- window size */
@@ -90,11 +133,28 @@ static FLAG pos_panel = 0;	/* --< CURSOR/TOTAL >-- normal info */
 						 */ 
 static int prevkey = 0;			/* previously pressed key */
 static chtype attrr, attrb;		/* reverse and bold or substitutes */
+
+/*
+ * rendered file panel lines, line 'ln' is cached in the slot
+ * ln % rowcache_cnt; a cached line is valid if the entry has not
+ * changed and neither the layout nor the screen width has changed
+ */
+typedef struct {
+	const FILE_ENTRY *pfe;	/* cached entry or 0 */
+	unsigned int gen;		/* pfe->gen */
+	unsigned int layout;	/* layout_gen */
+	FLAG select;			/* pfe->select */
+	chtype *cell;			/* display.pancols + 1 cells */
+} ROW_CACHE;
+static ROW_CACHE *rowcache = 0;
+static int rowcache_cnt = 0;
+static unsigned int layout_gen = 0;
 static int framechar;			/* panel frame character
 								  (note that ACS_HLINE is an int) */
 
 static void win_info(void);		/* defined below */
 static void win_position(void);	/* defined below */
+static void draw_panel(int);		/* defined below */
 
 
 static char type_symbol[][5] = {
@@ -102,6 +162,25 @@ static char type_symbol[][5] = {
 	"Bdev", "Cdev", "FIFO", "sock", "spec", "  ??"
 };	/* must correspond with  FT_XXX */
 
+/* new screen size, all cached lines are invalid */
+static void
+rowcache_alloc(void)
+{
+	int i;
+
+	for (i = 0; i < rowcache_cnt; i++)
+		free(rowcache[i].cell);
+	free(rowcache);
+	/* two screens: page down and page up again is a cache hit */
+	rowcache_cnt = 2 * display.panlines;
+	rowcache = emalloc(rowcache_cnt * sizeof(ROW_CACHE));
+	for (i = 0; i < rowcache_cnt; i++) {
+		rowcache[i].pfe = 0;
+		rowcache[i].cell = emalloc((display.pancols + 1) * sizeof(chtype));
+	}
+	layout_gen++;
+}
+
 /* draw everything from scratch */
 static void
 screen_draw_all(void)
@@ -122,8 +201,10 @@ screen_draw_all(void)
 		 * '>' continuation mark
 		 */
 		display.textline_area = x * config_num(CFG_CMD_LINES) - 2;
-		if (x >= MIN_COLS && y >= MIN_LINES)
+		if (x >= MIN_COLS && y >= MIN_LINES) {
+			rowcache_alloc();
 			break;
+		}
 		/* window too small */
 		printw("SCREEN: this window %d x %d is too small, "
 		  "required is " STR(MIN_LINES) " x " STR(MIN_COLS)
@@ -164,6 +245,7 @@ curses_initialize(void)
 	nonl();
 	noecho();
 	keypad(stdscr,TRUE);
+	idlok(stdscr,TRUE);	/* draw_panel() scrolls the panel */
 #ifdef HAVE_NOTIMEOUT
 	notimeout(stdscr,TRUE);
 #endif
@@ -183,7 +265,9 @@ curses_initialize(void)
 		attrb = A_STANDOUT;
 
 	win_frame_reconfig();
-	win_layout_reconfig();
+	if (layout_panel == 0)
+		/* not compiled by list_reconfig() */
+		win_layout_reconfig();
 	screen_draw_all();
 }
 
@@ -209,6 +293,7 @@ curses_stop(void)
 	refresh();
 	endwin();
 	display.curses = 0;
+	lat_idle();
 }
 
 /* stop CURSES */
@@ -226,7 +311,10 @@ static void
 screen_refresh(void)
 {
 	int pos;
+	long long start;
 
+	if (panel_deferred)
+		draw_panel(1);
 	if (pos_wait || pos_resize || pos_panel)
 		win_position();		/* display/clear message */
 
@@ -242,7 +330,27 @@ screen_refresh(void)
 		move(display.panlines + 5 + pos / display.scrcols,
 		  pos % display.scrcols);
 	}
+	start = lat_begin();
 	refresh();
+	lat_end(LAT_REFRESH,start);
+	lat_screen();
+	gettimeofday(&frame_time,0);
+}
+
+/* return value: 1 = skip this frame, more keys are waiting */
+static int
+kbd_typeahead(void)
+{
+	struct pollfd pfd;
+	struct timeval now;
+
+	pfd.fd = STDIN_FILENO;
+	pfd.events = POLLIN;
+	if (poll(&pfd,1,0) <= 0)
+		return 0;
+	gettimeofday(&now,0);
+	return (now.tv_sec - frame_time.tv_sec) * 1000L
+	  + (now.tv_usec - frame_time.tv_usec) / 1000 < FRAME_MSEC;
 }
 
 /*
@@ -282,12 +390,22 @@ kbd_getraw(void)
 	int key, retries;
 
 	for (;/* until return */;) {
-		screen_refresh();
+		if (!kbd_typeahead()) {
+			screen_refresh();
+			lat_idle();		/* waiting for the user */
+		}
 		retries = 10;
 		do {
 			if (--retries < 0)
 				err_exit("Cannot read the keyboard input");
+			/* wake up periodically if there are background jobs */
+			timeout(jobs_timeout());
 			key = getch();
+			if (key == ERR && jobs_timeout() >= 0) {
+				jobs_update();
+				screen_refresh();
+				retries = 10;
+			}
 		} while (key == ERR);
 #ifdef KEY_RESIZE
 		if (key == KEY_RESIZE) {
@@ -330,6 +448,34 @@ kbd_getany(void)
 	return key;
 }
 
+/*
+ * check if the user wants to cancel a lengthy operation (ctrl-C or
+ * ctrl-G), other keys pressed meanwhile are discarded
+ */
+int
+kbd_interrupt(void)
+{
+	int key;
+	FLAG intr, resize;
+
+	intr = resize = 0;
+	nodelay(stdscr,TRUE);
+	while ((key = getch()) != ERR)
+		if (key == CH_CTRL('C') || key == CH_CTRL('G'))
+			intr = 1;
+#ifdef KEY_RESIZE
+		else if (key == KEY_RESIZE)
+			resize = 1;
+#endif
+	nodelay(stdscr,FALSE);
+#ifdef KEY_RESIZE
+	if (resize)
+		/* to be processed later by kbd_getraw() */
+		ungetch(KEY_RESIZE);
+#endif
+	return intr;
+}
+
 /* get next input char */
 int
 kbd_input(void)
@@ -350,6 +496,7 @@ kbd_input(void)
 
 	prevkey = key;
 	key = kbd_getany();	
+	lat_key();
 	/* <esc> 1 --> <F1>, <esc> 2 --> <F2>, ... <esc> 0 --> <F10> */
 	if (prevkey == CH_ESC && IS_CHAR(key) && isdigit(key)) {
 		prevkey = 0;
@@ -404,30 +551,141 @@ win_frame_reconfig(void)
 	}
 }
 
+/*
+ * translate the 'fields' (see CFG_LAYOUT1) to a program executed
+ * by print_fields(), the 'fields' string must not be modified
+ * while the program is in use
+ */
+static LAYOUT_OP *
+layout_compile(const char *fields)
+{
+	int i, len;
+	FLAG left_align;
+	char ch;
+	LAYOUT_OP *ops;
+
+	ops = emalloc((strlen(fields) + 1) * sizeof(LAYOUT_OP));
+	for (i = 0, left_align = 0; *fields; i++) {
+		if (*fields != '$') {
+			for (len = 1; fields[len] && fields[len] != '$'; len++)
+				;
+			ops[i].code = LAYOUT_TEXT;
+			ops[i].left_align = 0;
+			ops[i].width = len;
+			ops[i].text = fields;
+			fields += len;
+			/* choose proper alignment (left or right) */
+			left_align = fields[-1] != ' ';
+			continue;
+		}
+
+		if ( (ch = fields[1]) == '\0')
+			break;
+		ops[i].code = ch;
+		ops[i].left_align = left_align;
+		switch (ch) {
+		case 'a':	/* access date/time */
+		case 'd':	/* modification date/time */
+		case 'i':	/* inode change date/time */
+			ops[i].width = display.date_len;
+			break;
+		case 'l':	/* links (total number) */
+			ops[i].width = FE_LINKS_STR - 1;
+			break;
+		case 'L':	/* links (flag) */
+			ops[i].width = 3;
+			break;
+		case 'm':	/* file mode */
+		case 'M':	/* file mode (alternative format) */
+			ops[i].width = FE_MODE_STR - 1;
+			break;
+		case 'o':	/* owner */
+			ops[i].width = FE_OWNER_STR - 1;
+			break;
+		case 'p':	/* permissions */
+		case 'P':	/* permissions (alternative format) */
+			ops[i].width = 9;	/* rwxrwxrwx */
+			break;
+		case 's':	/* file size (device major/minor) */
+		case 'S':	/* file size (not for directories) */
+			ops[i].width = FE_SIZE_DEV_STR - 1;
+			break;
+		case 't':	/* file type */
+			ops[i].width = 4;
+			break;
+		case '>':	/* symbolic link */
+			ops[i].width = 2;
+			break;
+		case '*':	/* selection mark */
+			ops[i].width = 1;
+			break;
+		case '$':	/* literal $ */
+		case '|':	/* literal | */
+			ops[i].code = LAYOUT_FIXED;
+			ops[i].width = 1;
+			ops[i].text = fields + 1;
+			break;
+		default:	/* syntax error */
+			ops[i].code = LAYOUT_FIXED;
+			ops[i].width = 2;
+			ops[i].text = fields;
+		}
+		if (ops[i].code != LAYOUT_FIXED
+		  && strchr(layout_fields,ch) == 0) {
+			len = strlen(layout_fields);
+			layout_fields[len] = ch;
+			layout_fields[len + 1] = '\0';
+		}
+		fields += 2;
+	}
+	ops[i].code = LAYOUT_END;
+	return ops;
+}
+
+/*
+ * compile the layout; the field widths depend on the date format,
+ * list_reconfig() calls this function whenever it changes
+ */
 void
 win_layout_reconfig(void)
 {
 	static USTRING layout = { 0,0 };
 	FLAG fld;
 	char ch, *pch;
+	const char *line;
 
 	us_copy(&layout,config_layout);
+	layout_gen++;
 
 	/* split layout to panel fields and line fields */
-	layout_panel = USTR(layout);
+	line = 0;
 	for (fld = 0, pch = USTR(layout); (ch = *pch); pch++)
 		if (!TCLR(fld)) {
 			if (ch == '$')
 				fld = 1;
 			else if (ch == '|') {
 				*pch = '\0';
-				layout_line = pch + 1;
-				return;	/* success */
+				line = pch + 1;
+				break;
 			}
 		}
+	if (line == 0) {
+		line = "$m $p $o";
+		txt_printf("CONFIG: Incorrect LAYOUT syntax: missing bar '|'\n");
+	}
 
-	layout_line = "$m $p $o";
-	txt_printf("CONFIG: Incorrect LAYOUT syntax: missing bar '|'\n");
+	free(layout_panel);
+	free(layout_line);
+	layout_fields[0] = '\0';
+	layout_panel = layout_compile(USTR(layout));
+	layout_line = layout_compile(line);
+}
+
+/* check if the field 'code' (e.g. 'd' for $d) is in the layout */
+int
+win_layout_field(int code)
+{
+	return strchr(layout_fields,code) != 0;
 }
 
 /* write a line of repeating chars */
@@ -515,6 +773,29 @@ win_waitmsg(void)
 	}
 }
 
+/*
+ * progress of a lengthy operation, it is displayed like the
+ * PLEASE WAIT message and replaced by the panel position later
+ */
+void
+win_progress_fmt(const char *format, ...)
+{
+	int len;
+	va_list argptr;
+	char buff[48];
+
+	if (!display.curses)
+		return;
+
+	va_start(argptr,format);
+	len = vsnprintf(buff,sizeof(buff),format,argptr);
+	va_end(argptr);
+	LIMIT_MAX(len,sizeof(buff) - 1);
+	print_position(buff,len,1);
+	pos_wait = 1;
+	refresh();
+}
+
 void
 win_filter(void)
 {
@@ -677,6 +958,9 @@ win_heading(void)
 	case MODE_DIR_SPLIT:
 		msg = "CHANGE WORKING DIRECTORY";
 		break;
+	case MODE_DIR_JUMP:
+		msg = "CHANGE WORKING DIRECTORY > JUMP  |  type parts of the directory name";
+		break;
 	case MODE_GROUP:
 		msg = "GROUP INFORMATION";
 		break;
@@ -689,6 +973,18 @@ win_heading(void)
 	case MODE_HIST:
 		msg = "COMMAND HISTORY  |  <tab> = insert, <esc> <del> = delete";
 		break;
+	case MODE_HIST_SEARCH:
+		msg = "COMMAND HISTORY > SEARCH  |  type a part of the command";
+		break;
+	case MODE_JOBS:
+		msg = "BACKGROUND JOBS  |  <enter> = output, <esc> <del> = terminate/remove";
+		break;
+	case MODE_JOBS_OUT:
+		msg = "BACKGROUND JOBS > OUTPUT";
+		break;
+	case MODE_LATENCY:
+		msg = "INPUT LATENCY  |  ctrl-W = write to file, <esc> <del> = reset";
+		break;
 	case MODE_MAINMENU:
 		msg = "MAIN FUNCTION MENU";
 		break;
@@ -704,6 +1000,11 @@ win_heading(void)
 	case MODE_SORT:
 		msg = "SORT ORDER";
 		break;
+	case MODE_TREECMP:
+		msg = panel_treecmp.dups ?
+		  "DUPLICATE FILES  |  <enter> = go to the directory" :
+		  "DIRECTORY TREE COMPARE  |  <enter> = go to the directory";
+		break;
 	case MODE_USER:
 		msg = "USER INFORMATION";
 		break;
@@ -734,133 +1035,101 @@ print_perms(const char *octal)
 }
 
 /*
- * see CFG_LAYOUT1 for more information about 'fields',
+ * execute the compiled layout (see layout_compile()),
  * function returns the remaining unused width
  */
 static int
-print_fields(FILE_ENTRY *pfe, int width, const char *fields)
+print_fields(FILE_ENTRY *pfe, int width, const LAYOUT_OP *op)
 {
 	const char *txt;
-	FLAG fld, left_align;
-	int ch, i, fw;
-	static char field[3] ="$x";
+	int i;
 
-	for (fld = left_align = 0; width > 0 && (ch = (unsigned char)*fields++); ) {
-		if (!TCLR(fld)) {
-			if (ch == '$')
-				fld = 1;
-			else {
-				addch(ch);
-				width--;
-				/* choose proper alignment (left or right) */
-				left_align = (ch != ' ');
-			}
+	for (; width > 0 && op->code != LAYOUT_END; op++) {
+		if (op->code == LAYOUT_TEXT) {
+			i = op->width < width ? op->width : width;
+			addnstr(op->text,i);
+			width -= i;
+			continue;
 		}
-		else {
-			switch (ch) {
-			case 'a':	/* access date/time */
-				fw = display.date_len;
-				txt = pfe->atime_str;
-				break;
-			case 'd':	/* modification date/time */
-				fw = display.date_len;
-				txt = pfe->mtime_str;
-				break;
-			case 'i':	/* inode change date/time */
-				fw = display.date_len;
-				txt = pfe->ctime_str;
-				break;
-			case 'l':	/* links (total number) */
-				fw = FE_LINKS_STR - 1;
-				txt = pfe->links_str;
-				break;
-			case 'L':	/* links (flag) */
-				fw = 3;
-				txt = pfe->links ? "LNK" : "   ";
-				break;
-			case 'm':	/* file mode */
-				fw = FE_MODE_STR - 1;
-				txt = pfe->mode_str;
-				break;
-			case 'M':	/* file mode (alternative format) */
-				fw = FE_MODE_STR - 1;
-				txt = pfe->normal_mode ? "" : pfe->mode_str;
-				break;
-			case 'o':	/* owner */
-				fw = FE_OWNER_STR - 1;
-				txt = pfe->owner_str;
-				break;
-			case 'p':	/* permissions */
-				fw = 9;	/* rwxrwxrwx */
-				txt = 0;
-				break;
-			case 'P':	/* permissions (alternative format) */
-				fw = 9;
-				txt = pfe->normal_mode ? "" : 0;
-				break;
-			case 's':	/* file size (device major/minor) */
-				fw = FE_SIZE_DEV_STR - 1;
-				txt = pfe->size_str;
-				break;
-			case 'S':	/* file size (not for directories) */
-				fw = FE_SIZE_DEV_STR - 1;
-				txt = IS_FT_DIR(pfe->file_type) ? "" : pfe->size_str;
-				break;
-			case 't':	/* file type */
-				fw = 4;
-				txt = type_symbol[pfe->file_type];
-				break;
-			case '>':	/* symbolic link */
-				fw = 2;
-				txt = pfe->symlink ? "->" : "  ";
-				break;
-			case '*':	/* selection mark */
-				fw = 1;
-				txt = pfe->select ? "*" : " ";
-				break;
-			case '$':	/* literal $ */
-				fw = 1;
-				txt = "$";
-				break;
-			case '|':	/* literal | */
-				fw = 1;
-				txt = "|";
-				break;
-			default:	/* syntax error */
-				fw = 2;
-				field[1] = ch;
-				txt = field;
-			}
+		if (width < op->width)
+			break;
 
-			if (width < fw)
-				break;
+		switch (op->code) {
+		case 'a':
+			txt = pfe->atime_str;
+			break;
+		case 'd':
+			txt = pfe->mtime_str;
+			break;
+		case 'i':
+			txt = pfe->ctime_str;
+			break;
+		case 'l':
+			txt = pfe->links_str;
+			break;
+		case 'L':
+			txt = pfe->links ? "LNK" : "   ";
+			break;
+		case 'm':
+			txt = pfe->mode_str;
+			break;
+		case 'M':
+			txt = pfe->normal_mode ? "" : pfe->mode_str;
+			break;
+		case 'o':
+			txt = pfe->owner_str;
+			break;
+		case 'p':
+			txt = 0;
+			break;
+		case 'P':
+			txt = pfe->normal_mode ? "" : 0;
+			break;
+		case 's':
+			txt = pfe->size_str;
+			break;
+		case 'S':
+			txt = IS_FT_DIR(pfe->file_type) ? "" : pfe->size_str;
+			break;
+		case 't':
+			txt = type_symbol[pfe->file_type];
+			break;
+		case '>':
+			txt = pfe->symlink ? "->" : "  ";
+			break;
+		case '*':
+			txt = pfe->select ? "*" : " ";
+			break;
+		default:	/* LAYOUT_FIXED */
+			addnstr(op->text,op->width);
+			width -= op->width;
+			continue;
+		}
 
-			/*
-             * txt == NULL     - compute the string
-             * txt == ""       - leave the field blank
-             * txt == "string" - print this string
-             */
-			if (txt == 0) {
-				/* $p */
-				if (pfe->file_type != FT_NA)
-					print_perms(pfe->mode_str);
-				else
-					BLANK(fw);
-			}
-			else if (*txt == '\0')
-				BLANK(fw);
-			else if (left_align && *txt == ' ') {
-				/* change alignment from right to left */
-				for (i = 1; txt[i] == ' '; i++)
-					;
-				addstr(txt + i);
-				BLANK(i);
-			}
+		/*
+		 * txt == NULL     - compute the string
+		 * txt == ""       - leave the field blank
+		 * txt == "string" - print this string
+		 */
+		if (txt == 0) {
+			/* $p */
+			if (pfe->file_type != FT_NA)
+				print_perms(pfe->mode_str);
 			else
-				addstr(txt);
-
-			width -= fw;
+				BLANK(op->width);
+		}
+		else if (*txt == '\0')
+			BLANK(op->width);
+		else if (op->left_align && *txt == ' ') {
+			/* change alignment from right to left */
+			for (i = 1; txt[i] == ' '; i++)
+				;
+			addstr(txt + i);
+			BLANK(i);
 		}
+		else
+			addstr(txt);
+		width -= op->width;
 	}
 
 	return width;
@@ -897,6 +1166,45 @@ pfe_info(FILE_ENTRY *pfe)
 	clrtoeol();
 }
 
+static void
+stats_info(const CMD_STATS *ps)
+{
+	int len;
+	char buff[160];
+
+	if (!ps->valid) {
+		putstr_trunc("  no execution statistics available",display.scrcols,0);
+		return;
+	}
+
+	if (ps->status >= 0)
+		len = sprintf(buff,"  exit code %d",ps->status);
+	else
+		len = sprintf(buff,"  killed by signal %d",-ps->status);
+	len += sprintf(buff + len,", real %s",duration_str(ps->wall));
+	if (ps->user >= 0) {
+		len += sprintf(buff + len,", user %s",duration_str(ps->user));
+		len += sprintf(buff + len,", sys %s",duration_str(ps->sys));
+	}
+	if (ps->maxrss >= 0)
+		sprintf(buff + len,", max RSS %ld kB",ps->maxrss);
+	putstr_trunc(buff,display.scrcols,0);
+}
+
+static void
+jobs_info(const JOB_ENTRY *pj)
+{
+	char buff[80];
+
+	if (pj->pid == 0) {
+		stats_info(&pj->stats);
+		return;
+	}
+	sprintf(buff,"  running, process ID %d, %lld bytes of output",
+	  (int)pj->pid,pj->outlen);
+	putstr_trunc(buff,display.scrcols,0);
+}
+
 /* information line */
 static void
 win_info(void)
@@ -910,10 +1218,10 @@ win_info(void)
 	if (info_warnmsg) {
 		flash();
 		attrset(attrb);
-		width =
-		  putstr_trunc(info_warnmsg,display.scrcols - 15,OPT_NOPAD);
+		width = putstr_trunc(info_warnmsg,
+		  display.scrcols - 15,OPT_NOPAD);
 		attrset(A_NORMAL);
-		addstr(" Press any key.");		/* 15 */
+		addstr(info_prompt);			/* max 15 */
 		if (display.scrcols - width > 15)
 			clrtoeol();
 		return;
@@ -958,6 +1266,15 @@ win_info(void)
 		case PANEL_TYPE_FILE:
 			pfe_info(ppanel_file->files[panel->curs]);
 			break;
+		case PANEL_TYPE_HIST:
+			stats_info(&panel_hist.hist[panel->curs]->stats);
+			break;
+		case PANEL_TYPE_JOBS:
+			jobs_info(panel_jobs.job[panel->curs]);
+			break;
+		case PANEL_TYPE_LATENCY:
+			putstr_trunc(lat_info(),display.scrcols,0);
+			break;
 		default:
 			clrtoeol();
 	}
@@ -985,12 +1302,28 @@ win_warning(const char *msg)
 	 * real work is performed there
 	 */
 	info_warnmsg = msg;
+	info_prompt = " Press any key.";
 	win_info();
 	kbd_getany();
 	info_warnmsg = 0;
 	win_info();
 }
 
+/* ask a question, return value: 1 = yes, 0 = no */
+int
+win_question(const char *msg)
+{
+	int key;
+
+	info_warnmsg = msg;
+	info_prompt = " (y = YES)";
+	win_info();
+	key = kbd_getany();
+	info_warnmsg = 0;
+	win_info();
+	return key == 'y' || key == 'Y';
+}
+
 void
 win_warning_fmt(const char *format, ...)
 {
@@ -1064,16 +1397,23 @@ win_completion(int cnt, const char *chars)
 void
 win_bar(void)
 {
-	int len;
+	int len, cnt;
+	char buff[64];
 
 	attrset(attrr);
 	move(display.panlines + 4,0);
 	len = strlen(clex_data.login_at_host) + 2;	/* + 2 spaces */
 	addstr(" CLEX file manager - ");			/* 21 */
-	putstr_trunc(clex_data.admin ? "ADMIN MODE" :
-	  "alt-M for menu, F1 for help",display.scrcols - 21 - len,0);
+	if (!clex_data.admin && (cnt = jobs_running()) > 0) {
+		sprintf(buff,"%d background job%s running, alt-O to view",
+		  cnt,cnt == 1 ? "" : "s");
+		putstr_trunc(buff,display.scrcols - 21 - len,0);
+	}
+	else
+		putstr_trunc(clex_data.admin ? "ADMIN MODE" :
+		  "alt-M for menu, F1 for help",display.scrcols - 21 - len,0);
 	addch(' ');
-	putstr_trunc(clex_data.login_at_host,len + 1,0);
+	putstr_trunc(clex_data.login_at_host,len - 1,0);
 	attrset(A_NORMAL);
 }
 
@@ -1142,6 +1482,10 @@ draw_line_compare(int ln)
 		"3: name, type, size, ownership+permissions",
 		"4: name, type, size, contents",
 		"5: name, type, size, ownership+permissions, contents",
+		"6: whole trees: name, type, size",
+		"7: whole trees: name, type, size, contents",
+		"8: find duplicate files (select them)",
+		"9: whole trees: find duplicate files (list them)",
 	};
 
 	putstr_trunc(description[ln],display.pancols,0);
@@ -1179,6 +1523,12 @@ draw_line_dir(int ln)
 	  display.pancols - shlen,0);
 }
 
+static void
+draw_line_dir_jump(int ln)
+{
+	putstr_trunc(panel_dir_jump.dir[ln].name,display.pancols,0);
+}
+
 static void
 draw_line_dir_split(int ln)
 {
@@ -1197,9 +1547,21 @@ static void
 draw_line_file(int ln)
 {
 	FILE_ENTRY *pfe;
+	ROW_CACHE *prc;
 	int width;
 
 	pfe = ppanel_file->files[ln];
+
+	/* the current line is always rendered (reverse video) */
+	prc = ln == panel->curs || rowcache_cnt == 0
+	  ? 0 : rowcache + ln % rowcache_cnt;
+	if (prc && prc->pfe == pfe && prc->gen == pfe->gen
+	  && prc->layout == layout_gen && prc->select == pfe->select) {
+		addchnstr(prc->cell,display.pancols);
+		move(2 + ln - panel->top,2 + display.pancols);
+		return;
+	}
+
 	if (pfe->select)
 		attron(attrb);
 
@@ -1215,6 +1577,16 @@ draw_line_file(int ln)
 
 	if (pfe->select)
 		attroff(attrb);
+
+	if (prc) {
+		/* read back what was drawn */
+		mvinchnstr(2 + ln - panel->top,2,prc->cell,display.pancols);
+		move(2 + ln - panel->top,2 + display.pancols);
+		prc->pfe = pfe;
+		prc->gen = pfe->gen;
+		prc->layout = layout_gen;
+		prc->select = pfe->select;
+	}
 }
 
 static void
@@ -1239,11 +1611,53 @@ draw_line_help(int ln)
 static void
 draw_line_hist(int ln)
 {
-	if (panel_hist.hist[ln]->failed)
+	char buff[16];
+	const HIST_ENTRY *pe;
+
+	pe = panel_hist.hist[ln];
+	if (pe->stats.valid) {
+		snprintf(buff,sizeof(buff),"%6s  ",duration_str(pe->stats.wall));
+		addstr(buff);			/* 8 */
+	}
+	else
+		BLANK(8);
+	if (pe->failed)
 		addstr("failed: ");		/* 8 */
 	else 
 		BLANK(8);
-	putstr_trunc(USTR(panel_hist.hist[ln]->cmd),display.pancols - 8,0);
+	putstr_trunc(USTR(pe->cmd),display.pancols - 16,0);
+}
+
+static void
+draw_line_jobs(int ln)
+{
+	char buff[48];
+	const char *state;
+	const JOB_ENTRY *pj;
+
+	pj = panel_jobs.job[ln];
+	if (pj->pid)
+		state = "running";
+	else if (!pj->stats.valid || pj->stats.status == 0)
+		state = "finished";
+	else
+		state = pj->stats.status > 0 ? "failed" : "killed";
+	sprintf(buff,"%4d  %-9s%8s  ",pj->num,state,
+	  duration_str(job_runtime(pj)));
+	addstr(buff);				/* 25 */
+	putstr_trunc(pj->cmd,display.pancols - 25,0);
+}
+
+static void
+draw_line_jobs_out(int ln)
+{
+	putstr_trunc(job_line(ln),display.pancols,0);
+}
+
+static void
+draw_line_lat(int ln)
+{
+	putstr_trunc(lat_line(ln),display.pancols,0);
 }
 
 static void
@@ -1256,7 +1670,14 @@ draw_line_mainmenu(int ln)
 		"  change into parent directory           alt-.",
 		"  change into home directory             alt-~",
 		"  bookmarks                              alt-K",
+		"  jump to a frequently used directory    alt-J",
 		"command history                          alt-H",
+		"  search in the command history          alt-R",
+		"background jobs                          alt-O",
+		"batch execution over selected files      alt-X",
+		"copy files to the secondary directory    alt-Y",
+		"move files to the secondary directory    alt-T",
+		"delete files                             alt-E",
 		"sort order for filenames                 alt-S",
 		"re-read current directory                ctrl-R",
 		"compare directories                      alt-=",
@@ -1267,6 +1688,7 @@ draw_line_mainmenu(int ln)
 		"               select using pattern      alt-+",
 		"               deselect using pattern    alt--",
 		"               invert selection          alt-*",
+		"input latency statistics                 alt-I",
 		"configure CLEX                           alt-C",
 		"program version                          alt-V",
 		"quit                                     alt-Q"
@@ -1341,6 +1763,43 @@ draw_line_sort(int ln)
 	}
 }
 
+static void
+draw_line_treecmp(int ln)
+{
+	static const char *description[] = {
+		/* must correspond with TC_XXX */
+		"primary only",
+		"secondary only",
+		"type differs",
+		"size differs",
+		"link differs",
+		"data differs",
+		"read error",
+		"primary",
+		"secondary"
+	};
+	int len;
+	char group[32];
+	const char *path;
+	const TREECMP_ENTRY *pe;
+
+	pe = panel_treecmp.diff + ln;
+	if (pe->diff == TC_DUP1 || pe->diff == TC_DUP2) {
+		sprintf(group,"%s #%d",description[pe->diff],pe->group);
+		printw("%-14.14s  ",group);				/* 16 */
+	}
+	else
+		printw("%-14s  ",description[pe->diff]);	/* 16 */
+	path = *pe->path ? pe->path : ".";
+	if (!pe->dir) {
+		putstr_trunc(path,display.pancols - 16,0);
+		return;
+	}
+	len = putstr_trunc(path,display.pancols - 17,OPT_NOPAD);
+	addch('/');								/* 1 */
+	BLANK(display.pancols - 17 - len);
+}
+
 static void
 draw_line_usr(int ln)
 {
@@ -1382,9 +1841,11 @@ draw_panel_line(int y)
 	/* must correspond with PANEL_TYPE_XXX */
 	static void (*draw_line[])(int) = {
 	  draw_line_bm, draw_line_cfg, draw_line_compare, draw_line_compl,
-	  draw_line_dir, draw_line_dir_split, draw_line_file, draw_line_grp,
-	  draw_line_help, draw_line_hist, draw_line_mainmenu,
-	  draw_line_pastemenu, draw_line_sort, draw_line_usr
+	  draw_line_dir, draw_line_dir_jump, draw_line_dir_split, draw_line_file,
+	  draw_line_grp, draw_line_help, draw_line_hist, draw_line_jobs,
+	  draw_line_jobs_out, draw_line_lat, draw_line_mainmenu,
+	  draw_line_pastemenu,
+	  draw_line_sort, draw_line_treecmp, draw_line_usr
 	};
 
 	move(2 + y,0);
@@ -1419,17 +1880,26 @@ static void
 draw_panel(int optimize)
 {
 	static int save_top, save_curs, save_ptype = PANEL_TYPE_NONE;
-	int y;
+	int y, shift, moved;
+	long long start;
+
+	start = lat_begin();
 
 	if (panel->type != save_ptype) {
 		/* panel type has changed */
 		optimize = 0;
 		save_ptype = panel->type;
 	}
+	/* the line where the skipped cursor movements ended */
+	moved = TCLR(panel_deferred) ? deferred_curs - panel->top : -1;
+	if (moved < 0 || moved >= display.panlines)
+		moved = -1;
 
 	if (optimize && save_top == panel->top) {
 		/* redraw only the old and new current lines */
 		draw_panel_line(save_curs - panel->top);
+		if (moved >= 0)
+			draw_panel_line(moved);
 		if (save_curs != panel->curs) {
 			pos_panel = 1;
 			draw_panel_line(panel->curs - panel->top);
@@ -1439,6 +1909,34 @@ draw_panel(int optimize)
 			/* number of selected files could have changed */
 			pos_panel = 1;
 	}
+	else if (optimize && (shift = panel->top - save_top) != 0
+	  && shift >= -display.panlines / 2 && shift <= display.panlines / 2) {
+		/*
+		 * scroll the panel lines by 'shift' and redraw only the
+		 * lines scrolled in and the old and new current lines,
+		 * with idlok() this is a terminal scroll operation
+		 */
+		pos_panel = 1;
+		setscrreg(2,display.panlines + 1);
+		scrollok(stdscr,TRUE);
+		scrl(shift);
+		scrollok(stdscr,FALSE);
+		setscrreg(0,display.scrlines - 1);
+		if (shift > 0)
+			for (y = display.panlines - shift; y < display.panlines; y++)
+				draw_panel_line(y);
+		else
+			for (y = 0; y < -shift; y++)
+				draw_panel_line(y);
+		y = save_curs - panel->top;
+		if (y >= 0 && y < display.panlines)
+			draw_panel_line(y);
+		if (moved >= 0)
+			draw_panel_line(moved);
+		draw_panel_line(panel->curs - panel->top);
+		save_top = panel->top;
+		save_curs = panel->curs;
+	}
 	else {
 		pos_panel = 1;
 		/* redraw all lines */
@@ -1449,6 +1947,7 @@ draw_panel(int optimize)
 	}
 
 	win_info();
+	lat_end(LAT_PANEL,start);
 }
 
 /* win_panel() without optimization */
@@ -1458,6 +1957,21 @@ win_panel(void)
 	draw_panel(0);
 }
 
+/*
+ * win_panel() after a cursor movement, drawing is postponed if more
+ * keys are waiting, e.g. while an arrow key is held down
+ */
+void
+win_panel_move(void)
+{
+	if (kbd_typeahead()) {
+		panel_deferred = 1;
+		deferred_curs = panel->curs;
+	}
+	else
+		draw_panel(1);
+}
+
 /*
  * win_panel() with optimization
  *
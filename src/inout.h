@@ -7,9 +7,11 @@ extern void txt_printf(const char *, ...);
 extern int kbd_input(void);
 extern int kbd_esc(void);
 extern int kbd_getraw(void);
+extern int kbd_interrupt(void);
 
 extern void win_frame_reconfig(void);
 extern void win_layout_reconfig(void);
+extern int win_layout_field(int);
 extern void win_bar(void);
 extern void win_edit(void);
 extern void win_remark_fmt(const char *, ...);
@@ -19,7 +21,10 @@ extern void win_frame(void);
 extern void win_heading(void);
 extern void win_panel(void);
 extern void win_panel_opt(void);
+extern void win_panel_move(void);
 extern void win_warning(const char *);
 extern void win_warning_fmt(const char *, ...);
+extern int win_question(const char *);
 extern void win_waitmsg(void);
+extern void win_progress_fmt(const char *, ...);
 extern void win_completion(int, const char *);
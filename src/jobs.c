@@ -0,0 +1,462 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2006 Vlado Potisk <vlado_potisk@clex.sk>
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from http://www.clex.sk
+ *
+ */
+
+#include <config.h>
+
+#include <sys/types.h>		/* pid_t */
+#include <errno.h>			/* errno */
+#include <fcntl.h>			/* fcntl() */
+#include <signal.h>			/* kill() */
+#include <stdlib.h>			/* free() */
+#include <string.h>			/* strerror() */
+#include <unistd.h>			/* read() */
+
+/* gettimeofday() */
+#if TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# if HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+
+/* waitpid() */
+#ifdef HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
+
+/* wait4() */
+#if defined(HAVE_WAIT4) && defined(HAVE_SYS_RESOURCE_H)
+# include <sys/resource.h>
+# define USE_WAIT4
+#endif
+#ifndef WEXITSTATUS
+# define WEXITSTATUS(status) ((unsigned)(status) >> 8)
+#endif
+#ifndef WIFEXITED
+# define WIFEXITED(status) (((status) & 255) == 0)
+#endif
+
+#include "clex.h"
+#include "jobs.h"
+
+#include "control.h"		/* get_current_mode() */
+#include "exec.h"			/* exec_background() */
+#include "inout.h"			/* win_panel() */
+#include "panel.h"			/* pan_adjust() */
+#include "util.h"			/* emalloc() */
+
+/*
+ * A command ending with a single '&' is started as a background job.
+ * Its standard output and error output go through a pipe into a ring
+ * buffer holding the latest JOB_OUTSIZE bytes. CLEX does not block
+ * while waiting for the keyboard input when there are active jobs,
+ * the pipes are drained and the finished jobs are reaped every
+ * JOB_POLL milliseconds.
+ */
+
+#define JOB_OUTSIZE		65536	/* ring buffer size, power of two */
+#define JOB_MAX			32		/* max number of jobs in the list */
+#define JOB_POLL		250		/* poll interval (in ms) */
+#define JOB_LINEMAX		512		/* max displayed line length */
+
+#define TV2MS(TV)	((TV).tv_sec * 1000L + (TV).tv_usec / 1000)
+
+static int jobs_cnt = 0;		/* number of jobs in the list */
+static int jobs_active = 0;		/* running jobs or jobs with open pipes */
+static int job_number = 0;		/* last assigned job number */
+
+static long long
+now_ms(void)
+{
+	struct timeval now;
+
+	gettimeofday(&now,0);
+	return (long long)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+static void
+job_free(JOB_ENTRY *pj)
+{
+	free(pj->cmd);
+	free(pj->out);
+	free(pj);
+}
+
+static void
+job_remove(int idx)
+{
+	job_free(panel_jobs.job[idx]);
+	for (jobs_cnt--; idx < jobs_cnt; idx++)
+		panel_jobs.job[idx] = panel_jobs.job[idx + 1];
+	panel_jobs.pd->cnt = jobs_cnt;
+}
+
+static int
+job_isactive(const JOB_ENTRY *pj)
+{
+	return pj->pid != 0 || pj->fd >= 0;
+}
+
+/* count the jobs for the status bar */
+int
+jobs_running(void)
+{
+	int i, cnt;
+
+	for (cnt = i = 0; i < jobs_cnt; i++)
+		if (panel_jobs.job[i]->pid)
+			cnt++;
+	return cnt;
+}
+
+/* elapsed time (in ms) of a running job or total time of a finished job */
+long
+job_runtime(const JOB_ENTRY *pj)
+{
+	long long ms;
+
+	if (pj->stats.valid)
+		return pj->stats.wall;
+	ms = now_ms() - pj->start;
+	return ms < 0 ? 0 : (long)ms;
+}
+
+/* timeout for the keyboard input: -1 = wait indefinitely */
+int
+jobs_timeout(void)
+{
+	return jobs_active ? JOB_POLL : -1;
+}
+
+/*
+ * job_start() starts the first 'len' characters of 'cmd' as
+ * a background job
+ *
+ * return value: 0 = ok, -1 = error (the user was notified)
+ */
+int
+job_start(const char *cmd, size_t len)
+{
+	int i, fd[2];
+	pid_t pid;
+	JOB_ENTRY *pj;
+
+	if (panel_jobs.job == 0)
+		panel_jobs.job = emalloc(JOB_MAX * sizeof(JOB_ENTRY *));
+	if (jobs_cnt == JOB_MAX) {
+		/* discard the oldest finished job */
+		for (i = jobs_cnt - 1; i >= 0; i--)
+			if (!job_isactive(panel_jobs.job[i]))
+				break;
+		if (i < 0) {
+			win_warning("Too many background jobs.");
+			return -1;
+		}
+		job_remove(i);
+	}
+
+	if (pipe(fd) < 0) {
+		win_warning_fmt("Cannot create a pipe: %s",strerror(errno));
+		return -1;
+	}
+	/* do not leak the pipe to other commands */
+	fcntl(fd[0],F_SETFD,FD_CLOEXEC);
+	fcntl(fd[1],F_SETFD,FD_CLOEXEC);
+	fcntl(fd[0],F_SETFL,O_NONBLOCK);
+
+	pj = emalloc(sizeof(JOB_ENTRY));
+	pj->cmd = emalloc(len + 1);
+	memcpy(pj->cmd,cmd,len);
+	pj->cmd[len] = '\0';
+	pj->start = now_ms();
+	pid = exec_background(pj->cmd,fd[1]);
+	close(fd[1]);
+	if (pid < 0) {
+		win_warning_fmt("Cannot start the background job: %s",
+		  strerror(errno));
+		close(fd[0]);
+		free(pj->cmd);
+		free(pj);
+		return -1;
+	}
+
+	pj->num = ++job_number;
+	pj->pid = pid;
+	pj->fd = fd[0];
+	pj->out = emalloc(JOB_OUTSIZE);
+	pj->outlen = 0;
+	pj->stats.valid = 0;
+	for (i = jobs_cnt++; i > 0; i--)
+		panel_jobs.job[i] = panel_jobs.job[i - 1];
+	panel_jobs.job[0] = pj;
+	panel_jobs.pd->cnt = jobs_cnt;
+	jobs_active++;
+
+	win_remark_fmt("background job #%d started",pj->num);
+	win_bar();
+	return 0;
+}
+
+/*
+ * read the available output of the job into the ring buffer, a job
+ * producing output without a pause must not block the user interface,
+ * that's why the amount of data read in one call is limited
+ *
+ * return value: 1 = some data was read or the pipe was closed
+ */
+static int
+job_read(JOB_ENTRY *pj)
+{
+	int pos, changed;
+	ssize_t rd;
+	long long limit;
+
+	limit = pj->outlen + 16 * JOB_OUTSIZE;
+	for (changed = 0; pj->outlen < limit; ) {
+		pos = pj->outlen & (JOB_OUTSIZE - 1);
+		rd = read(pj->fd,pj->out + pos,JOB_OUTSIZE - pos);
+		if (rd > 0) {
+			pj->outlen += rd;
+			changed = 1;
+			continue;
+		}
+		if (rd < 0 && errno == EINTR)
+			continue;
+		if (rd < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return changed;
+		/* EOF or error */
+		close(pj->fd);
+		pj->fd = -1;
+		return 1;
+	}
+	return changed;
+}
+
+/* check if the job has terminated, return value: 1 = terminated */
+static int
+job_reap(JOB_ENTRY *pj)
+{
+	pid_t pid;
+	int status;
+#ifdef USE_WAIT4
+	struct rusage ru;
+
+	while ((pid = wait4(pj->pid,&status,WNOHANG,&ru)) < 0 && errno == EINTR)
+		;
+#else
+	while ((pid = waitpid(pj->pid,&status,WNOHANG)) < 0 && errno == EINTR)
+		;
+#endif
+	if (pid == 0)
+		return 0;
+
+	pj->pid = 0;
+	if (pid < 0)
+		/* should not happen, the child was reaped elsewhere */
+		return 1;
+
+	pj->stats.valid = 1;
+	pj->stats.wall = now_ms() - pj->start;
+	if (pj->stats.wall < 0)
+		pj->stats.wall = 0;
+#ifdef USE_WAIT4
+	pj->stats.user = TV2MS(ru.ru_utime);
+	pj->stats.sys = TV2MS(ru.ru_stime);
+	pj->stats.maxrss = ru.ru_maxrss;
+#else
+	pj->stats.user = pj->stats.sys = pj->stats.maxrss = -1;
+#endif
+	pj->stats.status = WIFEXITED(status) ?
+	  WEXITSTATUS(status) : -WTERMSIG(status);
+	return 1;
+}
+
+/* index of output lines of the job displayed in the output panel */
+static void
+jobs_out_index(void)
+{
+	int cnt;
+	long long pos, end;
+	const JOB_ENTRY *pj;
+
+	pj = panel_jobs_out.job;
+	end = pj->outlen;
+	pos = end > JOB_OUTSIZE ? end - JOB_OUTSIZE : 0;
+	for (cnt = 0; pos < end; cnt++) {
+		if (cnt == panel_jobs_out.alloc) {
+			panel_jobs_out.alloc = cnt ? 2 * cnt : 256;
+			panel_jobs_out.line = erealloc(panel_jobs_out.line,
+			  panel_jobs_out.alloc * sizeof(long long));
+		}
+		panel_jobs_out.line[cnt] = pos;
+		while (pos < end && pj->out[pos++ & (JOB_OUTSIZE - 1)] != '\n')
+			;
+	}
+	panel_jobs_out.pd->cnt = cnt;
+}
+
+/*
+ * job_line() returns the line 'ln' of the output panel ready to be
+ * displayed: escape sequences are removed, tabs are expanded and
+ * a carriage return starts the line again (progress indicators)
+ */
+const char *
+job_line(int ln)
+{
+	int i, ch;
+	long long pos, end;
+	const JOB_ENTRY *pj;
+	static char line[JOB_LINEMAX + 1];
+
+	pj = panel_jobs_out.job;
+	pos = panel_jobs_out.line[ln];
+	end = ln + 1 < panel_jobs_out.pd->cnt ?
+	  panel_jobs_out.line[ln + 1] - 1 : pj->outlen;
+	for (i = 0; pos < end; ) {
+		ch = (unsigned char)pj->out[pos++ & (JOB_OUTSIZE - 1)];
+		if (ch == '\n')
+			break;
+		if (ch == '\r')
+			i = 0;
+		else if (ch == '\033') {
+			/* skip ESC [ params final, or ESC + one char */
+			if (pos < end && pj->out[pos & (JOB_OUTSIZE - 1)] == '[')
+				for (pos++; pos < end; ) {
+					ch = (unsigned char)pj->out[pos++ & (JOB_OUTSIZE - 1)];
+					if (ch >= 0x40 && ch <= 0x7E)
+						break;
+				}
+			else
+				pos++;
+		}
+		else if (i == JOB_LINEMAX)
+			/* too long, but a '\r' may still follow */
+			;
+		else if (ch == '\t')
+			do
+				line[i++] = ' ';
+			while (i % 8 && i < JOB_LINEMAX);
+		else
+			line[i++] = ch;
+	}
+	line[i] = '\0';
+	return line;
+}
+
+/*
+ * jobs_update() drains the pipes and reaps the finished jobs,
+ * it is called periodically while waiting for the keyboard input
+ */
+void
+jobs_update(void)
+{
+	int i, mode, output, finished;
+	FLAG follow;
+	JOB_ENTRY *pj;
+
+	output = finished = 0;
+	for (i = 0; i < jobs_cnt; i++) {
+		pj = panel_jobs.job[i];
+		if (pj->fd >= 0 && job_read(pj))
+			output |= pj == panel_jobs_out.job ? 2 : 1;
+		if (pj->pid && job_reap(pj)) {
+			finished = 1;
+			if (pj->stats.valid == 0)
+				win_remark_fmt("background job #%d finished",pj->num);
+			else if (pj->stats.status >= 0)
+				win_remark_fmt("background job #%d finished, exit code %d",
+				  pj->num,pj->stats.status);
+			else
+				win_remark_fmt("background job #%d killed by signal %d",
+				  pj->num,-pj->stats.status);
+		}
+	}
+	for (jobs_active = i = 0; i < jobs_cnt; i++)
+		if (job_isactive(panel_jobs.job[i]))
+			jobs_active++;
+
+	if (finished)
+		win_bar();
+	mode = get_current_mode();
+	if (mode == MODE_JOBS)
+		/* running times are displayed */
+		win_panel();
+	else if (mode == MODE_JOBS_OUT && (output & 2)) {
+		/* the cursor on the last line follows the output */
+		follow = panel_jobs_out.pd->curs == panel_jobs_out.pd->cnt - 1;
+		jobs_out_index();
+		if (follow)
+			panel_jobs_out.pd->curs = panel_jobs_out.pd->cnt - 1;
+		pan_adjust(panel_jobs_out.pd);
+		win_panel();
+	}
+}
+
+void
+jobs_prepare(void)
+{
+	panel_jobs.pd->cnt = jobs_cnt;
+	panel_jobs.pd->top = panel_jobs.pd->min;
+	panel_jobs.pd->curs = jobs_cnt ? 0 : -1;
+	panel = panel_jobs.pd;
+	textline = 0;
+}
+
+void
+jobs_out_prepare(void)
+{
+	panel_jobs_out.job = panel_jobs.job[panel_jobs.pd->curs];
+	jobs_out_index();
+	panel_jobs_out.pd->top = panel_jobs_out.pd->min;
+	panel_jobs_out.pd->curs = panel_jobs_out.pd->cnt - 1;
+	panel = panel_jobs_out.pd;
+	textline = 0;
+}
+
+void
+cx_jobs_output(void)
+{
+	control_loop(MODE_JOBS_OUT);
+	panel_jobs_out.job = 0;
+}
+
+/* terminate a running job or remove a finished job from the list */
+void
+cx_jobs_kill(void)
+{
+	JOB_ENTRY *pj;
+
+	pj = panel_jobs.job[panel_jobs.pd->curs];
+	if (pj->pid) {
+		/* the job is a process group leader */
+		if (kill(-pj->pid,SIGTERM) < 0)
+			win_remark_fmt("cannot terminate job #%d: %s",
+			  pj->num,strerror(errno));
+		else
+			win_remark_fmt("termination signal sent to job #%d",pj->num);
+		return;
+	}
+
+	if (pj->fd >= 0) {
+		close(pj->fd);
+		jobs_active--;
+	}
+	job_remove(panel_jobs.pd->curs);
+	pan_adjust(panel_jobs.pd);
+	win_panel();
+}
@@ -0,0 +1,10 @@
+extern int job_start(const char *, size_t);
+extern int jobs_running(void);
+extern long job_runtime(const JOB_ENTRY *);
+extern int jobs_timeout(void);
+extern void jobs_update(void);
+extern const char *job_line(int);
+extern void jobs_prepare(void);
+extern void jobs_out_prepare(void);
+extern void cx_jobs_output(void);
+extern void cx_jobs_kill(void);
@@ -0,0 +1,360 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2006 Vlado Potisk <vlado_potisk@clex.sk>
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from http://www.clex.sk
+ *
+ */
+
+/*
+ * Input latency statistics. When enabled (CFG_LATENCY_STATS), every
+ * key is timestamped on input and its latency is recorded when the
+ * screen is updated. The time spent in the main steps of processing
+ * the key is measured as well. All values go into histograms with
+ * logarithmic buckets, one histogram per LAT_XXX operation.
+ *
+ * Intervals containing a wait for the user (e.g. for an answer to
+ * a question or in a nested panel) or a command execution in the
+ * text mode are not measured, see lat_idle().
+ */
+
+#include <config.h>
+
+#include <sys/types.h>		/* umask() */
+#include <sys/stat.h>		/* umask() */
+#include <stdio.h>			/* fprintf() */
+#include <string.h>			/* memset() */
+
+/* gettimeofday() */
+#if TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# if HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+
+#include "clex.h"
+#include "latency.h"
+
+#include "cfg.h"			/* config_num() */
+#include "inout.h"			/* win_panel() */
+#include "util.h"			/* pathname_join() */
+
+#define LAT_BUCKETS		14
+#define LAT_KEYQ		64		/* max keys waiting for a screen update */
+
+/* lines of the statistics panel */
+#define LAT_LN_COUNT	1
+#define LAT_LN_AVG		2
+#define LAT_LN_P50		3
+#define LAT_LN_P90		4
+#define LAT_LN_P99		5
+#define LAT_LN_MAX		6
+#define LAT_LN_BUCKET	7
+#define LAT_LINES		(LAT_LN_BUCKET + LAT_BUCKETS)
+
+/* upper bucket limits (in microseconds), the last bucket is open */
+static const long limit[LAT_BUCKETS - 1] = {
+	100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000,
+	100000, 200000, 500000, 1000000
+};
+
+static const char *bucket_label[LAT_BUCKETS] = {
+	"below 100 us", "100 - 200 us", "200 - 500 us", "0.5 - 1 ms",
+	"1 - 2 ms", "2 - 5 ms", "5 - 10 ms", "10 - 20 ms", "20 - 50 ms",
+	"50 - 100 ms", "100 - 200 ms", "200 - 500 ms", "0.5 - 1 s",
+	"1 s and more"
+};
+
+/* must correspond with LAT_XXX */
+static const char *op_name[LAT_OPS] = {
+	"screen", "action", "filter", "panel", "refresh"
+};
+
+typedef struct {
+	long cnt;					/* number of measured intervals */
+	long max;					/* the longest one */
+	long long total;			/* sum of all intervals */
+	long bucket[LAT_BUCKETS];	/* histogram */
+} LAT_STATS;
+
+typedef struct {
+	long long start, stop;		/* start and end of the measurement */
+	LAT_STATS op[LAT_OPS];
+} LAT_DATA;
+
+static LAT_DATA lat, snapshot;	/* live data, data in the panel */
+static FLAG enabled = 0;
+static long long idle = 0;		/* time of the last wait for the user */
+static long long keyq[LAT_KEYQ];/* keys waiting for a screen update */
+static int keycnt = 0;
+static const char *user_lat_file;
+
+/* current time in microseconds */
+static long long
+now_usec(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv,0);
+	return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void
+lat_reset(void)
+{
+	memset(&lat,0,sizeof(lat));
+	lat.start = idle = now_usec();
+	keycnt = 0;
+}
+
+void
+lat_reconfig(void)
+{
+	/* old data is kept for viewing when the measurement is turned off */
+	if ( (enabled = config_num(CFG_LATENCY_STATS)) )
+		lat_reset();
+	else {
+		lat.stop = now_usec();
+		keycnt = 0;
+	}
+}
+
+void
+lat_initialize(void)
+{
+	pathname_set_directory(clex_data.homedir);
+	user_lat_file = estrdup(pathname_join(".clexlatency"));
+	lat_reconfig();
+}
+
+static void
+lat_record(int op, long usec)
+{
+	int i;
+	LAT_STATS *ps;
+
+	ps = lat.op + op;
+	ps->cnt++;
+	ps->total += usec;
+	if (usec > ps->max)
+		ps->max = usec;
+	for (i = 0; i < LAT_BUCKETS - 1 && usec >= limit[i]; i++)
+		;
+	ps->bucket[i]++;
+}
+
+/*
+ * start of an interval to be measured by lat_end(),
+ * return value: 0 if the measurement is off
+ */
+long long
+lat_begin(void)
+{
+	return enabled ? now_usec() : 0;
+}
+
+void
+lat_end(int op, long long start)
+{
+	long long now;
+
+	/* start < idle: CLEX has waited for the user meanwhile */
+	if (start == 0 || start < idle)
+		return;
+	now = now_usec();
+	lat_record(op,(long)(now - start));
+}
+
+/* a key has been read */
+void
+lat_key(void)
+{
+	if (enabled && keycnt < LAT_KEYQ)
+		keyq[keycnt++] = now_usec();
+}
+
+/* the screen has been updated, all keys read so far are processed */
+void
+lat_screen(void)
+{
+	int i;
+	long long now;
+
+	if (keycnt == 0)
+		return;
+	now = now_usec();
+	for (i = 0; i < keycnt; i++)
+		if (keyq[i] >= idle)
+			lat_record(LAT_SCREEN,(long)(now - keyq[i]));
+	keycnt = 0;
+}
+
+/* CLEX is going to wait for the user or leave the curses mode */
+void
+lat_idle(void)
+{
+	if (enabled)
+		idle = now_usec();
+}
+
+static char *
+usec_str(char *buff, long usec)
+{
+	if (usec < 1000)
+		sprintf(buff,"%ld us",usec);
+	else if (usec < 1000000)
+		sprintf(buff,usec < 100000 && usec % 1000 >= 100 ?
+		  "%ld.%ld ms" : "%ld ms",usec / 1000,usec / 100 % 10);
+	else
+		sprintf(buff,usec % 1000000 >= 100000 ?
+		  "%ld.%ld s" : "%ld s",usec / 1000000,usec / 100000 % 10);
+	return buff;
+}
+
+/* upper limit of the bucket containing the percentile 'pct' */
+static char *
+percentile_str(char *buff, const LAT_STATS *ps, int pct)
+{
+	int i;
+	long sum, rank;
+
+	rank = (ps->cnt * pct + 99) / 100;
+	for (sum = i = 0; i < LAT_BUCKETS - 1; i++)
+		if ( (sum += ps->bucket[i]) >= rank)
+			break;
+	if (i == LAT_BUCKETS - 1)
+		return usec_str(buff,ps->max);
+	buff[0] = '<';
+	usec_str(buff + 1,limit[i]);
+	return buff;
+}
+
+static const char *
+line_label(int ln)
+{
+	static const char *label[LAT_LN_BUCKET] = {
+		"", "count", "average", "median", "90th percentile",
+		"99th percentile", "maximum"
+	};
+
+	return ln < LAT_LN_BUCKET ? label[ln] : bucket_label[ln - LAT_LN_BUCKET];
+}
+
+/* one line of the statistics table */
+static const char *
+lat_format(const LAT_DATA *pd, int ln)
+{
+	int i, len;
+	char cell[24];
+	const LAT_STATS *ps;
+	static char buff[32 + 12 * LAT_OPS];
+
+	len = sprintf(buff,"%-16s",line_label(ln));
+	for (i = 0; i < LAT_OPS; i++) {
+		ps = pd->op + i;
+		if (ln == 0)
+			strcpy(cell,op_name[i]);
+		else if (ln == LAT_LN_COUNT || ln >= LAT_LN_BUCKET)
+			sprintf(cell,"%ld",ln == LAT_LN_COUNT ?
+			  ps->cnt : ps->bucket[ln - LAT_LN_BUCKET]);
+		else if (ps->cnt == 0)
+			strcpy(cell,"-");
+		else if (ln == LAT_LN_AVG)
+			usec_str(cell,(long)(ps->total / ps->cnt));
+		else if (ln == LAT_LN_MAX)
+			usec_str(cell,ps->max);
+		else
+			percentile_str(cell,ps,
+			  ln == LAT_LN_P50 ? 50 : ln == LAT_LN_P90 ? 90 : 99);
+		len += sprintf(buff + len,"%10s",cell);
+	}
+	return buff;
+}
+
+const char *
+lat_line(int ln)
+{
+	return lat_format(&snapshot,ln);
+}
+
+/* summary for the information line */
+const char *
+lat_info(void)
+{
+	static char buff[80];
+
+	if (snapshot.start == 0)
+		return "  no data, the measurement is turned off (LATENCY_STATS)";
+	sprintf(buff,"  data collected during %s%s",
+	  duration_str((long)((snapshot.stop - snapshot.start) / 1000)),
+	  enabled ? "" : ", the measurement is turned off now");
+	return buff;
+}
+
+void
+lat_prepare(void)
+{
+	snapshot = lat;
+	if (enabled)
+		snapshot.stop = now_usec();
+	panel_lat.pd->cnt = LAT_LINES;
+	panel_lat.pd->top = panel_lat.pd->min;
+	panel_lat.pd->curs = 0;
+	panel = panel_lat.pd;
+	textline = 0;
+}
+
+/* clear the statistics */
+void
+cx_lat_reset(void)
+{
+	if (!enabled) {
+		win_remark("the measurement is turned off");
+		return;
+	}
+	lat_reset();
+	snapshot = lat;
+	snapshot.stop = lat.start;
+	win_panel();
+}
+
+/* write the displayed statistics to a file */
+void
+cx_lat_save(void)
+{
+	int ln;
+	FLAG errflag;
+	FILE *fp;
+
+	umask(clex_data.umask | 022);
+	fp = fopen(user_lat_file,"w");
+	umask(clex_data.umask);
+
+	if (fp == 0) {
+		win_warning("LATENCY: Cannot open the statistics file "
+		  "for writing.");
+		return;
+	}
+	fprintf(fp,	"#\n"
+				"# CLEX input latency statistics\n"
+				"#%s\n"
+				"#\n",lat_info() + 1);
+	for (ln = 0; ln < LAT_LINES; ln++)
+		fprintf(fp,"%s\n",lat_line(ln));
+	errflag = ferror(fp) != 0;
+	if (fclose(fp) || errflag)
+		win_warning("LATENCY: File write error occurred.");
+	else
+		win_remark_fmt("statistics written to %s",user_lat_file);
+}
@@ -0,0 +1,12 @@
+extern void lat_initialize(void);
+extern void lat_reconfig(void);
+extern long long lat_begin(void);
+extern void lat_end(int, long long);
+extern void lat_key(void);
+extern void lat_screen(void);
+extern void lat_idle(void);
+extern const char *lat_line(int);
+extern const char *lat_info(void);
+extern void lat_prepare(void);
+extern void cx_lat_reset(void);
+extern void cx_lat_save(void);
@@ -19,6 +19,7 @@
 #include <errno.h>			/* errno */
 #include <filter.h>			/* filter_update() */
 #include <stdio.h>			/* sprintf() */
+#include <stdlib.h>			/* free() */
 #include <string.h>			/* strcmp() */
 #include <unistd.h>			/* stat() */
 
@@ -62,6 +63,12 @@
 # define S_ISLNK(X)	(0)
 #endif
 
+/* inotify_add_watch() */
+#if defined(HAVE_SYS_INOTIFY_H) && defined(HAVE_INOTIFY_INIT1)
+# include <sys/inotify.h>
+# define USE_INOTIFY
+#endif
+
 #include "clex.h"
 #include "list.h"
 
@@ -88,6 +95,12 @@ extern int errno;
 static time_t now;
 static FLAG do_a, do_d, do_i, do_l, do_L, do_m, do_M, do_o, do_s;
 static FLAG clock24, use_pathname = 0;
+#ifdef USE_INOTIFY
+static int inotify_fd = -1;
+/* any change of a directory entry or of a file in the directory */
+# define WATCH_MASK	(IN_ATTRIB | IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE \
+  | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
 static char sep000;			/* thousands separator */
 static int tpad, dpad;		/* length of padding for time and date */
 static int K2;				/* kilobyte/2 */
@@ -99,8 +112,6 @@ static int ucache_cnt = 0, gcache_cnt = 0;
 void
 list_reconfig(void)
 {
-	const char *fields;
-	FLAG fld;
 	char ch;
 	int i, dlen, tlen;
 
@@ -172,30 +183,16 @@ list_reconfig(void)
 	}
 
 	/* which fields are going to be displayed ? */
-	do_a = do_d = do_i = do_l = 0;
-	do_L = do_m = do_M = do_o = do_s = 0;
-	for (fld = 0, fields = config_layout; (ch = *fields++); )
-		if (!TCLR(fld)) {
-			if (ch == '$')
-				fld = 1;
-		}
-		else {
-			switch (ch) {
-			case 'a': do_a = 1; break;
-			case 'd': do_d = 1; break;
-			case 'i': do_i = 1; break;
-			case 'L': do_L = 1; break;
-			case 'l': do_l = 1; break;
-			case 'P':					/* $P -> $M */
-			case 'M': do_M = 1; 		/* $M -> $m */
-			case 'p':					/* $p -> $m */
-			case 'm': do_m = 1; break;
-			case 'o': do_o = 1; break;
-			case 'S':					/* $S -> $s */
-			case 's': do_s = 1; break;
-			/* default:   ignore unknown formatting character */
-			}
-		}
+	win_layout_reconfig();		/* field widths depend on date_len */
+	do_a = win_layout_field('a');
+	do_d = win_layout_field('d');
+	do_i = win_layout_field('i');
+	do_l = win_layout_field('l');
+	do_L = win_layout_field('L');
+	do_M = win_layout_field('M') || win_layout_field('P');
+	do_m = do_M || win_layout_field('m') || win_layout_field('p');
+	do_o = win_layout_field('o');
+	do_s = win_layout_field('s') || win_layout_field('S');
 }
 
 void
@@ -203,6 +200,10 @@ list_initialize(void)
 {
 	normal_dir  = 0777 & ~clex_data.umask;	/* dir or executable file */
 	normal_file = 0666 & ~clex_data.umask;	/* any other file */
+#ifdef USE_INOTIFY
+	/* failure is not an error, the directories won't be watched */
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
 
 	list_reconfig();
 }
@@ -593,7 +594,10 @@ static int
 describe_file(const char *name, FILE_ENTRY *pfe)
 {
 	struct stat stdata;
+	static unsigned int generation = 0;
 
+	/* the displayed line must be re-rendered, see draw_line_file() */
+	pfe->gen = ++generation;
 	if (lstat(name,&stdata) < 0) {
 		if (errno == ENOENT)
 			return -1;		/* file deleted in the meantime */
@@ -633,6 +637,131 @@ dotfile(const char *name)
         return DOT_HIDDEN;
 }
 
+#ifdef USE_INOTIFY
+/* record a change reported by inotify */
+static void
+watch_change(PANEL_FILE *pfp, const struct inotify_event *pev)
+{
+	int i;
+	const char *name;
+
+	if (pfp->dirty < 0)
+		return;
+
+	/* only modifications of existing files can be handled individually */
+	if (pev->mask & ~(IN_ATTRIB | IN_CLOSE_WRITE | IN_MODIFY)) {
+		pfp->dirty = -1;
+		return;
+	}
+	/* no name = the directory itself, i.e. the "." entry */
+	name = pev->len ? pev->name : ".";
+	for (i = 0; i < pfp->dirty; i++)
+		if (strcmp(pfp->changed[i],name) == 0)
+			return;
+	if (pfp->dirty == WATCH_NAMES)
+		pfp->dirty = -1;
+	else
+		pfp->changed[pfp->dirty++] = estrdup(name);
+}
+
+/* process the queued inotify events */
+static void
+watch_events(void)
+{
+	int i;
+	ssize_t len;
+	char *ptr;
+	const struct inotify_event *pev;
+	PANEL_FILE *pfp[2];
+	union {
+		struct inotify_event ev;
+		char buff[4096];
+	} ev;
+
+	pfp[0] = ppanel_file;
+	pfp[1] = ppanel_file->other;
+	while ((len = read(inotify_fd,ev.buff,sizeof(ev.buff))) > 0)
+		for (ptr = ev.buff; ptr < ev.buff + len;
+		  ptr += sizeof(struct inotify_event) + pev->len) {
+			pev = (const struct inotify_event *)ptr;
+			for (i = 0; i < 2; i++)
+				if (pev->mask & IN_Q_OVERFLOW)
+					pfp[i]->dirty = -1;
+				else if (pev->wd == pfp[i]->watch)
+					watch_change(pfp[i],pev);
+		}
+}
+
+/* forget the recorded changes */
+static void
+watch_reset(PANEL_FILE *pfp)
+{
+	int i;
+
+	for (i = 0; i < pfp->dirty; i++)
+		free(pfp->changed[i]);
+	pfp->dirty = 0;
+}
+#endif
+
+/*
+ * start watching the directory of the current panel, the panel
+ * is clean afterwards, i.e. it is up to date as long as no event
+ * arrives
+ */
+static void
+watch_start(const char *dir)
+{
+#ifdef USE_INOTIFY
+	int wd;
+	PANEL_FILE *pfp;
+
+	pfp = ppanel_file;
+	if (inotify_fd < 0)
+		return;
+	watch_events();
+	/* the same directory in both panels gets the same descriptor */
+	wd = inotify_add_watch(inotify_fd,dir,WATCH_MASK);
+	if (pfp->watch >= 0 && pfp->watch != wd
+	  && pfp->watch != pfp->other->watch)
+		inotify_rm_watch(inotify_fd,pfp->watch);
+	pfp->watch = wd;
+	watch_reset(pfp);
+	if (wd < 0)
+		pfp->dirty = -1;
+#endif
+}
+
+/*
+ * watch_check() returns the number of files changed in the directory
+ * of the panel 'pfp' since its last read (their names are listed
+ * in pfp->changed), 0 = no change at all, -1 = unknown
+ */
+static int
+watch_check(PANEL_FILE *pfp)
+{
+#ifdef USE_INOTIFY
+	if (inotify_fd < 0 || pfp->watch < 0)
+		return -1;
+	watch_events();
+	return pfp->dirty;
+#else
+	return -1;
+#endif
+}
+
+/*
+ * watch_blind() returns 1 if the data displayed for the entry 'pfe'
+ * can change without an event in the watched directory: changes
+ * in a subdirectory modify its time and size, a symbolic link
+ * shows the data of its target which might be located elsewhere
+ */
+static int
+watch_blind(const FILE_ENTRY *pfe)
+{
+	return IS_FT_DIR(pfe->file_type) || pfe->symlink;
+}
+
 /*
  * We abandoned any form of caching and always build the file
  * panel from scratch. No caching algorithm was 100% perfect,
@@ -651,6 +780,7 @@ directory_read(void)
 	const char *name;
 
 	name = USTR(ppanel_file->dir);
+	ppanel_file->timestamp = 0;
 	if (stat(name,&st) < 0 || (dd = opendir(name)) == 0) {
 		ppanel_file->pd->cnt = ppanel_file->selected = 0;
 		win_warning("LIST DIR: Cannot list the contents "
@@ -658,6 +788,13 @@ directory_read(void)
 		return;
 	}
 	dirdev = st.st_dev;
+	ppanel_file->dir_dev = st.st_dev;
+	ppanel_file->dir_ino = st.st_ino;
+	ppanel_file->dir_mtime = st.st_mtime;
+	ppanel_file->dir_ctime = st.st_ctime;
+	ppanel_file->dir_nlink = st.st_nlink;
+	ppanel_file->dir_size = st.st_size;
+	watch_start(name);
 	hide = config_num(CFG_SHOW_HIDDEN) == HIDE_ALWAYS
 		|| (config_num(CFG_SHOW_HIDDEN) == HIDE_HOME
 		    && strcmp(USTR(ppanel_file->dir),clex_data.homedir) == 0);
@@ -725,13 +862,62 @@ directory_read(void)
 		cnt2++;
 	}
 	ppanel_file->pd->cnt = cnt2;
+	ppanel_file->timestamp = now;
 
 	closedir(dd);
 }
 
+/*
+ * directory_restat() is a faster replacement for directory_read()
+ * when the list of files is known to be up to date: it only updates
+ * the information about the files already listed in the panel, or
+ * just about the files reported by inotify as changed and about
+ * the entries inotify cannot see, see watch_blind()
+ */
+static void
+directory_restat(void)
+{
+	int i, j, nchg;
+	FILE_ENTRY *pfe;
+	const char *name;
+	char *changed[WATCH_NAMES];
+
+	/* take over the list of changes before the watch is restarted */
+	nchg = ppanel_file->dirty;
+	for (j = 0; j < nchg; j++)
+		changed[j] = ppanel_file->changed[j];
+	ppanel_file->dirty = 0;
+	watch_start(USTR(ppanel_file->dir));
+
+	if (nchg < 0)
+		win_waitmsg();
+	for (i = 0; i < ppanel_file->pd->cnt; i++) {
+		pfe = ppanel_file->files[i];
+		name = SDSTR(pfe->file);
+		if (nchg == 0 && !watch_blind(pfe))
+			continue;
+		if (nchg > 0 && !watch_blind(pfe)) {
+			for (j = 0; j < nchg; j++)
+				if (strcmp(changed[j],name) == 0)
+					break;
+			if (j == nchg)
+				continue;
+		}
+		if (describe_file(use_pathname ? pathname_join(name) : name,
+		  pfe) < 0) {
+			/* the file has disappeared meanwhile */
+			directory_read();
+			break;
+		}
+	}
+	for (j = 0; j < nchg; j++)
+		free(changed[j]);
+	ppanel_file->timestamp = now;
+}
+
 /* directory read wrapper */
 static void
-filepanel_read(void)
+filepanel_read(FLAG restat)
 {
 	filepos_save();
 	if (ppanel_file->pd->filtering) {
@@ -739,7 +925,10 @@ filepanel_read(void)
 		ppanel_file->pd->cnt = ppanel_file->filt_cnt;
 		ppanel_file->selected += ppanel_file->filt_sel;
 	}
-	directory_read();
+	if (restat)
+		directory_restat();
+	else
+		directory_read();
 	if (ppanel_file->pd->filtering) {
 		/* resume filtering */
 		ppanel_file->filt_cnt = ppanel_file->pd->cnt;
@@ -748,7 +937,7 @@ filepanel_read(void)
 	else
 		sort_files();
 	filepos_set();
-	ppanel_file->expired = 0;
+	ppanel_file->expired = ppanel_file->outdated = 0;
 }
 
 void
@@ -762,7 +951,70 @@ list_directory(void)
 		ucache_cnt = gcache_cnt = 0;
 	}
 
-	filepanel_read();
+	filepanel_read(0);
+}
+
+/*
+ * list_refresh() is to be called after a command execution, the
+ * command might have changed the directory or not; the panel is
+ * re-read only when necessary:
+ *   - no change (as reported by inotify) -> update the file info
+ *     of directories and symbolic links only, see watch_blind(),
+ *     nothing to do if there are none
+ *   - the same files (see list_fresh())  -> update the file info
+ *   - otherwise                          -> read the directory
+ */
+void
+list_refresh(void)
+{
+	int i, cnt;
+
+	now = time(0);
+
+	if (userdata_refresh()) {
+		ppanel_file->other->expired = 1;
+		ucache_cnt = gcache_cnt = 0;
+		filepanel_read(0);
+		return;
+	}
+
+	if (!list_fresh(ppanel_file))
+		filepanel_read(0);
+	else if (watch_check(ppanel_file) == 0) {
+		cnt = ppanel_file->pd->filtering ?
+		  ppanel_file->filt_cnt : ppanel_file->pd->cnt;
+		for (i = 0; i < cnt; i++)
+			if (watch_blind(ppanel_file->files[i]))
+				break;
+		if (i < cnt)
+			filepanel_read(1);
+		else {
+			/* put the cwd to the top of the list like the others do */
+			filepos_save();
+			ppanel_file->outdated = 0;
+		}
+	}
+	else
+		filepanel_read(1);
+}
+
+/*
+ * list_fresh() returns 1 if no file was created, deleted or renamed
+ * in the directory of the panel 'pfp' since its last read, i.e. the
+ * list of names and file types in the panel is up to date; changes
+ * made within the same second as the read cannot be ruled out
+ */
+int
+list_fresh(PANEL_FILE *pfp)
+{
+	struct stat st;
+
+	return !pfp->expired && pfp->timestamp
+	  && stat(USTR(pfp->dir),&st) == 0
+	  && st.st_dev == pfp->dir_dev && st.st_ino == pfp->dir_ino
+	  && st.st_mtime == pfp->dir_mtime && st.st_ctime == pfp->dir_ctime
+	  && st.st_nlink == pfp->dir_nlink && st.st_size == pfp->dir_size
+	  && st.st_mtime < pfp->timestamp && st.st_ctime < pfp->timestamp;
 }
 
 void
@@ -776,7 +1028,7 @@ list_both_directories(void)
 	if (userdata_refresh())
 		ucache_cnt = gcache_cnt = 0;
 
-	filepanel_read();
+	filepanel_read(0);
 	panel = ppanel_file->pd;
 	if (panel->filtering)
 		filter_update();
@@ -789,7 +1041,7 @@ list_both_directories(void)
 	ppanel_file = ppanel_file->other;
 	pathname_set_directory(USTR(ppanel_file->dir));
 	use_pathname = 1;	/* must prepend directory name */
-	filepanel_read();
+	filepanel_read(0);
 	panel = ppanel_file->pd;
 	if (panel->filtering)
 		filter_update();
@@ -1,5 +1,7 @@
 extern void list_reconfig(void);
 extern void list_initialize(void);
 extern void list_directory(void);
+extern void list_refresh(void);
+extern int  list_fresh(PANEL_FILE *);
 extern void list_both_directories(void);
 extern int  stat2type(mode_t, uid_t);
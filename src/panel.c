@@ -19,7 +19,7 @@
 #include "clex.h"
 #include "panel.h"
 
-#include "inout.h"		/* win_panel_opt() */
+#include "inout.h"		/* win_panel_move() */
 
 void
 cx_pan_up(void)
@@ -27,7 +27,7 @@ cx_pan_up(void)
 	if (panel->curs > panel->min) {
 		panel->curs--;
 		LIMIT_MAX(panel->top,panel->curs);
-		win_panel_opt();
+		win_panel_move();
 	}
 }
 
@@ -37,7 +37,7 @@ cx_pan_down(void)
 	if (panel->curs < panel->cnt - 1) {
 		panel->curs++;
 		LIMIT_MIN(panel->top,panel->curs - display.panlines + 1);
-		win_panel_opt();
+		win_panel_move();
 	}
 }
 
@@ -45,7 +45,7 @@ void
 cx_pan_home(void)
 {
 	panel->top = panel->curs = panel->min;
-	win_panel_opt();
+	win_panel_move();
 }
 
 void
@@ -53,7 +53,7 @@ cx_pan_end(void)
 {
 	panel->curs = panel->cnt - 1;
 	LIMIT_MIN(panel->top,panel->curs - display.panlines + 1);
-	win_panel_opt();
+	win_panel_move();
 }
 
 void
@@ -67,7 +67,7 @@ cx_pan_pgup(void)
 			LIMIT_MIN(panel->curs,panel->min);
 			panel->top = panel->curs;
 		}
-		win_panel_opt();
+		win_panel_move();
 	}
 }
 
@@ -81,7 +81,7 @@ cx_pan_pgdown(void)
 			panel->curs += display.panlines;
 		LIMIT_MAX(panel->curs,panel->cnt - 1);
 		LIMIT_MIN(panel->top,panel->curs - display.panlines + 1);
-		win_panel_opt();
+		win_panel_move();
 	}
 }
 
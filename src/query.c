@@ -0,0 +1,443 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2006 Vlado Potisk <vlado_potisk@clex.sk>
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from http://www.clex.sk
+ *
+ */
+
+/*
+ * query.c implements attribute queries used to select files, e.g.
+ *     size>1G && mtime>7d && type=plain && owner=build
+ *
+ * A query is compiled once into a list of terms. The attributes
+ * needed by the terms are copied from the file panel entries into
+ * columns (plain arrays) and each term is evaluated over a whole
+ * column in a simple loop the compiler can vectorize. Large panels
+ * are divided into slices evaluated by the worker threads.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>	/* clex.h */
+#include <ctype.h>		/* isspace() */
+#include <grp.h>		/* getgrnam() */
+#include <pwd.h>		/* getpwnam() */
+#include <stdlib.h>		/* strtoll() */
+#include <string.h>		/* strncmp() */
+#include <time.h>		/* time() */
+
+#include "clex.h"
+#include "query.h"
+
+#include "inout.h"		/* win_warning_fmt() */
+#include "match.h"		/* match() */
+#include "sdstring.h"	/* SDSTR() */
+#include "ustring.h"	/* us_setsize() */
+#include "util.h"		/* emalloc() */
+#include "workers.h"	/* work_run() */
+
+/* attributes */
+#define Q_SIZE		0
+#define Q_MTIME		1
+#define Q_TYPE		2
+#define Q_OWNER		3
+#define Q_GROUP		4
+#define Q_NAME		5
+#define Q_COLUMNS	5	/* all attributes except the name */
+
+/* operators */
+#define OP_EQ		0
+#define OP_NE		1
+#define OP_LT		2
+#define OP_LE		3
+#define OP_GT		4
+#define OP_GE		5
+
+/* file type classes (bits) */
+#define QT_PLAIN	1
+#define QT_EXEC		2
+#define QT_DIR		4
+#define QT_DEV		8
+#define QT_FIFO		16
+#define QT_SOCKET	32
+#define QT_LINK		64
+
+/* max number of terms in a query */
+#define Q_TERMS		16
+/* panel entries processed by one job */
+#define Q_SLICE		65536
+
+typedef struct {
+	CODE attr;				/* Q_XXX */
+	CODE op;				/* OP_XXX */
+	long long value;
+} Q_TERM;
+
+static Q_TERM term[Q_TERMS];
+static int term_cnt;
+static FLAG use_name;			/* there is a name pattern term */
+static FLAG name_ne;			/* name!=pattern */
+static FLAG use_column[Q_COLUMNS];
+static long long *column[Q_COLUMNS];
+
+static FILE_ENTRY **q_files;	/* the panel being evaluated */
+static int q_cnt;
+
+static const struct {
+	const char *name;
+	int type;
+} typenames[] = {
+	{ "plain",	QT_PLAIN	},
+	{ "exec",	QT_EXEC		},
+	{ "dir",	QT_DIR		},
+	{ "dev",	QT_DEV		},
+	{ "fifo",	QT_FIFO		},
+	{ "socket",	QT_SOCKET	},
+	{ "link",	QT_LINK		},
+	{ 0, 0 }
+};
+
+static int
+type_class(const FILE_ENTRY *pfe)
+{
+	int class;
+
+	class = pfe->symlink ? QT_LINK : 0;
+	if (IS_FT_PLAIN(pfe->file_type))
+		class |= QT_PLAIN;
+	if (IS_FT_EXEC(pfe->file_type))
+		class |= QT_EXEC;
+	else if (IS_FT_DIR(pfe->file_type))
+		class |= QT_DIR;
+	else if (IS_FT_DEV(pfe->file_type))
+		class |= QT_DEV;
+	else if (pfe->file_type == FT_FIFO)
+		class |= QT_FIFO;
+	else if (pfe->file_type == FT_SOCKET)
+		class |= QT_SOCKET;
+	return class;
+}
+
+/* number with an optional suffix, 'unit' = multiplier of each suffix */
+static int
+number(const char *str, const char *suffix, const long long *unit,
+  long long *pval)
+{
+	char *end;
+	const char *s;
+
+	if (!isdigit((unsigned char)*str))
+		return -1;
+	*pval = strtoll(str,&end,10);
+	if (*end == '\0')
+		return 0;
+	if (end[1] != '\0' || (s = strchr(suffix,tolower((unsigned char)*end)))
+	  == 0)
+		return -1;
+	*pval *= unit[s - suffix];
+	return 0;
+}
+
+static int
+parse_value(Q_TERM *pt, const char *str)
+{
+	static const long long size_unit[] = {
+		1, 1024LL, 1024LL * 1024, 1024LL * 1024 * 1024,
+		1024LL * 1024 * 1024 * 1024
+	};
+	static const long long time_unit[] = {
+		1, 60, 3600, 86400, 7 * 86400
+	};
+	int i;
+	struct passwd *pw;
+	struct group *gr;
+
+	switch (pt->attr) {
+	case Q_SIZE:
+		return number(str,"bkmgt",size_unit,&pt->value);
+	case Q_MTIME:
+		if (number(str,"smhdw",time_unit,&pt->value) < 0)
+			return -1;
+		/* the age is compared, convert it to a time */
+		pt->value = (long long)time(0) - pt->value;
+		pt->op = pt->op == OP_LT ? OP_GT : pt->op == OP_LE ? OP_GE
+		  : pt->op == OP_GT ? OP_LT : pt->op == OP_GE ? OP_LE : pt->op;
+		return 0;
+	case Q_TYPE:
+		for (i = 0; typenames[i].name; i++)
+			if (strcmp(str,typenames[i].name) == 0) {
+				pt->value = typenames[i].type;
+				return 0;
+			}
+		return -1;
+	case Q_OWNER:
+		if (number(str,"",0,&pt->value) == 0)
+			return 0;
+		if ( (pw = getpwnam(str)) == 0)
+			return -1;
+		pt->value = pw->pw_uid;
+		return 0;
+	case Q_GROUP:
+		if (number(str,"",0,&pt->value) == 0)
+			return 0;
+		if ( (gr = getgrnam(str)) == 0)
+			return -1;
+		pt->value = gr->gr_gid;
+		return 0;
+	}
+	/* Q_NAME */
+	return match_sre(str);
+}
+
+/*
+ * query_compile() compiles the query 'str', errors are reported
+ * to the user
+ *
+ * return value: 0 = ok, -1 = error
+ */
+int
+query_compile(const char *str)
+{
+	static const char *attrnames[] = {
+		"size", "mtime", "type", "owner", "group", "name", 0
+	};	/* must correspond with Q_XXX */
+	static const char *opnames[] = {
+		/* two character operators first */
+		"!=", "<=", ">=", "=", "<", ">", 0
+	};
+	static const CODE opcodes[] = {
+		OP_NE, OP_LE, OP_GE, OP_EQ, OP_LT, OP_GT
+	};
+	static USTRING value = { 0,0 };
+	static char *pattern = 0;
+	int i;
+	size_t len;
+	const char *end;
+	char *val;
+	Q_TERM *pt;
+
+	term_cnt = 0;
+	use_name = 0;
+	for (i = 0; i < Q_COLUMNS; i++)
+		use_column[i] = 0;
+
+	for (;;) {
+		while (isspace((unsigned char)*str))
+			str++;
+		if (term_cnt == Q_TERMS) {
+			win_warning("SYNTAX CHECK: Too many conditions.");
+			return -1;
+		}
+		pt = term + term_cnt;
+
+		for (i = 0; attrnames[i]; i++) {
+			len = strlen(attrnames[i]);
+			if (strncmp(str,attrnames[i],len) == 0
+			  && !isalpha((unsigned char)str[len]))
+				break;
+		}
+		if (attrnames[i] == 0) {
+			win_warning("SYNTAX CHECK: Unknown attribute, use size, "
+			  "mtime, type, owner, group or name.");
+			return -1;
+		}
+		pt->attr = i;
+		for (str += len; isspace((unsigned char)*str); str++)
+			;
+
+		for (i = 0; opnames[i]; i++) {
+			len = strlen(opnames[i]);
+			if (strncmp(str,opnames[i],len) == 0)
+				break;
+		}
+		if (opnames[i] == 0) {
+			win_warning_fmt("SYNTAX CHECK: Missing operator after '%s'.",
+			  attrnames[pt->attr]);
+			return -1;
+		}
+		pt->op = opcodes[i];
+		if ((pt->attr == Q_TYPE || pt->attr == Q_OWNER
+		  || pt->attr == Q_GROUP || pt->attr == Q_NAME)
+		  && pt->op != OP_EQ && pt->op != OP_NE) {
+			win_warning_fmt("SYNTAX CHECK: Only = and != can be used "
+			  "with '%s'.",attrnames[pt->attr]);
+			return -1;
+		}
+		if (pt->attr == Q_NAME && use_name) {
+			win_warning("SYNTAX CHECK: Only one name condition "
+			  "is allowed.");
+			return -1;
+		}
+		for (str += len; isspace((unsigned char)*str); str++)
+			;
+
+		/* the value ends with && or at the end of the query */
+		if ( (end = strstr(str,"&&")) == 0)
+			end = str + strlen(str);
+		for (len = end - str; len > 0 && isspace((unsigned char)str[len - 1]);
+		  len--)
+			;
+		us_setsize(&value,len + 1);
+		val = USTR(value);
+		memcpy(val,str,len);
+		val[len] = '\0';
+		if (pt->attr == Q_NAME) {
+			/* match() keeps a pointer to the pattern */
+			free(pattern);
+			pattern = estrdup(val);
+			if (parse_value(pt,pattern) < 0)
+				return -1;
+			use_name = 1;
+			name_ne = pt->op == OP_NE;
+		}
+		else {
+			if (len == 0 || parse_value(pt,val) < 0) {
+				win_warning_fmt("SYNTAX CHECK: Invalid %s value '%s'.",
+				  attrnames[pt->attr],val);
+				return -1;
+			}
+			use_column[pt->attr] = 1;
+			term_cnt++;
+		}
+
+		if (*end == '\0')
+			return 0;
+		str = end + 2;
+	}
+}
+
+/* copy the attributes of entries 'from' to 'to'-1 into the columns */
+static void
+extract(int from, int to)
+{
+	int i;
+	long long *col;
+
+	if ( (col = column[Q_SIZE]) )
+		for (i = from; i < to; i++)
+			col[i] = q_files[i]->size;
+	if ( (col = column[Q_MTIME]) )
+		for (i = from; i < to; i++)
+			col[i] = q_files[i]->mtime;
+	if ( (col = column[Q_TYPE]) )
+		for (i = from; i < to; i++)
+			col[i] = type_class(q_files[i]);
+	if ( (col = column[Q_OWNER]) )
+		for (i = from; i < to; i++)
+			col[i] = q_files[i]->uid;
+	if ( (col = column[Q_GROUP]) )
+		for (i = from; i < to; i++)
+			col[i] = q_files[i]->gid;
+}
+
+/* evaluate one term over entries 'from' to 'to'-1 */
+static void
+eval_term(const Q_TERM *pt, char *res, int from, int to)
+{
+	int i;
+	long long v;
+	const long long *col;
+
+	col = column[pt->attr];
+	v = pt->value;
+	if (pt->attr == Q_TYPE) {
+		if (pt->op == OP_EQ)
+			for (i = from; i < to; i++)
+				res[i] &= (col[i] & v) != 0;
+		else
+			for (i = from; i < to; i++)
+				res[i] &= (col[i] & v) == 0;
+		return;
+	}
+	switch (pt->op) {
+	case OP_EQ:
+		for (i = from; i < to; i++)
+			res[i] &= col[i] == v;
+		break;
+	case OP_NE:
+		for (i = from; i < to; i++)
+			res[i] &= col[i] != v;
+		break;
+	case OP_LT:
+		for (i = from; i < to; i++)
+			res[i] &= col[i] < v;
+		break;
+	case OP_LE:
+		for (i = from; i < to; i++)
+			res[i] &= col[i] <= v;
+		break;
+	case OP_GT:
+		for (i = from; i < to; i++)
+			res[i] &= col[i] > v;
+		break;
+	case OP_GE:
+		for (i = from; i < to; i++)
+			res[i] &= col[i] >= v;
+	}
+}
+
+/*
+ * job function: evaluate the terms over one slice of the panel,
+ * 'data' is the result array
+ */
+static void
+eval_slice(void *data, int slice)
+{
+	int i, from, to;
+	char *res;
+
+	res = data;
+	from = slice * Q_SLICE;
+	to = from + Q_SLICE < q_cnt ? from + Q_SLICE : q_cnt;
+	extract(from,to);
+	for (i = from; i < to; i++)
+		res[i] = 1;
+	for (i = 0; i < term_cnt; i++)
+		eval_term(term + i,res,from,to);
+}
+
+/*
+ * query_eval() evaluates the compiled query for 'cnt' entries
+ * 'files'; result[i] is set to 1 if files[i] matches, 0 otherwise
+ *
+ * return value: 0 = ok, -1 = cancelled by the user
+ */
+int
+query_eval(FILE_ENTRY **files, int cnt, char *result)
+{
+	int i, slices;
+
+	q_files = files;
+	q_cnt = cnt;
+	for (i = 0; i < Q_COLUMNS; i++)
+		column[i] = use_column[i] && cnt ?
+		  emalloc(cnt * sizeof(long long)) : 0;
+
+	slices = (cnt + Q_SLICE - 1) / Q_SLICE;
+	if (slices <= 1) {
+		if (cnt)
+			eval_slice(result,0);
+	}
+	else if (work_run(slices,eval_slice,result,0) < 0)
+		cnt = -1;
+
+	for (i = 0; i < Q_COLUMNS; i++)
+		free(column[i]);
+
+	if (cnt < 0)
+		return -1;
+
+	/* match() is not thread-safe, the name is checked last */
+	if (use_name)
+		for (i = 0; i < cnt; i++)
+			if (result[i] && match(SDSTR(files[i]->file)) == name_ne)
+				result[i] = 0;
+	return 0;
+}
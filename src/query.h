@@ -0,0 +1,2 @@
+extern int query_compile(const char *);
+extern int query_eval(FILE_ENTRY **, int, char *);
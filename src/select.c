@@ -19,20 +19,24 @@
 #include <fcntl.h>		/* open() */
 #include <stdlib.h>		/* qsort() */
 #include <string.h>		/* strcpy() */
+#include <time.h>		/* time() */
 #include <unistd.h>		/* close() */
 
 #include "clex.h"
 #include "select.h"
 
 #include "control.h"	/* get_current_mode() */
+#include "digest.h"		/* digest_lookup() */
 #include "edit.h"		/* edit_putstr() */
 #include "inout.h"		/* win_panel() */
 #include "match.h"		/* match() */
 #include "list.h"		/* list_both_directories() */
+#include "query.h"		/* query_compile() */
 #include "sdstring.h"	/* SDSTR() */
-#include "sort.h"		/* sort_files() */
+#include "treecmp.h"	/* tree_compare() */
 #include "ustring.h"	/* USTR() */
 #include "util.h"		/* pathname_join() */
+#include "workers.h"	/* work_run() */
 
 #define FN_SELECT	1
 #define FN_DESELECT	2
@@ -118,6 +122,34 @@ void cx_select_invert(void)		{ process_all(FN_TOGGLE);   }
 void cx_select_allfiles(void)	{ process_all(FN_SELECT);   }
 void cx_select_nofiles(void)	{ process_all(FN_DESELECT); }
 
+/* select or deselect files matching an attribute query, see query.c */
+static void
+select_query(const char *query, int fn)
+{
+	int i, cnt;
+	static int result_alloc = 0;
+	static char *result;
+
+	if (query_compile(query) < 0)
+		/* return and correct the error */
+		return;
+
+	if ( (cnt = ppanel_file->pd->cnt) > result_alloc) {
+		free(result);
+		result_alloc = cnt;
+		result = emalloc(cnt);
+	}
+	if (query_eval(ppanel_file->files,cnt,result) < 0)
+		win_remark("selection cancelled");
+	else
+		for (i = 0; i < cnt; i++)
+			if (result[i])
+				ppanel_file->selected +=
+				  selectfile(ppanel_file->files[i],fn);
+	win_panel();
+	next_mode = MODE_SPECIAL_RETURN;
+}
+
 void
 cx_select_files(void)
 {
@@ -130,10 +162,6 @@ cx_select_files(void)
 		next_mode = MODE_SPECIAL_RETURN;
 		return;
 	}
-	sre = USTR(textline->line);
-	if (match_sre(sre) < 0)
-		/* return and correct the error */
-		return;
 
 	if (get_current_mode() == MODE_SELECT) {
 		select = 1; fn = FN_SELECT;
@@ -141,6 +169,17 @@ cx_select_files(void)
 	else {
 		select = 0; fn = FN_DESELECT;
 	}
+
+	sre = USTR(textline->line);
+	if (*sre == '=') {
+		/* =attribute query */
+		select_query(sre + 1,fn);
+		return;
+	}
+	if (match_sre(sre) < 0)
+		/* return and correct the error */
+		return;
+
 	for (i = 0; i < ppanel_file->pd->cnt; i++) {
 		pfe = ppanel_file->files[i];
 		if (select == !pfe->select && match(SDSTR(pfe->file)))
@@ -159,60 +198,220 @@ qcmp(const void *e1, const void *e2)
 	  SDSTR((*(FILE_ENTRY **)e2)->file));
 }
 
-#define CMP_BUF_STR	16384
+/*
+ * name_index() fills '*pidx' with pointers to the panel entries
+ * sorted by name; the panel itself is not reordered
+ */
+static void
+name_index(PANEL_FILE *pfp, FILE_ENTRY ***pidx, int *palloc)
+{
+	int i, cnt;
+	FLAG sorted;
+	FILE_ENTRY **idx;
+
+	if ( (cnt = pfp->pd->cnt) > *palloc) {
+		free(*pidx);
+		*palloc = cnt;
+		*pidx = emalloc(cnt * sizeof(FILE_ENTRY *));
+	}
+	idx = *pidx;
+	for (sorted = 1, i = 0; i < cnt; i++) {
+		idx[i] = pfp->files[i];
+		if (sorted && i > 0 && qcmp(idx + i - 1,idx + i) > 0)
+			sorted = 0;
+	}
+	/* the panel is often sorted by name already */
+	if (!sorted)
+		qsort(idx,cnt,sizeof(FILE_ENTRY *),qcmp);
+}
+
+/* files are compared in windows of CMP_WINDOW bytes */
+#define CMP_WINDOW	(1024 * 1024)
 
-/* return value: -1 error, 0 compare ok, +1 compare failed */
+/* a pair of files to be compared by contents */
+typedef struct {
+	FILE_ENTRY *pfe1, *pfe2;	/* primary and secondary panel entry */
+	char *file1, *file2;		/* pathnames of the files */
+	int result;					/* file_cmp() return value */
+	struct stat st1, st2;		/* status of both files */
+	DIGEST dg1, dg2;			/* digests of both files */
+	FLAG new1, new2;			/* digest computed, not found in the cache */
+} CMP_JOB;
+
+/*
+ * data_cmp() and file_cmp() are executed by worker threads
+ * return value: -1 error, 0 compare ok, +1 compare failed
+ *
+ * Files with digests in the cache are not read. Files without
+ * a cached digest are read entirely (even if a difference was found)
+ * in order to compute their digests.
+ */
 static int
-data_cmp(int fd1, int fd2)
+data_cmp(CMP_JOB *pj, int fd1, int fd2)
 {
-	struct stat st1, st2;
-	static char buff1[CMP_BUF_STR], buff2[CMP_BUF_STR];
-	off_t filesize;
-	size_t chunksize;
-
-	if (fstat(fd1,&st1) < 0 || !S_ISREG(st1.st_mode))
+	char *buff1, *buff2;
+	off_t filesize, offset;
+	size_t window, chunksize;
+	int cmp;
+	FLAG known1, known2;
+	DIGEST_CTX ctx1, ctx2;
+
+	if (fstat(fd1,&pj->st1) < 0 || !S_ISREG(pj->st1.st_mode))
 		return -1;
-	if (fstat(fd2,&st2) < 0 || !S_ISREG(st2.st_mode))
+	if (fstat(fd2,&pj->st2) < 0 || !S_ISREG(pj->st2.st_mode))
 		return -1;
-	if (st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino)
+	if (pj->st1.st_dev == pj->st2.st_dev && pj->st1.st_ino == pj->st2.st_ino) {
 		/* same file */
+		work_add(pj->st1.st_size);
 		return 0;
-	if ((filesize = st1.st_size) != st2.st_size)
+	}
+	if ((filesize = pj->st1.st_size) != pj->st2.st_size)
 		return 1;
+	if (filesize == 0)
+		return 0;
 
-	while (filesize > 0) {
-		chunksize = filesize > CMP_BUF_STR ? CMP_BUF_STR : filesize;
-		if ( read_fd(fd1,buff1,chunksize) != chunksize
-		  || read_fd(fd2,buff2,chunksize) != chunksize)
-			return -1;
-		if (memcmp(buff1,buff2,chunksize) != 0)
-			return 1;
-		filesize -= chunksize;
+	known1 = digest_lookup(&pj->st1,&pj->dg1);
+	known2 = digest_lookup(&pj->st2,&pj->dg2);
+	if (known1 && known2) {
+		work_add(filesize);
+		return pj->dg1 != pj->dg2;
+	}
+	if (!known1)
+		digest_init(&ctx1);
+	if (!known2)
+		digest_init(&ctx2);
+
+	window = filesize > CMP_WINDOW ? CMP_WINDOW : filesize;
+	/* malloc() and not emalloc(), see workers.c */
+	if ( (buff1 = malloc(2 * window)) == 0)
+		return -1;
+	buff2 = buff1 + window;
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise(fd1,0,0,POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(fd2,0,0,POSIX_FADV_SEQUENTIAL);
+#endif
+
+	for (cmp = 0, offset = 0; cmp >= 0 && offset < filesize;
+	  offset += chunksize) {
+		if (work_cancelled()) {
+			cmp = -1;
+			break;
+		}
+		chunksize = filesize - offset > window ? window : filesize - offset;
+		if ((!known1 && read_at(fd1,buff1,chunksize,offset) < 0)
+		  || (!known2 && read_at(fd2,buff2,chunksize,offset) < 0)) {
+			cmp = -1;
+			break;
+		}
+		if (!known1)
+			digest_update(&ctx1,buff1,chunksize);
+		if (!known2)
+			digest_update(&ctx2,buff2,chunksize);
+		if (cmp == 0 && !known1 && !known2
+		  && memcmp(buff1,buff2,chunksize) != 0)
+			cmp = 1;
+		work_add(chunksize);
 	}
+	free(buff1);
+	if (cmp < 0)
+		return -1;
 
-	return 0;
+	if (!known1) {
+		pj->dg1 = digest_final(&ctx1);
+		pj->new1 = 1;
+	}
+	if (!known2) {
+		pj->dg2 = digest_final(&ctx2);
+		pj->new2 = 1;
+	}
+	/* one of the files was not read, compare the digests */
+	return (known1 || known2) ? pj->dg1 != pj->dg2 : cmp;
 }
 
-/* return value: -1 error, 0 compare ok, +1 compare failed */
 static int
-file_cmp(const char *file1, const char *file2)
+file_cmp(CMP_JOB *pj)
 {
 	int cmp, fd1, fd2;
 
-	fd1 = open(file1,O_RDONLY | O_NONBLOCK);
+	fd1 = open(pj->file1,O_RDONLY | O_NONBLOCK);
 	if (fd1 < 0)
 		return -1;
-	fd2 = open(file2,O_RDONLY | O_NONBLOCK);
+	fd2 = open(pj->file2,O_RDONLY | O_NONBLOCK);
 	if (fd2 < 0) {
 		close(fd1);
 		return -1;
 	}
-	cmp = data_cmp(fd1,fd2);
+	cmp = data_cmp(pj,fd1,fd2);
 	close(fd1);
 	close(fd2);
 	return cmp;
 }
 
+/* worker pool job function */
+static void
+cmp_job(void *data, int i)
+{
+	CMP_JOB *pj;
+
+	pj = (CMP_JOB *)data + i;
+	pj->result = file_cmp(pj);
+}
+
+/*
+ * run the prepared jobs, cache the computed digests
+ * return value: 0 = ok, -1 = cancelled
+ */
+static int
+cmp_run(CMP_JOB *jobs, int jobcnt, long long total)
+{
+	int i, cancelled;
+	time_t start;
+
+	if (jobcnt == 0)
+		return 0;
+	start = time(0);
+	cancelled = work_run(jobcnt,cmp_job,jobs,total);
+	/* digests of files read before a cancel are valid too */
+	for (i = 0; i < jobcnt; i++) {
+		if (jobs[i].new1)
+			digest_store(&jobs[i].st1,jobs[i].dg1,start);
+		if (jobs[i].new2)
+			digest_store(&jobs[i].st2,jobs[i].dg2,start);
+	}
+	digest_save();
+	return cancelled;
+}
+
+/*
+ * compare_files() compares 'cnt' pairs of files file1[i] and file2[i]
+ * by contents, results are stored in result[i]: -1 error, 0 equal,
+ * +1 different; 'total' is the total size of the files in one set
+ *
+ * return value: 0 = ok, -1 = cancelled by the user
+ */
+int
+compare_files(int cnt, char **file1, char **file2, int *result,
+  long long total)
+{
+	int i, cancelled;
+	CMP_JOB *jobs;
+
+	if (cnt == 0)
+		return 0;
+	digest_prepare();
+	jobs = emalloc(cnt * sizeof(CMP_JOB));
+	for (i = 0; i < cnt; i++) {
+		jobs[i].file1 = file1[i];
+		jobs[i].file2 = file2[i];
+		jobs[i].new1 = jobs[i].new2 = 0;
+	}
+	cancelled = cmp_run(jobs,cnt,total);
+	for (i = 0; i < cnt; i++)
+		result[i] = jobs[i].result;
+	free(jobs);
+	return cancelled;
+}
+
 /*
  * compare panels
  * levels:
@@ -222,55 +421,70 @@ file_cmp(const char *file1, const char *file2)
  *	3: name, type, size, ownership&mode
  *	4: name, type, size, contents
  *	5: name, type, size, ownership&mode, contents
+ *
+ * The entries are matched by a merge of two name-sorted index
+ * arrays, the order of the panels does not change. The contents
+ * (levels 4 and 5) are compared in parallel after all other checks
+ * are done. Unchanged files are compared by their cached digests
+ * (see digest.c).
  */
 void
 compare_panels(int level)
 {
-	int min, med, max, cmp, i, cnt1, errcnt;
+	int cmp, i, j, cnt1, cnt2, errcnt, jobcnt;
+	FLAG cancelled;
+	static int jobs_alloc = 0, idx1_alloc = 0, idx2_alloc = 0;
+	static CMP_JOB *jobs;
+	static FILE_ENTRY **idx1, **idx2;
+	long long total;
 	const char *name2;
 	FILE_ENTRY *pfe1, *pfe2;
 
-	errcnt = 0;
+	errcnt = jobcnt = 0;
+	total = 0;
 
-	/* reread panels */
-	list_both_directories();
+	/*
+	 * reread panels; level 0 compares only names and types,
+	 * listings known to be up to date will do
+	 */
+	if (level > 0 || !list_fresh(ppanel_file)
+	  || !list_fresh(ppanel_file->other))
+		list_both_directories();
 
 	if (level >= 4) {
 		win_waitmsg();
+		digest_prepare();
 		pathname_set_directory(USTR(ppanel_file->other->dir));
 	}
 
-	/* sort panel#1 by name (prepare for binary search) */
-	if ( (cnt1 = ppanel_file->pd->cnt) )
-		qsort(ppanel_file->files,cnt1,sizeof(FILE_ENTRY *),qcmp);
+	name_index(ppanel_file,&idx1,&idx1_alloc);
+	name_index(ppanel_file->other,&idx2,&idx2_alloc);
+	cnt1 = ppanel_file->pd->cnt;
+	cnt2 = ppanel_file->other->pd->cnt;
 
-	/* select all files in the panel#1 */
+	/* select all files in both panels */
 	for (i = 0; i < cnt1; i++)
-		ppanel_file->selected +=
-		  selectfile(ppanel_file->files[i],FN_SELECT);
+		ppanel_file->selected += selectfile(idx1[i],FN_SELECT);
+	for (i = 0; i < cnt2; i++)
+		ppanel_file->other->selected += selectfile(idx2[i],FN_SELECT);
 
-	/* for all files in panel#2 search for matching file in panel#1 */
-	for (i = 0; i < ppanel_file->other->pd->cnt; i++) {
-		pfe2 = ppanel_file->other->files[i];
-		ppanel_file->other->selected += selectfile(pfe2,FN_SELECT);
+	/* merge the sorted lists, i.e. find pairs of matching names */
+	for (i = j = 0; i < cnt1 && j < cnt2; ) {
+		pfe1 = idx1[i];
+		pfe2 = idx2[j];
 
 		/* all levels: comparing name */
 		name2 = SDSTR(pfe2->file);
-		for (pfe1 = 0, min = 0, max = cnt1 - 1; min <= max; ) {
-			med = (min + max) / 2;
-			cmp = strcmp(name2,SDSTR(ppanel_file->files[med]->file));
-			if (cmp == 0) {
-				pfe1 = ppanel_file->files[med];
-				/* entries *pfe1 and *pfe2 have the same name */
-				break;
-			}
+		if ( (cmp = strcmp(SDSTR(pfe1->file),name2)) ) {
 			if (cmp < 0)
-				max = med - 1;
+				i++;
 			else
-				min = med + 1;
-		}
-		if (pfe1 == 0)
+				j++;
 			continue;
+		}
+		/* entries *pfe1 and *pfe2 have the same name */
+		i++;
+		j++;
 
 		/* all levels: comparing type */
 		if ( !( (IS_FT_PLAIN(pfe1->file_type)
@@ -297,12 +511,19 @@ compare_panels(int level)
 		  || pfe1->gid != pfe2->gid || pfe1->mode12 != pfe2->mode12))
 			continue;
 
-		/* level 4+: comparing data (contents) */
-		if (level >= 4 && IS_FT_PLAIN(pfe1->file_type)
-		  && (cmp = file_cmp(SDSTR(pfe1->file),pathname_join(name2))) ) {
-			if (cmp < 0 && ++errcnt <= 3)
-				win_warning_fmt("COMPARE: Cannot read file '%s'.",
-				  name2);
+		/* level 4+: comparing data (contents) - postponed */
+		if (level >= 4 && IS_FT_PLAIN(pfe1->file_type)) {
+			if (jobcnt == jobs_alloc) {
+				jobs_alloc = jobs_alloc ? 2 * jobs_alloc : 64;
+				jobs = erealloc(jobs,jobs_alloc * sizeof(CMP_JOB));
+			}
+			jobs[jobcnt].pfe1 = pfe1;
+			jobs[jobcnt].pfe2 = pfe2;
+			jobs[jobcnt].file1 = SDSTR(pfe1->file);
+			jobs[jobcnt].file2 = estrdup(pathname_join(name2));
+			jobs[jobcnt].new1 = jobs[jobcnt].new2 = 0;
+			jobcnt++;
+			total += pfe1->size;
 			continue;
 		}
 
@@ -313,20 +534,58 @@ compare_panels(int level)
 		  selectfile(pfe2,FN_DESELECT);
 	}
 
+	/* level 4+: comparing data (contents) */
+	if ( (cancelled = cmp_run(jobs,jobcnt,total) < 0) ) {
+		/* cancelled, the results are not valid */
+		for (i = 0; i < cnt1; i++)
+			ppanel_file->selected += selectfile(idx1[i],FN_DESELECT);
+		for (i = 0; i < cnt2; i++)
+			ppanel_file->other->selected += selectfile(idx2[i],FN_DESELECT);
+		win_remark("compare cancelled");
+	}
+	for (i = 0; i < jobcnt; i++) {
+		free(jobs[i].file2);
+		if (cancelled)
+			continue;
+		if ( (cmp = jobs[i].result) ) {
+			if (cmp < 0 && ++errcnt <= 3)
+				win_warning_fmt("COMPARE: Cannot read file '%s'.",
+				  SDSTR(jobs[i].pfe2->file));
+			continue;
+		}
+		/* pair of matching files found */
+		ppanel_file->selected +=
+		  selectfile(jobs[i].pfe1,FN_DESELECT);
+		ppanel_file->other->selected +=
+		  selectfile(jobs[i].pfe2,FN_DESELECT);
+	}
+
 	if (errcnt > 3)
 		win_warning_fmt("COMPARE: %d files could not be read.",errcnt);
 
-	/* restore the sort order */
-	sort_files();
-
 	win_panel();
 }
 
+/* select or deselect a file panel entry */
+void
+select_file(PANEL_FILE *pfp, FILE_ENTRY *pfe, int select)
+{
+	pfp->selected += selectfile(pfe,select ? FN_SELECT : FN_DESELECT);
+}
+
 static void
 compare_level(int level)
 {
-	compare_panels(level);
-	next_mode = MODE_SPECIAL_RETURN;
+	if (level >= 8)
+		/* levels 8 and 9: duplicate files */
+		find_duplicates(level == 9);
+	else if (level >= 6)
+		/* levels 6 and 7: directory trees */
+		tree_compare(level == 7);
+	else {
+		compare_panels(level);
+		next_mode = MODE_SPECIAL_RETURN;
+	}
 }
 
 void cx_compare(void)   { compare_level(panel_compare.pd->curs); }
@@ -1,6 +1,8 @@
 extern void select_prepare(void);
 extern void compare_prepare(void);
 extern void cx_compare(void);
+extern int compare_files(int, char **, char **, int *, long long);
+extern void select_file(PANEL_FILE *, FILE_ENTRY *, int);
 extern void cx_select_toggle(void);
 extern void cx_select_invert(void);
 extern void cx_select_files(void);
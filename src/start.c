@@ -34,6 +34,7 @@
 #include "history.h"	/* hist_initialize() */
 #include "inout.h"		/* curses_initialize() */
 #include "lang.h"		/* lang_initialize() */
+#include "latency.h"	/* lat_initialize() */
 #include "list.h"		/* list_initialize() */
 #include "signals.h"	/* signal_initialize() */
 #include "tty.h"		/* tty_initialize() */
@@ -104,12 +105,14 @@ static PANEL_DESC pd_bm_mng =
 static PANEL_DESC pd_cfg =
   { CFG_VARIABLES,0,0,-3,PANEL_TYPE_CFG,0,el_cfg,0,0 };
 static PANEL_DESC pd_compare =
-  /* 6 items in this menu */
-  {  6,-1,2,-1,PANEL_TYPE_COMPARE,0,el_leave,0,0 };
+  /* 10 items in this menu */
+  { 10,-1,2,-1,PANEL_TYPE_COMPARE,0,el_leave,0,0 };
 static PANEL_DESC pd_compl =
   { 0,0,0,-1,PANEL_TYPE_COMPL,0,el_leave,0,0 };
 static PANEL_DESC pd_dir =
   { 0,0,0,-2,PANEL_TYPE_DIR,0,el_dir,&il_filt,0 };
+static PANEL_DESC pd_dir_jump =
+  { 0,0,0,-1,PANEL_TYPE_DIR_JUMP,0,el_leave,0,0 };
 static PANEL_DESC pd_dir_split =
   { 0,0,0,-1,PANEL_TYPE_DIR_SPLIT,0,el_dir,0,0 };
 static PANEL_DESC pd_grp =
@@ -118,15 +121,23 @@ static PANEL_DESC pd_help =
   { 0,0,0,-1,PANEL_TYPE_HELP,1,el_help,0,0 };
 static PANEL_DESC pd_hist =
   { 0,0,0,-1,PANEL_TYPE_HIST,0,el_leave,&il_filt,0 };
+static PANEL_DESC pd_jobs =
+  { 0,0,0,-1,PANEL_TYPE_JOBS,0,el_leave,0,0 };
+static PANEL_DESC pd_jobs_out =
+  { 0,0,0,-1,PANEL_TYPE_JOBS_OUT,0,el_leave,0,0 };
+static PANEL_DESC pd_lat =
+  { 0,0,0,-1,PANEL_TYPE_LATENCY,0,el_leave,0,0 };
 static PANEL_DESC pd_mainmenu =
-  /* 20 items in this menu */
-  { 20,-1,-1,-1,PANEL_TYPE_MAINMENU,0,el_leave,0,0 };
+  /* 28 items in this menu */
+  { 28,-1,-1,-1,PANEL_TYPE_MAINMENU,0,el_leave,0,0 };
 static PANEL_DESC pd_paste =
   /* 13 items in this menu */
   { 13,-1,-1,-1,PANEL_TYPE_PASTE,0,el_leave,0,0 };
 static PANEL_DESC pd_sort =
   /* 13 items in this menu */
   {  13,0,0,-1,PANEL_TYPE_SORT,0,el_leave,0,0 };
+static PANEL_DESC pd_treecmp =
+  { 0,0,0,-1,PANEL_TYPE_TREECMP,0,el_leave,0,0 };
 static PANEL_DESC pd_usr =
   { 0,0,0,-2,PANEL_TYPE_USER,0,el_usr,&il_filt,0 };
 PANEL_DESC *panel = 0;
@@ -134,13 +145,18 @@ PANEL_BM panel_bm_lst = { &pd_bm_lst }, panel_bm_mng = { &pd_bm_mng };
 PANEL_COMPL panel_compl = { &pd_compl };
 PANEL_CFG panel_cfg = { &pd_cfg };
 PANEL_DIR panel_dir = { &pd_dir }, panel_dir_split = { &pd_dir_split };
+PANEL_DIR panel_dir_jump = { &pd_dir_jump };
 PANEL_GROUP panel_group = { &pd_grp,0,0 };
 PANEL_HELP panel_help = { &pd_help };
 PANEL_HIST panel_hist = { &pd_hist };
+PANEL_JOBS panel_jobs = { &pd_jobs,0 };
+PANEL_JOBS_OUT panel_jobs_out = { &pd_jobs_out,0,0,0 };
+PANEL_LAT panel_lat = { &pd_lat };
 PANEL_MENU panel_mainmenu = { &pd_mainmenu };
 PANEL_MENU panel_compare = { &pd_compare };
 PANEL_MENU panel_paste = { &pd_paste };
 PANEL_SORT panel_sort =  { &pd_sort, SORT_NAME };
+PANEL_TREECMP panel_treecmp = { &pd_treecmp,0,0,0,0,0 };
 PANEL_USER panel_user = { &pd_usr,0,0 };
 PANEL_FILE *ppanel_file;
 DISPLAY display = { 0,0,0,0,0,0,0 };
@@ -238,6 +254,7 @@ main(int argc, char *argv[])
 		files_initialize();
 		hist_initialize();
 		lang_initialize();	/* lang_ before list_ */
+		lat_initialize();
 		list_initialize();
 		xterm_title_initialize();
 	}
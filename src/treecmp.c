@@ -0,0 +1,1076 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2006 Vlado Potisk <vlado_potisk@clex.sk>
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from http://www.clex.sk
+ *
+ */
+
+/*
+ * Directory tree compare: the primary and the secondary working
+ * directories are compared recursively, entries are matched by their
+ * relative pathnames and the differences are listed in a panel.
+ *
+ * Each pair of directories is one task of the worker pool (see
+ * workers.c), subdirectories found in both trees become new tasks.
+ * The contents of the files are compared afterwards, see
+ * compare_files() in select.c.
+ *
+ * Duplicate files search: files from both panels or both trees are
+ * grouped by size, then by a digest of their first and last block,
+ * and finally by a digest of their contents. Each step reads only
+ * files having a counterpart in the previous step.
+ *
+ * The task and job functions run on worker threads, they must not
+ * call emalloc() and other non thread-safe functions.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>	/* clex.h */
+#include <sys/stat.h>	/* lstat() */
+#include <fcntl.h>		/* open() */
+#include <stdlib.h>		/* malloc() */
+#include <string.h>		/* strcmp() */
+#include <time.h>		/* time() */
+#include <unistd.h>		/* readlink() */
+
+/* readdir() */
+#ifdef HAVE_DIRENT_H
+# include <dirent.h>
+#else
+# define dirent direct
+# ifdef HAVE_SYS_NDIR_H
+#  include <sys/ndir.h>
+# endif
+# ifdef HAVE_SYS_DIR_H
+#  include <sys/dir.h>
+# endif
+# ifdef HAVE_NDIR_H
+#  include <ndir.h>
+# endif
+#endif
+
+#if defined(HAVE_FSTATAT) && defined(HAVE_DIRFD)
+# define USE_FSTATAT
+#endif
+
+#include "clex.h"
+#include "treecmp.h"
+
+#include "digest.h"		/* digest_init() */
+#include "filepanel.h"	/* changedir() */
+#include "inout.h"		/* win_panel() */
+#include "list.h"		/* list_both_directories() */
+#include "sdstring.h"	/* SDSTR() */
+#include "select.h"		/* compare_files() */
+#include "ustring.h"	/* USTR() */
+#include "util.h"		/* emalloc() */
+#include "workers.h"	/* work_run_tasks() */
+
+/* directory entry */
+typedef struct {
+	char *name;
+	mode_t mode;			/* 0 = lstat() failed */
+	off_t size;
+	dev_t dev;
+	ino_t ino;
+} TC_DENT;
+
+/* results collected by one thread */
+typedef struct {
+	TREECMP_ENTRY *diff;	/* differences found */
+	int cnt, alloc;
+	char **pair;			/* files to be compared by contents */
+	int paircnt, pairalloc;
+	long long total;		/* total size of the 'pair' files */
+	FLAG nomem;				/* out of memory, results incomplete */
+} TC_RESULT;
+
+static TC_RESULT *result;
+static int result_cnt;
+static FLAG contents;		/* compare also the contents */
+
+/* join with a slash, malloc()-ed result */
+static char *
+tc_join(const char *dir, const char *name)
+{
+	size_t len;
+	char *path;
+
+	len = strlen(dir);
+	if ( (path = malloc(len + strlen(name) + 2)) == 0)
+		return 0;
+	strcpy(path,dir);
+	if (len > 0 && dir[len - 1] != '/')
+		path[len++] = '/';
+	strcpy(path + len,name);
+	return path;
+}
+
+/* record a difference, 'path' is freed later */
+static void
+tc_diff(TC_RESULT *pr, char *path, int diff, int dir)
+{
+	TREECMP_ENTRY *new;
+
+	if (path == 0) {
+		pr->nomem = 1;
+		return;
+	}
+	if (pr->cnt == pr->alloc) {
+		pr->alloc = pr->alloc ? 2 * pr->alloc : 64;
+		if ( (new = realloc(pr->diff,pr->alloc * sizeof(TREECMP_ENTRY))) == 0) {
+			pr->nomem = 1;
+			free(path);
+			return;
+		}
+		pr->diff = new;
+	}
+	pr->diff[pr->cnt].path = path;
+	pr->diff[pr->cnt].diff = diff;
+	pr->diff[pr->cnt].dir = dir;
+	pr->cnt++;
+}
+
+/* record a pair of files to be compared by contents */
+static void
+tc_pair(TC_RESULT *pr, char *path, off_t size)
+{
+	char **new;
+
+	if (path == 0) {
+		pr->nomem = 1;
+		return;
+	}
+	if (pr->paircnt == pr->pairalloc) {
+		pr->pairalloc = pr->pairalloc ? 2 * pr->pairalloc : 64;
+		if ( (new = realloc(pr->pair,pr->pairalloc * sizeof(char *))) == 0) {
+			pr->nomem = 1;
+			free(path);
+			return;
+		}
+		pr->pair = new;
+	}
+	pr->pair[pr->paircnt++] = path;
+	pr->total += size;
+}
+
+static int
+qcmp_dent(const void *e1, const void *e2)
+{
+	/* not strcoll() ! */
+	return strcmp(((TC_DENT *)e1)->name,((TC_DENT *)e2)->name);
+}
+
+static void
+tc_freedir(TC_DENT *list, int cnt)
+{
+	while (cnt > 0)
+		free(list[--cnt].name);
+	free(list);
+}
+
+/*
+ * read directory 'path' into a list sorted by name
+ * return value: number of entries, -1 error, -2 out of memory
+ */
+static int
+tc_readdir(const char *path, TC_DENT **plist)
+{
+	int cnt, alloc, ok;
+	DIR *dd;
+	struct dirent *direntry;
+	struct stat st;
+	const char *name;
+	TC_DENT *list, *new;
+#ifndef USE_FSTATAT
+	char *file;
+#endif
+
+	if ( (dd = opendir(path)) == 0)
+		return -1;
+	list = 0;
+	cnt = alloc = 0;
+	while ( (direntry = readdir(dd)) ) {
+		name = direntry->d_name;
+		if (name[0] == '.' && (name[1] == '\0'
+		  || (name[1] == '.' && name[2] == '\0')))
+			continue;
+		if (cnt == alloc) {
+			alloc = alloc ? 2 * alloc : 64;
+			if ( (new = realloc(list,alloc * sizeof(TC_DENT))) == 0)
+				break;
+			list = new;
+		}
+		if ( (list[cnt].name = malloc(strlen(name) + 1)) == 0)
+			break;
+		strcpy(list[cnt].name,name);
+#ifdef USE_FSTATAT
+		ok = fstatat(dirfd(dd),name,&st,AT_SYMLINK_NOFOLLOW) == 0;
+#else
+		if ( (file = tc_join(path,name)) == 0) {
+			free(list[cnt].name);
+			break;
+		}
+		ok = lstat(file,&st) == 0;
+		free(file);
+#endif
+		list[cnt].mode = ok ? st.st_mode : 0;
+		list[cnt].size = ok ? st.st_size : 0;
+		list[cnt].dev = ok ? st.st_dev : 0;
+		list[cnt].ino = ok ? st.st_ino : 0;
+		cnt++;
+	}
+	closedir(dd);
+	if (direntry) {
+		/* loop terminated by break */
+		tc_freedir(list,cnt);
+		return -2;
+	}
+
+	qsort(list,cnt,sizeof(TC_DENT),qcmp_dent);
+	*plist = list;
+	return cnt;
+}
+
+/* compare symbolic links: -1 error, 0 equal, +1 different */
+static int
+tc_linkcmp(const char *dir1, const char *dir2, const TC_DENT *pd)
+{
+	int cmp;
+	char *file1, *file2, *buff;
+	size_t size;
+
+	size = pd->size + 1;
+	file1 = tc_join(dir1,pd->name);
+	file2 = tc_join(dir2,pd->name);
+	buff = malloc(2 * size);
+	if (file1 == 0 || file2 == 0 || buff == 0)
+		cmp = -1;
+	else if (readlink(file1,buff,size) != size - 1
+	  || readlink(file2,buff + size,size) != size - 1)
+		cmp = -1;
+	else
+		cmp = memcmp(buff,buff + size,size - 1) != 0;
+	free(file1);
+	free(file2);
+	free(buff);
+	return cmp;
+}
+
+/* compare two directory entries with the same name */
+static void
+tc_entry(int thr, const char *rel, const char *dir1, const char *dir2,
+  const TC_DENT *pd1, const TC_DENT *pd2)
+{
+	int diff;
+	char *path;
+	TC_RESULT *pr;
+
+	pr = result + thr;
+	if (pd1->mode == 0 || pd2->mode == 0)
+		diff = TC_ERROR;
+	else if ((pd1->mode & S_IFMT) != (pd2->mode & S_IFMT))
+		diff = TC_TYPE;
+	else if (S_ISDIR(pd1->mode)) {
+		if ( (path = tc_join(rel,pd1->name)) == 0)
+			pr->nomem = 1;
+		else
+			work_push(thr,path);
+		return;
+	}
+	else if (S_ISREG(pd1->mode)) {
+		if (pd1->size != pd2->size)
+			diff = TC_SIZE;
+		else {
+			if (contents && pd1->size > 0)
+				tc_pair(pr,tc_join(rel,pd1->name),pd1->size);
+			return;
+		}
+	}
+	else if (S_ISLNK(pd1->mode)) {
+		if (pd1->size != pd2->size)
+			diff = TC_LINK;
+		else if ( (diff = tc_linkcmp(dir1,dir2,pd1)) == 0)
+			return;
+		else
+			diff = diff < 0 ? TC_ERROR : TC_LINK;
+	}
+	else
+		/* special files: type check only */
+		return;
+
+	tc_diff(pr,tc_join(rel,pd1->name),diff,S_ISDIR(pd1->mode)
+	  && S_ISDIR(pd2->mode));
+}
+
+/* worker pool task: compare directory 'rel' in both trees */
+static void
+tc_dir(void *task, int thr)
+{
+	int i1, i2, cnt1, cnt2, cmp;
+	char *rel, *dir1, *dir2;
+	TC_DENT *list1, *list2;
+	TC_RESULT *pr;
+
+	rel = task;
+	pr = result + thr;
+	dir1 = tc_join(panel_treecmp.root1,rel);
+	dir2 = tc_join(panel_treecmp.root2,rel);
+	if (dir1 == 0 || dir2 == 0) {
+		pr->nomem = 1;
+		free(dir1);
+		free(dir2);
+		free(rel);
+		return;
+	}
+
+	cnt1 = tc_readdir(dir1,&list1);
+	cnt2 = tc_readdir(dir2,&list2);
+	if (cnt1 < 0 || cnt2 < 0) {
+		if (cnt1 == -2 || cnt2 == -2) {
+			pr->nomem = 1;
+			free(rel);
+		}
+		else
+			tc_diff(pr,rel,TC_ERROR,1);
+		if (cnt1 >= 0)
+			tc_freedir(list1,cnt1);
+		if (cnt2 >= 0)
+			tc_freedir(list2,cnt2);
+		free(dir1);
+		free(dir2);
+		return;
+	}
+
+	/* merge join of two sorted lists */
+	for (i1 = i2 = 0; i1 < cnt1 || i2 < cnt2; ) {
+		if (i1 == cnt1)
+			cmp = 1;
+		else if (i2 == cnt2)
+			cmp = -1;
+		else
+			cmp = strcmp(list1[i1].name,list2[i2].name);
+		if (cmp < 0) {
+			tc_diff(pr,tc_join(rel,list1[i1].name),TC_ONLY1,
+			  S_ISDIR(list1[i1].mode));
+			i1++;
+		}
+		else if (cmp > 0) {
+			tc_diff(pr,tc_join(rel,list2[i2].name),TC_ONLY2,
+			  S_ISDIR(list2[i2].mode));
+			i2++;
+		}
+		else
+			tc_entry(thr,rel,dir1,dir2,list1 + i1++,list2 + i2++);
+	}
+
+	tc_freedir(list1,cnt1);
+	tc_freedir(list2,cnt2);
+	free(dir1);
+	free(dir2);
+	free(rel);
+}
+
+static int
+qcmp_diff(const void *e1, const void *e2)
+{
+	return strcmp(((TREECMP_ENTRY *)e1)->path,((TREECMP_ENTRY *)e2)->path);
+}
+
+/* add the thread results to the panel */
+static void
+tc_collect(void)
+{
+	int i, j, cnt;
+	TC_RESULT *pr;
+
+	for (cnt = i = 0; i < result_cnt; i++)
+		cnt += result[i].cnt;
+	if (cnt > panel_treecmp.alloc) {
+		free(panel_treecmp.diff);
+		panel_treecmp.alloc = cnt;
+		panel_treecmp.diff = emalloc(cnt * sizeof(TREECMP_ENTRY));
+	}
+	for (cnt = i = 0; i < result_cnt; i++) {
+		pr = result + i;
+		for (j = 0; j < pr->cnt; j++)
+			panel_treecmp.diff[cnt++] = pr->diff[j];
+		free(pr->diff);
+	}
+	panel_treecmp.pd->cnt = cnt;
+	qsort(panel_treecmp.diff,cnt,sizeof(TREECMP_ENTRY),qcmp_diff);
+}
+
+/* compare the contents of the collected file pairs */
+static int
+tc_contents(void)
+{
+	int i, j, cnt, cancelled, *cmp;
+	long long total;
+	char **rel, **file1, **file2;
+
+	for (cnt = i = 0, total = 0; i < result_cnt; i++) {
+		cnt += result[i].paircnt;
+		total += result[i].total;
+	}
+	if (cnt == 0)
+		return 0;
+
+	rel = emalloc(cnt * sizeof(char *));
+	file1 = emalloc(cnt * sizeof(char *));
+	file2 = emalloc(cnt * sizeof(char *));
+	cmp = emalloc(cnt * sizeof(int));
+	for (cnt = i = 0; i < result_cnt; i++)
+		for (j = 0; j < result[i].paircnt; j++)
+			rel[cnt++] = result[i].pair[j];
+	pathname_set_directory(panel_treecmp.root1);
+	for (i = 0; i < cnt; i++)
+		file1[i] = estrdup(pathname_join(rel[i]));
+	pathname_set_directory(panel_treecmp.root2);
+	for (i = 0; i < cnt; i++)
+		file2[i] = estrdup(pathname_join(rel[i]));
+
+	cancelled = compare_files(cnt,file1,file2,cmp,total);
+	for (i = 0; i < cnt; i++) {
+		free(file1[i]);
+		free(file2[i]);
+		if (cancelled || cmp[i] == 0)
+			free(rel[i]);
+		else
+			/* thread 0 results, it is safe to use them now */
+			tc_diff(result,rel[i],cmp[i] < 0 ? TC_ERROR : TC_DATA,0);
+	}
+	free(rel);
+	free(file1);
+	free(file2);
+	free(cmp);
+	return cancelled;
+}
+
+/* discard the current results */
+static void
+tc_clear(void)
+{
+	int i;
+
+	for (i = 0; i < panel_treecmp.pd->cnt; i++)
+		free(panel_treecmp.diff[i].path);
+	panel_treecmp.pd->cnt = 0;
+	free(panel_treecmp.root1);
+	free(panel_treecmp.root2);
+	panel_treecmp.root1 = panel_treecmp.root2 = 0;
+}
+
+/*
+ * tree_compare() compares the trees and switches to the results
+ * panel; 'data' = compare also the contents of the files
+ */
+void
+tree_compare(int data)
+{
+	int i, j, cancelled;
+	FLAG nomem;
+
+	tc_clear();
+	panel_treecmp.root1 = estrdup(USTR(ppanel_file->dir));
+	panel_treecmp.root2 = estrdup(USTR(ppanel_file->other->dir));
+	panel_treecmp.dups = 0;
+	contents = data;
+
+	result_cnt = work_threads();
+	result = emalloc(result_cnt * sizeof(TC_RESULT));
+	for (i = 0; i < result_cnt; i++) {
+		result[i].diff = 0;
+		result[i].cnt = result[i].alloc = 0;
+		result[i].pair = 0;
+		result[i].paircnt = result[i].pairalloc = 0;
+		result[i].total = 0;
+		result[i].nomem = 0;
+	}
+
+	win_waitmsg();
+	cancelled = work_run_tasks(tc_dir,estrdup(""));
+	if (!cancelled)
+		cancelled = tc_contents();
+	else
+		for (i = 0; i < result_cnt; i++)
+			for (j = 0; j < result[i].paircnt; j++)
+				free(result[i].pair[j]);
+
+	for (nomem = 0, i = 0; i < result_cnt; i++) {
+		free(result[i].pair);
+		if (result[i].nomem)
+			nomem = 1;
+	}
+	tc_collect();
+	free(result);
+
+	if (cancelled) {
+		tc_clear();
+		win_remark("compare cancelled");
+		next_mode = MODE_SPECIAL_RETURN;
+		return;
+	}
+	if (nomem)
+		win_warning("COMPARE: Out of memory, the results are incomplete.");
+	else if (panel_treecmp.pd->cnt == 0) {
+		win_remark("the directory trees are equal");
+		next_mode = MODE_SPECIAL_RETURN;
+		return;
+	}
+	panel_treecmp.pd->top = panel_treecmp.pd->min;
+	panel_treecmp.pd->curs = panel_treecmp.pd->cnt ? 0 : -1;
+	next_mode = MODE_TREECMP;
+}
+
+/*** duplicate files ***/
+
+/* the first and the last DUP_BLOCK bytes make the partial digest */
+#define DUP_BLOCK	4096
+/* files are read in windows of DUP_WINDOW bytes */
+#define DUP_WINDOW	(1024 * 1024)
+
+typedef struct {
+	char *path;			/* pathname relative to the root */
+	FILE_ENTRY *pfe;	/* file panel entry (panel search only) */
+	CODE side;			/* 0 = primary, 1 = secondary */
+	int seq;			/* order of collecting, the primary panel first */
+	FLAG error;			/* the file could not be read */
+	off_t size;
+	dev_t dev;
+	ino_t ino;
+	DIGEST partial;		/* digest of the first and the last block */
+	DIGEST full;		/* digest of the contents */
+} DUP_FILE;
+
+/* files collected by one thread */
+typedef struct {
+	DUP_FILE *file;
+	int cnt, alloc;
+	FLAG nomem;
+} DUP_RESULT;
+
+/* computation of a full digest */
+typedef struct {
+	DUP_FILE *pf;
+	struct stat st;		/* file status (digest cache key) */
+	FLAG new;			/* digest computed, not found in the cache */
+} DUP_JOB;
+
+static DUP_RESULT *dresult;
+static int dup_side;		/* tree being searched */
+static int dup_key;			/* see dup_refine() */
+
+static DUP_FILE *
+dup_add(DUP_RESULT *pr, char *path, off_t size, dev_t dev, ino_t ino)
+{
+	DUP_FILE *pf;
+
+	if (path == 0) {
+		pr->nomem = 1;
+		return 0;
+	}
+	if (pr->cnt == pr->alloc) {
+		pr->alloc = pr->alloc ? 2 * pr->alloc : 256;
+		if ( (pf = realloc(pr->file,pr->alloc * sizeof(DUP_FILE))) == 0) {
+			pr->nomem = 1;
+			free(path);
+			return 0;
+		}
+		pr->file = pf;
+	}
+	pf = pr->file + pr->cnt++;
+	pf->path = path;
+	pf->pfe = 0;
+	pf->side = dup_side;
+	pf->error = 0;
+	pf->size = size;
+	pf->dev = dev;
+	pf->ino = ino;
+	return pf;
+}
+
+/* worker pool task: collect plain files from directory 'rel' */
+static void
+dup_dir(void *task, int thr)
+{
+	int i, cnt;
+	char *rel, *dir, *path;
+	TC_DENT *list;
+	DUP_RESULT *pr;
+
+	rel = task;
+	pr = dresult + thr;
+	dir = tc_join(dup_side ? panel_treecmp.root2 : panel_treecmp.root1,rel);
+	if (dir == 0) {
+		pr->nomem = 1;
+		free(rel);
+		return;
+	}
+	cnt = tc_readdir(dir,&list);
+	if (cnt == -2)
+		pr->nomem = 1;
+	for (i = 0; i < cnt; i++)
+		if (S_ISDIR(list[i].mode)) {
+			if ( (path = tc_join(rel,list[i].name)) == 0)
+				pr->nomem = 1;
+			else
+				work_push(thr,path);
+		}
+		else if (S_ISREG(list[i].mode) && list[i].size > 0)
+			dup_add(pr,tc_join(rel,list[i].name),
+			  list[i].size,list[i].dev,list[i].ino);
+	if (cnt >= 0)
+		tc_freedir(list,cnt);
+	free(dir);
+	free(rel);
+}
+
+/* collect plain files from a file panel */
+static void
+dup_panel(PANEL_FILE *pfp)
+{
+	int i;
+	struct stat st;
+	FILE_ENTRY *pfe;
+	DUP_FILE *pf;
+
+	pathname_set_directory(USTR(pfp->dir));
+	for (i = 0; i < pfp->pd->cnt; i++) {
+		pfe = pfp->files[i];
+		if (!IS_FT_PLAIN(pfe->file_type) || pfe->symlink || pfe->size == 0
+		  || lstat(pathname_join(SDSTR(pfe->file)),&st) < 0)
+			continue;
+		if ( (pf = dup_add(dresult,estrdup(SDSTR(pfe->file)),st.st_size,
+		  st.st_dev,st.st_ino)) )
+			pf->pfe = pfe;
+	}
+}
+
+/* open the file and make sure it did not change */
+static int
+dup_open(const DUP_FILE *pf, struct stat *pst)
+{
+	int fd;
+	char *path;
+
+	if ( (path = tc_join(pf->side ?
+	  panel_treecmp.root2 : panel_treecmp.root1,pf->path)) == 0)
+		return -1;
+	fd = open(path,O_RDONLY | O_NONBLOCK);
+	free(path);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd,pst) < 0 || !S_ISREG(pst->st_mode)
+	  || pst->st_size != pf->size || pst->st_ino != pf->ino) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * job function: partial digest; small files are read entirely,
+ * their partial digest is the full digest
+ */
+static void
+dup_partial(void *data, int i)
+{
+	int fd;
+	size_t len;
+	struct stat st;
+	char buff[2 * DUP_BLOCK];
+	DIGEST_CTX ctx;
+	DUP_FILE *pf;
+
+	pf = ((DUP_FILE **)data)[i];
+	if ( (fd = dup_open(pf,&st)) < 0) {
+		pf->error = 1;
+		return;
+	}
+	if (pf->size <= 2 * DUP_BLOCK) {
+		len = pf->size;
+		pf->error = read_at(fd,buff,len,0) < 0;
+	}
+	else {
+		len = 2 * DUP_BLOCK;
+		pf->error = read_at(fd,buff,DUP_BLOCK,0) < 0
+		  || read_at(fd,buff + DUP_BLOCK,DUP_BLOCK,pf->size - DUP_BLOCK) < 0;
+	}
+	close(fd);
+	digest_init(&ctx);
+	digest_update(&ctx,buff,len);
+	pf->partial = pf->full = digest_final(&ctx);
+	work_add(len);
+}
+
+/* job function: full digest */
+static void
+dup_full(void *data, int i)
+{
+	int fd;
+	off_t offset;
+	size_t chunksize;
+	char *buff;
+	DIGEST_CTX ctx;
+	DUP_JOB *pj;
+	DUP_FILE *pf;
+
+	pj = (DUP_JOB *)data + i;
+	pf = pj->pf;
+	if ( (fd = dup_open(pf,&pj->st)) < 0) {
+		pf->error = 1;
+		return;
+	}
+	if (digest_lookup(&pj->st,&pf->full)) {
+		close(fd);
+		work_add(pf->size);
+		return;
+	}
+	/* malloc() and not emalloc(), see above */
+	if ( (buff = malloc(DUP_WINDOW)) == 0) {
+		close(fd);
+		pf->error = 1;
+		return;
+	}
+#ifdef HAVE_POSIX_FADVISE
+	posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+#endif
+	digest_init(&ctx);
+	for (offset = 0; offset < pf->size; offset += chunksize) {
+		if (work_cancelled()) {
+			pf->error = 1;
+			break;
+		}
+		chunksize = pf->size - offset > DUP_WINDOW ?
+		  DUP_WINDOW : pf->size - offset;
+		if (read_at(fd,buff,chunksize,offset) < 0) {
+			pf->error = 1;
+			break;
+		}
+		digest_update(&ctx,buff,chunksize);
+		work_add(chunksize);
+	}
+	free(buff);
+	close(fd);
+	if (!pf->error) {
+		pf->full = digest_final(&ctx);
+		pj->new = 1;
+	}
+}
+
+static int
+qcmp_inode(const void *e1, const void *e2)
+{
+	const DUP_FILE *pf1, *pf2;
+	int cmp;
+
+	pf1 = *(DUP_FILE **)e1;
+	pf2 = *(DUP_FILE **)e2;
+	if ( (cmp = CMP(pf1->dev,pf2->dev)) )
+		return cmp;
+	if ( (cmp = CMP(pf1->ino,pf2->ino)) )
+		return cmp;
+	/* keep the order of collecting, the primary panel first */
+	return CMP(pf1->seq,pf2->seq);
+}
+
+/* compare using the current 'dup_key', see dup_refine() */
+static int
+dup_keycmp(const DUP_FILE *pf1, const DUP_FILE *pf2)
+{
+	int cmp;
+
+	if ( (cmp = CMP(pf1->size,pf2->size)) )
+		return cmp;
+	if (dup_key == 1)
+		return CMP(pf1->partial,pf2->partial);
+	if (dup_key == 2)
+		return CMP(pf1->full,pf2->full);
+	return 0;
+}
+
+static int
+qcmp_dup(const void *e1, const void *e2)
+{
+	const DUP_FILE *pf1, *pf2;
+	int cmp;
+
+	pf1 = *(DUP_FILE **)e1;
+	pf2 = *(DUP_FILE **)e2;
+	if ( (cmp = dup_keycmp(pf1,pf2)) )
+		return cmp;
+	return CMP(pf1->seq,pf2->seq);
+}
+
+/*
+ * hard links to the same file are not duplicates,
+ * only one of them is kept
+ */
+static int
+dup_links(DUP_FILE **pf, int cnt)
+{
+	int i, j;
+
+	qsort(pf,cnt,sizeof(DUP_FILE *),qcmp_inode);
+	for (i = j = 0; i < cnt; i++)
+		if (j == 0 || pf[i]->dev != pf[j - 1]->dev
+		  || pf[i]->ino != pf[j - 1]->ino)
+			pf[j++] = pf[i];
+	return j;
+}
+
+/*
+ * dup_refine() sorts the files by size (key 0), size and partial
+ * digest (key 1), or size and full digest (key 2) and keeps only
+ * files having at least one equal counterpart
+ */
+static int
+dup_refine(DUP_FILE **pf, int cnt, int key)
+{
+	int i, j, k, next;
+
+	for (i = j = 0; i < cnt; i++)
+		if (!pf[i]->error)
+			pf[j++] = pf[i];
+	cnt = j;
+
+	dup_key = key;
+	qsort(pf,cnt,sizeof(DUP_FILE *),qcmp_dup);
+	for (i = j = 0; i < cnt; i = next) {
+		for (next = i + 1; next < cnt && dup_keycmp(pf[i],pf[next]) == 0;
+		  next++)
+			;
+		if (next - i >= 2)
+			for (k = i; k < next; k++)
+				pf[j++] = pf[k];
+	}
+	return j;
+}
+
+/* compute the partial digests, return value: 0 = ok, -1 = cancelled */
+static int
+dup_partials(DUP_FILE **pf, int cnt)
+{
+	int i;
+	long long total;
+
+	for (total = 0, i = 0; i < cnt; i++)
+		total += pf[i]->size > 2 * DUP_BLOCK ? 2 * DUP_BLOCK : pf[i]->size;
+	return work_run(cnt,dup_partial,pf,total);
+}
+
+/*
+ * compute the full digests of files larger than two blocks,
+ * return value: 0 = ok, -1 = cancelled
+ */
+static int
+dup_fulls(DUP_FILE **pf, int cnt)
+{
+	int i, jobcnt, cancelled;
+	long long total;
+	time_t start;
+	DUP_JOB *jobs;
+
+	jobs = emalloc(cnt * sizeof(DUP_JOB));
+	for (total = 0, jobcnt = i = 0; i < cnt; i++)
+		if (pf[i]->size > 2 * DUP_BLOCK) {
+			jobs[jobcnt].pf = pf[i];
+			jobs[jobcnt++].new = 0;
+			total += pf[i]->size;
+		}
+	start = time(0);
+	cancelled = jobcnt ? work_run(jobcnt,dup_full,jobs,total) : 0;
+	if (!cancelled) {
+		for (i = 0; i < jobcnt; i++)
+			if (jobs[i].new)
+				digest_store(&jobs[i].st,jobs[i].pf->full,start);
+		digest_save();
+	}
+	free(jobs);
+	return cancelled;
+}
+
+/* list the duplicates in the panel, the largest files first */
+static void
+dup_list(DUP_FILE **pf, int cnt)
+{
+	int i, first, end, group;
+	TREECMP_ENTRY *pe;
+
+	if (cnt > panel_treecmp.alloc) {
+		free(panel_treecmp.diff);
+		panel_treecmp.alloc = cnt;
+		panel_treecmp.diff = emalloc(cnt * sizeof(TREECMP_ENTRY));
+	}
+	pe = panel_treecmp.diff;
+	dup_key = 2;
+	for (group = 1, end = cnt; end > 0; group++, end = first) {
+		for (first = end - 1;
+		  first > 0 && dup_keycmp(pf[first - 1],pf[first]) == 0; first--)
+			;
+		for (i = first; i < end; i++, pe++) {
+			pe->path = estrdup(pf[i]->path);
+			pe->diff = pf[i]->side ? TC_DUP2 : TC_DUP1;
+			pe->dir = 0;
+			pe->group = group;
+		}
+	}
+	panel_treecmp.pd->cnt = cnt;
+	panel_treecmp.pd->top = panel_treecmp.pd->min;
+	panel_treecmp.pd->curs = 0;
+	next_mode = MODE_TREECMP;
+}
+
+/* select the duplicates in the file panels */
+static void
+dup_select(DUP_FILE **pf, int cnt)
+{
+	int i, side;
+	PANEL_FILE *pfp;
+
+	for (pfp = ppanel_file, side = 0; side < 2; pfp = pfp->other, side++)
+		for (i = 0; i < pfp->pd->cnt; i++)
+			select_file(pfp,pfp->files[i],0);
+	for (i = 0; i < cnt; i++)
+		select_file(pf[i]->side ? ppanel_file->other : ppanel_file,
+		  pf[i]->pfe,1);
+	win_panel();
+	next_mode = MODE_SPECIAL_RETURN;
+}
+
+/*
+ * find_duplicates() searches for files with equal contents
+ * 'tree' = search the whole directory trees and list the results,
+ * otherwise search the panels and select the duplicates
+ */
+void
+find_duplicates(int tree)
+{
+	int i, j, cnt, side, sides, groups, cancelled;
+	FLAG nomem;
+	DUP_FILE **pf;
+
+	tc_clear();
+	panel_treecmp.dups = 1;
+	if (!tree)
+		list_both_directories();
+	panel_treecmp.root1 = estrdup(USTR(ppanel_file->dir));
+	panel_treecmp.root2 = estrdup(USTR(ppanel_file->other->dir));
+	sides = strcmp(panel_treecmp.root1,panel_treecmp.root2) ? 2 : 1;
+	win_waitmsg();
+	digest_prepare();
+
+	/* collect the files */
+	result_cnt = tree ? work_threads() : 1;
+	dresult = emalloc(result_cnt * sizeof(DUP_RESULT));
+	for (i = 0; i < result_cnt; i++) {
+		dresult[i].file = 0;
+		dresult[i].cnt = dresult[i].alloc = 0;
+		dresult[i].nomem = 0;
+	}
+	cancelled = groups = 0;
+	for (dup_side = 0; dup_side < sides && !cancelled; dup_side++)
+		if (tree)
+			cancelled = work_run_tasks(dup_dir,estrdup(""));
+		else
+			dup_panel(dup_side ? ppanel_file->other : ppanel_file);
+
+	for (nomem = 0, cnt = i = 0; i < result_cnt; i++) {
+		cnt += dresult[i].cnt;
+		if (dresult[i].nomem)
+			nomem = 1;
+	}
+	pf = emalloc((cnt ? cnt : 1) * sizeof(DUP_FILE *));
+	/* the sequence number: side, thread, index */
+	for (cnt = side = 0; side < sides; side++)
+		for (i = 0; i < result_cnt; i++)
+			for (j = 0; j < dresult[i].cnt; j++)
+				if (dresult[i].file[j].side == side) {
+					dresult[i].file[j].seq = cnt;
+					pf[cnt++] = dresult[i].file + j;
+				}
+
+	/* narrow down the candidates */
+	if (!cancelled) {
+		cnt = dup_links(pf,cnt);
+		cnt = dup_refine(pf,cnt,0);
+		cancelled = dup_partials(pf,cnt);
+	}
+	if (!cancelled) {
+		cnt = dup_refine(pf,cnt,1);
+		cancelled = dup_fulls(pf,cnt);
+	}
+	if (!cancelled) {
+		cnt = dup_refine(pf,cnt,2);
+		dup_key = 2;
+		for (groups = i = 0; i < cnt; i++)
+			if (i == 0 || dup_keycmp(pf[i - 1],pf[i]))
+				groups++;
+		if (tree)
+			dup_list(pf,cnt);
+		else
+			dup_select(pf,cnt);
+	}
+
+	free(pf);
+	for (i = 0; i < result_cnt; i++) {
+		for (j = 0; j < dresult[i].cnt; j++)
+			free(dresult[i].file[j].path);
+		free(dresult[i].file);
+	}
+	free(dresult);
+
+	if (cancelled) {
+		win_remark("search cancelled");
+		next_mode = MODE_SPECIAL_RETURN;
+		return;
+	}
+	if (nomem)
+		win_warning("COMPARE: Out of memory, the results are incomplete.");
+	if (cnt == 0) {
+		win_remark("no duplicate files found");
+		next_mode = MODE_SPECIAL_RETURN;
+	}
+	else
+		win_remark_fmt("%d duplicate files in %d groups",cnt,groups);
+}
+
+void
+treecmp_prepare(void)
+{
+	panel = panel_treecmp.pd;
+	textline = 0;
+}
+
+/* change the working directory to the directory containing the entry */
+void
+cx_treecmp_enter(void)
+{
+	char *dir, *slash;
+	const char *root;
+	const TREECMP_ENTRY *pe;
+
+	pe = panel_treecmp.diff + panel_treecmp.pd->curs;
+	root = (pe->diff == TC_ONLY2 || pe->diff == TC_DUP2) ?
+	  panel_treecmp.root2 : panel_treecmp.root1;
+	if (*pe->path == '\0')
+		dir = estrdup(root);
+	else {
+		pathname_set_directory(root);
+		dir = estrdup(pathname_join(pe->path));
+		slash = strrchr(dir,'/');
+		slash[slash == dir] = '\0';
+	}
+	if (changedir(dir) == 0)
+		next_mode = MODE_SPECIAL_RETURN;
+	free(dir);
+}
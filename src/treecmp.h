@@ -0,0 +1,4 @@
+extern void tree_compare(int);
+extern void find_duplicates(int);
+extern void treecmp_prepare(void);
+extern void cx_treecmp_enter(void);
@@ -29,7 +29,8 @@
 
 extern int errno;
 
-static struct termios text_termios, raw_termios, *ptermios = 0;
+static struct termios text_termios, raw_termios, pass_termios;
+static struct termios *ptermios = 0;
 #ifdef _POSIX_JOB_CONTROL
 static pid_t save_pgid = 0;
 #endif
@@ -46,6 +47,10 @@ tty_initialize(void)
 	raw_termios.c_cc[VMIN] = 1;
 	raw_termios.c_cc[VTIME] = 0;
 
+	pass_termios = raw_termios;	/* struct copy */
+	pass_termios.c_iflag &= ~(ICRNL | INLCR | IGNCR | ISTRIP | IXON);
+	pass_termios.c_oflag &= ~OPOST;
+
 #ifdef _POSIX_JOB_CONTROL
 	/* move CLEX to its own process group */
 	save_pgid = tcgetpgrp(STDIN_FILENO);
@@ -61,6 +66,13 @@ tty_setraw(void)
 	tcsetattr(STDIN_FILENO,TCSAFLUSH,&raw_termios);
 }
 
+/* no processing at all, for passing data to a pseudo-terminal */
+void
+tty_setpassthru(void)
+{
+	tcsetattr(STDIN_FILENO,TCSAFLUSH,&pass_termios);
+}
+
 /* note: this is a cleanup function */
 void
 tty_reset(void)
@@ -110,7 +122,7 @@ tty_press_enter(void)
 	if (in == 't') {
 		puts("\n");
 		fflush(stdout);
-		execute("",DONOT_PROMPT_USER);
+		execute("",DONOT_PROMPT_USER,0);
 		tty_reset();
 	}
 
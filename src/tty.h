@@ -1,5 +1,6 @@
 extern void tty_initialize(void);
 extern void tty_setraw(void);
+extern void tty_setpassthru(void);
 extern void tty_reset(void);
 extern void tty_pgrp_reset(void);
 extern void tty_press_enter(void);
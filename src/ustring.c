@@ -51,6 +51,11 @@ extern int errno;
  *     a) allocate enough memory with us_setsize() or us_resize()
  *     b) edit the string starting at USTR() location
  *
+ * A USTRING with USalloc equal to zero does not own its string,
+ * it may point to a memory managed elsewhere (e.g. a mapped file).
+ * Such string is never freed, us_copy() and friends replace it with
+ * newly allocated memory. Do not use us_resize() on it.
+ *
  * WARNING: US_INIT, USTR, and PUSTR are macros
  */
 
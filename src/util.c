@@ -17,11 +17,12 @@
 #include <sys/types.h>			/* clex.h */
 #include <sys/stat.h>			/* fstat() */
 #include <ctype.h>				/* tolower */
+#include <errno.h>				/* EINTR */
 #include <fcntl.h>				/* open() */
 #include <stdio.h>				/* sprintf() */
 #include <stdlib.h>				/* malloc() */
 #include <string.h>				/* strlen() */
-#include <unistd.h>				/* read() */
+#include <unistd.h>				/* pread() */
 #include <limits.h>				/* SSIZE_MAX */
 
 #include "clex.h"
@@ -67,6 +68,32 @@ substring(const char *haystack, const char *needle, int ic)
 	return 0;
 }
 
+/*
+ * string hash function (FNV-1a) for the hash tables used
+ * throughout the program; the caller reduces the result
+ * to the table size with a bit mask
+ */
+unsigned int
+hash_str(const char *str)
+{
+	unsigned int hash;
+
+	for (hash = 2166136261U; *str; str++)
+		hash = (hash ^ (unsigned char)*str) * 16777619U;
+	return hash;
+}
+
+/* hash_str() for the first 'len' characters of the string */
+unsigned int
+hash_strn(const char *str, size_t len)
+{
+	unsigned int hash;
+
+	for (hash = 2166136261U; len-- > 0; str++)
+		hash = (hash ^ (unsigned char)*str) * 16777619U;
+	return hash;
+}
+
 static void
 alloc_fail(size_t size)
 {
@@ -208,6 +235,36 @@ read_fd(int fd, char *buff, size_t bytes)
 	return total;
 }
 
+/*
+ * read 'size' bytes at 'offset', return 0 if ok, -1 on error or EOF;
+ * it is thread-safe if pread() is available
+ */
+int
+read_at(int fd, char *buff, size_t size, off_t offset)
+{
+	ssize_t rd;
+
+#ifndef HAVE_PREAD
+	if (lseek(fd,offset,SEEK_SET) < 0)
+		return -1;
+#endif
+	while (size > 0) {
+#ifdef HAVE_PREAD
+		rd = pread(fd,buff,size,offset);
+#else
+		rd = read(fd,buff,size);
+#endif
+		if (rd == -1 && errno == EINTR)
+			continue;
+		if (rd <= 0)
+			return -1;
+		buff += rd;
+		size -= rd;
+		offset += rd;
+	}
+	return 0;
+}
+
 /*
  * read file into memory
  * input: filename, *size = max size
@@ -261,3 +318,31 @@ mod_time(const char *file)
 
 	return stat(file,&stbuf) < 0 ? 0 : stbuf.st_mtime;
 }
+
+/*
+ * duration_str() converts time 'msec' (in milliseconds) to a short
+ * human readable string (max 6 chars), e.g. 0.25s, 12.5s, 3m05s, 2h30m,
+ * times of 1000 hours and more are shown as 999h+
+ */
+const char *
+duration_str(long msec)
+{
+	static char buff[24];
+	long sec;
+
+	LIMIT_MIN(msec,0);
+	sec = msec / 1000;
+	if (msec < 10000)
+		sprintf(buff,"%ld.%02lds",sec,msec % 1000 / 10);
+	else if (msec < 100000)
+		sprintf(buff,"%ld.%lds",sec,msec % 1000 / 100);
+	else if (sec < 3600)
+		sprintf(buff,"%ldm%02lds",sec / 60,sec % 60);
+	else if (sec < 360000)
+		sprintf(buff,"%ldh%02ldm",sec / 3600,sec / 60 % 60);
+	else if (sec < 3600000)
+		sprintf(buff,"%ldh",sec / 3600);
+	else
+		strcpy(buff,"999h+");
+	return buff;
+}
@@ -1,5 +1,7 @@
 extern const char *base_name(const char *);
 extern int substring(const char *, const char *,int);
+extern unsigned int hash_str(const char *);
+extern unsigned int hash_strn(const char *, size_t);
 extern void *emalloc(size_t);
 extern void *erealloc(void *, size_t);
 extern char *estrdup(const char *);
@@ -7,5 +9,7 @@ extern void pathname_set_directory(const char *);
 extern char *pathname_join(const char *);
 extern size_t dequote_txt(const char *,  size_t, char *);
 extern ssize_t read_fd(int, char *, size_t);
+extern int read_at(int, char *, size_t, off_t);
 extern char *read_file(const char *, size_t *, int *);
 extern time_t mod_time(const char *);
+extern const char *duration_str(long);
@@ -0,0 +1,538 @@
+/*
+ *
+ * CLEX File Manager
+ *
+ * Copyright (C) 2001-2006 Vlado Potisk <vlado_potisk@clex.sk>
+ *
+ * CLEX is free software without warranty of any kind; see the
+ * GNU General Public License as set out in the "COPYING" document
+ * which accompanies the CLEX File Manager package.
+ *
+ * CLEX can be downloaded from http://www.clex.sk
+ *
+ */
+
+/*
+ * The worker pool runs lengthy I/O intensive jobs (e.g. comparing
+ * file contents) on several threads. A job consists of 'cnt'
+ * independent items processed by a job function. Meanwhile the main
+ * thread displays the progress and lets the user cancel the job.
+ *
+ * The job function must not call any curses or other non thread-safe
+ * CLEX function (including emalloc() and err_exit()).
+ *
+ * A task job starts with one task and every task may create new
+ * tasks (e.g. one task per directory of a tree). Each thread has
+ * its own task queue, it adds and takes its tasks at the tail of the
+ * queue (depth first order); an idle thread steals tasks from the
+ * head of other threads' queues.
+ *
+ * Without POSIX threads the items are processed sequentially by the
+ * main thread.
+ */
+
+#include <config.h>
+
+#include <sys/types.h>	/* clex.h */
+#include <errno.h>		/* ETIMEDOUT */
+#include <signal.h>		/* sigfillset() */
+#include <stdlib.h>		/* realloc() */
+#include <string.h>		/* memmove() */
+#include <unistd.h>		/* sysconf() */
+
+/* gettimeofday() */
+#if TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# if HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+# include <pthread.h>	/* pthread_create() */
+# define USE_THREADS
+#endif
+
+#include "clex.h"
+#include "workers.h"
+
+#include "inout.h"		/* win_progress_fmt() */
+
+/* max number of worker threads */
+#define WORKERS_MAX		16
+/* progress display interval */
+#define PROGRESS_MSEC	250
+
+static struct {
+	void (*fn)(void *, int);	/* job function */
+	void *data;					/* job function's data */
+	int cnt;					/* number of items, -1 = task job */
+	int next;					/* next item to be processed */
+	int done;					/* number of processed items */
+	int running;				/* number of running threads */
+	long long amount;			/* work_add() total */
+	long long total;			/* expected 'amount' when finished */
+	int pending;				/* number of unfinished tasks */
+	unsigned int gen;			/* incremented when a task is added */
+	struct timeval start;		/* start of the job */
+	volatile FLAG cancel;		/* the job was cancelled */
+} job;
+
+/* called by the main thread with the progress display */
+static void (*monitor)(void) = 0;
+
+/* task queue of one thread */
+typedef struct {
+	void **task;			/* queued tasks: task[head] to task[tail-1] */
+	int head, tail;
+	int alloc;				/* allocated size of 'task' */
+#ifdef USE_THREADS
+	pthread_mutex_t mutex;
+#endif
+} TASK_QUEUE;
+
+static TASK_QUEUE queue[WORKERS_MAX];
+static int queuecnt;
+
+#ifdef USE_THREADS
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t idle = PTHREAD_COND_INITIALIZER;
+# define QLOCK(PQ)		pthread_mutex_lock(&(PQ)->mutex)
+# define QUNLOCK(PQ)	pthread_mutex_unlock(&(PQ)->mutex)
+#else
+# define QLOCK(PQ)
+# define QUNLOCK(PQ)
+#endif
+
+/*
+ * number of threads to be used; thread numbers passed to
+ * the task job function are lower than this value
+ */
+int
+work_threads(void)
+{
+	int cpus;
+
+#ifdef _SC_NPROCESSORS_ONLN
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+	cpus = 1;
+#endif
+	/* the jobs are I/O bound, use more threads than processors */
+	cpus *= 2;
+	LIMIT_MIN(cpus,4);
+	LIMIT_MAX(cpus,WORKERS_MAX);
+	return cpus;
+}
+
+/* called by the job function to report the progress */
+void
+work_add(long long amount)
+{
+#ifdef USE_THREADS
+	pthread_mutex_lock(&mutex);
+	job.amount += amount;
+	pthread_mutex_unlock(&mutex);
+#else
+	job.amount += amount;
+#endif
+}
+
+/* called by the job function to report items done besides the tasks */
+void
+work_done(int cnt)
+{
+#ifdef USE_THREADS
+	pthread_mutex_lock(&mutex);
+	job.done += cnt;
+	pthread_mutex_unlock(&mutex);
+#else
+	job.done += cnt;
+#endif
+}
+
+/* change a counter shared by several tasks, return its new value */
+int
+work_count(int *counter, int delta)
+{
+	int value;
+
+#ifdef USE_THREADS
+	pthread_mutex_lock(&mutex);
+	value = *counter += delta;
+	pthread_mutex_unlock(&mutex);
+#else
+	value = *counter += delta;
+#endif
+	return value;
+}
+
+/*
+ * set a function to be called by the main thread periodically
+ * during the next job, e.g. to show partial results in the panel
+ */
+void
+work_monitor(void (*fn)(void))
+{
+	monitor = fn;
+}
+
+/* called by the job function to check if it should terminate early */
+int
+work_cancelled(void)
+{
+	return job.cancel;
+}
+
+static long
+elapsed_msec(const struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now,0);
+	return (now.tv_sec - start->tv_sec) * 1000L
+	  + (now.tv_usec - start->tv_usec) / 1000;
+}
+
+/* progress display; executed periodically by the main thread */
+static void
+work_progress(void)
+{
+	int pct;
+	long msec;
+	long long amount;
+	int done;
+
+#ifdef USE_THREADS
+	pthread_mutex_lock(&mutex);
+#endif
+	amount = job.amount;
+	done = job.done;
+#ifdef USE_THREADS
+	pthread_mutex_unlock(&mutex);
+#endif
+
+	if (job.cancel)
+		return;
+	if (monitor)
+		(*monitor)();
+	if (kbd_interrupt()) {
+		job.cancel = 1;
+		win_progress_fmt("< CANCELLING >");
+		return;
+	}
+	if (job.cnt < 0) {
+		/* task jobs reporting an amount are copying data */
+		if (amount > 0 && (msec = elapsed_msec(&job.start)) > 0)
+			win_progress_fmt("< %lld MB  %lld MB/s  ctrl-C = cancel >",
+			  amount / 1000000,amount / 1000 / msec);
+		else
+			win_progress_fmt("< %d done  ctrl-C = cancel >",done);
+		return;
+	}
+	pct = job.total > 0 ? (int)(100 * amount / job.total)
+	  : (int)(100LL * done / job.cnt);
+	LIMIT_MAX(pct,99);
+	win_progress_fmt("< %d%%  ctrl-C = cancel >",pct);
+}
+
+/* add a task to the queue, return -1 if out of memory */
+static int
+queue_put(TASK_QUEUE *pq, void *task)
+{
+	int alloc;
+	void **new;
+
+	QLOCK(pq);
+	if (pq->tail == pq->alloc) {
+		if (pq->head > 0) {
+			memmove(pq->task,pq->task + pq->head,
+			  (pq->tail - pq->head) * sizeof(void *));
+			pq->tail -= pq->head;
+			pq->head = 0;
+		}
+		else {
+			/* realloc() and not erealloc(), see above */
+			alloc = pq->alloc ? 2 * pq->alloc : 64;
+			if ( (new = realloc(pq->task,alloc * sizeof(void *))) == 0) {
+				QUNLOCK(pq);
+				return -1;
+			}
+			pq->task = new;
+			pq->alloc = alloc;
+		}
+	}
+	pq->task[pq->tail++] = task;
+	QUNLOCK(pq);
+	return 0;
+}
+
+/* take a task from the tail (owner) or from the head (thief) */
+static void *
+queue_get(TASK_QUEUE *pq, int steal)
+{
+	void *task;
+
+	QLOCK(pq);
+	if (pq->tail == pq->head)
+		task = 0;
+	else if (steal)
+		task = pq->task[pq->head++];
+	else
+		task = pq->task[--pq->tail];
+	QUNLOCK(pq);
+	return task;
+}
+
+/*
+ * called by the task job function running on thread 'thr' to add
+ * a new task; if it cannot be queued, it is processed immediately
+ */
+void
+work_push(int thr, void *task)
+{
+	if (queue_put(queue + thr,task) < 0) {
+		(*job.fn)(task,thr);
+		return;
+	}
+#ifdef USE_THREADS
+	pthread_mutex_lock(&mutex);
+	job.pending++;
+	job.gen++;
+	pthread_cond_broadcast(&idle);
+	pthread_mutex_unlock(&mutex);
+#else
+	job.pending++;
+#endif
+}
+
+#ifdef USE_THREADS
+static void *
+task_worker(void *arg)
+{
+	int i, thr;
+	unsigned int gen;
+	void *task;
+
+	thr = *(int *)arg;
+	pthread_mutex_lock(&mutex);
+	while (!job.cancel && job.pending > 0) {
+		gen = job.gen;
+		pthread_mutex_unlock(&mutex);
+
+		task = queue_get(queue + thr,0);
+		for (i = 1; task == 0 && i < queuecnt; i++)
+			task = queue_get(queue + (thr + i) % queuecnt,1);
+
+		pthread_mutex_lock(&mutex);
+		if (task) {
+			pthread_mutex_unlock(&mutex);
+			(*job.fn)(task,thr);
+			pthread_mutex_lock(&mutex);
+			job.done++;
+			if (--job.pending == 0)
+				pthread_cond_broadcast(&idle);
+		}
+		else if (job.gen == gen && job.pending > 0 && !job.cancel)
+			/* nothing to steal, wait for new tasks */
+			pthread_cond_wait(&idle,&mutex);
+	}
+	if (--job.running == 0)
+		pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+	return 0;
+}
+
+static void *
+worker(void *unused)
+{
+	int i;
+
+	pthread_mutex_lock(&mutex);
+	while (!job.cancel && job.next < job.cnt) {
+		i = job.next++;
+		pthread_mutex_unlock(&mutex);
+		(*job.fn)(job.data,i);
+		pthread_mutex_lock(&mutex);
+		job.done++;
+	}
+	if (--job.running == 0)
+		pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+	return 0;
+}
+
+/*
+ * start 'nthr' threads and display the progress until all of them
+ * terminate; return the number of threads actually started
+ */
+static int
+run_threads(int nthr, void *(*thread_fn)(void *))
+{
+	int i;
+	FLAG running;
+	sigset_t all, save;
+	struct timeval now;
+	struct timespec deadline;
+	pthread_t thread[WORKERS_MAX];
+	static int thrnum[WORKERS_MAX];
+
+	/* signals are handled by the main thread only */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK,&all,&save);
+	pthread_mutex_lock(&mutex);
+	for (job.running = i = 0; i < nthr; i++) {
+		thrnum[job.running] = job.running;
+		if (pthread_create(thread + job.running,0,thread_fn,
+		  thrnum + job.running) == 0)
+			job.running++;
+	}
+	pthread_mutex_unlock(&mutex);
+	pthread_sigmask(SIG_SETMASK,&save,0);
+	if ((nthr = job.running) == 0)
+		return 0;
+
+	for (;/* until break */;) {
+		gettimeofday(&now,0);
+		now.tv_usec += PROGRESS_MSEC * 1000L;
+		deadline.tv_sec = now.tv_sec + now.tv_usec / 1000000;
+		deadline.tv_nsec = now.tv_usec % 1000000 * 1000;
+		pthread_mutex_lock(&mutex);
+		while (job.running
+		  && pthread_cond_timedwait(&cond,&mutex,&deadline) != ETIMEDOUT)
+			;
+		running = job.running > 0;
+		pthread_mutex_unlock(&mutex);
+		if (!running)
+			break;
+		work_progress();
+		if (job.cancel) {
+			/* wake up idle threads */
+			pthread_mutex_lock(&mutex);
+			pthread_cond_broadcast(&idle);
+			pthread_mutex_unlock(&mutex);
+		}
+	}
+	for (i = 0; i < nthr; i++)
+		pthread_join(thread[i],0);
+	return nthr;
+}
+#endif
+
+/*
+ * work_run() processes items 0 to 'cnt'-1 by calling fn(data,item)
+ * on the worker threads; 'total' is the expected sum of work_add()
+ * amounts (e.g. bytes) used for the progress display, if it is zero,
+ * the progress is computed from the number of processed items
+ *
+ * return value: 0 = ok, -1 = cancelled by the user
+ */
+int
+work_run(int cnt, void (*fn)(void *, int), void *data, long long total)
+{
+	int i;
+	struct timeval start;
+
+	job.fn = fn;
+	job.data = data;
+	job.cnt = cnt;
+	job.next = job.done = 0;
+	job.amount = 0;
+	job.total = total;
+	job.cancel = 0;
+	if (cnt == 0) {
+		monitor = 0;
+		return 0;
+	}
+
+#ifdef USE_THREADS
+	i = work_threads();
+	LIMIT_MAX(i,cnt);
+	if (run_threads(i,worker) > 0) {
+		monitor = 0;
+		return job.cancel ? -1 : 0;
+	}
+	/* no thread could be created, do the work here */
+#endif
+
+	gettimeofday(&start,0);
+	for (i = 0; i < cnt && !job.cancel; i++) {
+		(*fn)(data,i);
+		job.done++;
+		if (elapsed_msec(&start) >= PROGRESS_MSEC) {
+			work_progress();
+			gettimeofday(&start,0);
+		}
+	}
+	monitor = 0;
+	return job.cancel ? -1 : 0;
+}
+
+/*
+ * work_run_tasks() processes 'task' and all tasks added with
+ * work_push() by calling fn(task,thr) on the worker threads, 'thr'
+ * is the number of the calling thread; the tasks must be allocated
+ * with malloc() and freed by the job function, tasks not processed
+ * due to a cancel are freed here
+ *
+ * return value: 0 = ok, -1 = cancelled by the user
+ */
+int
+work_run_tasks(void (*fn)(void *, int), void *task)
+{
+	int i;
+	struct timeval start;
+
+	job.fn = fn;
+	job.data = 0;
+	job.cnt = -1;
+	job.done = 0;
+	job.amount = job.total = 0;
+	job.cancel = 0;
+	job.pending = 0;
+	gettimeofday(&job.start,0);
+	queuecnt = work_threads();
+	for (i = 0; i < queuecnt; i++) {
+		queue[i].head = queue[i].tail = 0;
+#ifdef USE_THREADS
+		pthread_mutex_init(&queue[i].mutex,0);
+#endif
+	}
+	work_push(0,task);
+
+#ifdef USE_THREADS
+	if (run_threads(queuecnt,task_worker) == 0)
+#endif
+	{
+		/* no thread could be created, do the work here */
+		gettimeofday(&start,0);
+		while (!job.cancel) {
+			for (i = 0; (task = queue_get(queue + i,0)) == 0; )
+				if (++i == queuecnt)
+					break;
+			if (task == 0)
+				break;
+			(*fn)(task,0);
+			job.done++;
+			if (elapsed_msec(&start) >= PROGRESS_MSEC) {
+				work_progress();
+				gettimeofday(&start,0);
+			}
+		}
+	}
+
+	for (i = 0; i < queuecnt; i++) {
+		while ( (task = queue_get(queue + i,0)) )
+			free(task);
+#ifdef USE_THREADS
+		pthread_mutex_destroy(&queue[i].mutex);
+#endif
+	}
+	monitor = 0;
+	return job.cancel ? -1 : 0;
+}
@@ -0,0 +1,9 @@
+extern int work_run(int, void (*)(void *, int), void *, long long);
+extern void work_add(long long);
+extern void work_done(int);
+extern int work_count(int *, int);
+extern void work_monitor(void (*)(void));
+extern int work_cancelled(void);
+extern int work_threads(void);
+extern int work_run_tasks(void (*)(void *, int), void *);
+extern void work_push(int, void *);
@@ -28,6 +28,14 @@
 # include <sys/wait.h>
 #endif
 
+/* posix_spawnp() */
+#if defined(HAVE_SPAWN_H) && defined(HAVE_POSIX_SPAWN)
+# include <spawn.h>
+# include <sys/select.h>	/* select() */
+# define USE_SPAWN
+extern char **environ;
+#endif
+
 #include "clex.h"
 #include "xterm_title.h"
 
@@ -62,11 +70,58 @@ get_title(void)
 	const char *wid;
 	char *p1, *p2, title[128];
 	pid_t pid;
+#ifdef USE_SPAWN
+	int err;
+	char *argv[5];
+	fd_set fds;
+	struct timeval tv;
+	posix_spawn_file_actions_t actions;
+#else
 	struct sigaction act;
+#endif
 
 	if ( (wid = getenv("WINDOWID")) == 0)
 		return 0;
 
+#ifdef USE_SPAWN
+	if (pipe(fd) < 0)
+		return 0;
+	if (posix_spawn_file_actions_init(&actions)) {
+		close(fd[0]);
+		close(fd[1]);
+		return 0;
+	}
+	posix_spawn_file_actions_addclose(&actions,fd[0]);
+	if (fd[1] != STDOUT_FILENO) {
+		posix_spawn_file_actions_adddup2(&actions,fd[1],STDOUT_FILENO);
+		posix_spawn_file_actions_addclose(&actions,fd[1]);
+	}
+	argv[0] = "xprop";
+	argv[1] = "-id";
+	argv[2] = (char *)wid;
+	argv[3] = "WM_NAME";
+	argv[4] = 0;
+	err = posix_spawnp(&pid,"xprop",&actions,0,argv,environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(fd[1]);	/* close write end */
+	if (err) {
+		close(fd[0]);
+		return 0;
+	}
+
+	/* the child cannot set an alarm, the timeout is handled here */
+	FD_ZERO(&fds);
+	FD_SET(fd[0],&fds);
+	tv.tv_sec = XPROP_TIMEOUT;
+	tv.tv_usec = 0;
+	if (select(fd[0] + 1,&fds,0,0,&tv) <= 0) {
+		kill(pid,SIGKILL);
+		rd = -1;
+	}
+	else
+		rd = read_fd(fd[0],title,sizeof(title) - 1);
+	close(fd[0]);
+#else
 	if (pipe(fd) < 0 || (pid = fork()) < 0)
 		return 0;
 
@@ -94,6 +149,7 @@ get_title(void)
 	close(fd[1]);	/* close write end */
 	rd = read_fd(fd[0],title,sizeof(title) - 1);
 	close(fd[0]);
+#endif
 
 	if (waitpid(pid, 0, 0) < 0)
 		return 0;